@@ -150,7 +150,7 @@ static int evbuffer_readfile(struct evbuffer *buf, evutil_socket_t fd,
 #endif
 
 static struct evbuffer_chain *
-evbuffer_chain_new(size_t size)
+evbuffer_chain_new(struct evbuffer *buf, size_t size)
 {
 	struct evbuffer_chain *chain;
 	size_t to_alloc;
@@ -163,10 +163,11 @@ evbuffer_chain_new(size_t size)
 		to_alloc <<= 1;
 
 	/* we get everything in one chunk */
-	if ((chain = mm_malloc(to_alloc)) == NULL)
+	if ((chain = mm_malloc_with(buf->mm, to_alloc)) == NULL)
 		return (NULL);
 
 	memset(chain, 0, EVBUFFER_CHAIN_SIZE);
+	chain->mm = buf->mm;
 
 	chain->buffer_len = to_alloc - EVBUFFER_CHAIN_SIZE;
 
@@ -221,7 +222,7 @@ evbuffer_chain_free(struct evbuffer_chain *chain)
 #endif
 	}
 
-	mm_free(chain);
+	mm_free_with(chain->mm, chain);
 }
 
 static void
@@ -281,7 +282,7 @@ static inline struct evbuffer_chain *
 evbuffer_chain_insert_new(struct evbuffer *buf, size_t datlen)
 {
 	struct evbuffer_chain *chain;
-	if ((chain = evbuffer_chain_new(datlen)) == NULL)
+	if ((chain = evbuffer_chain_new(buf, datlen)) == NULL)
 		return NULL;
 	evbuffer_chain_insert(buf, chain);
 	return chain;
@@ -359,6 +360,7 @@ evbuffer_enable_locking(struct evbuffer *buf, void *lock)
 		EVTHREAD_ALLOC_LOCK(lock, EVTHREAD_LOCKTYPE_RECURSIVE);
 		if (!lock)
 			return -1;
+		EVTHREAD_SET_LOCK_CLASS(lock, EVTHREAD_LOCK_CLASS_EVBUFFER);
 		buf->lock = lock;
 		buf->own_lock = 1;
 	} else {
@@ -718,7 +720,7 @@ PRESERVE_PINNED(struct evbuffer *src, struct evbuffer_chain **first,
 		struct evbuffer_chain *tmp;
 
 		EVUTIL_ASSERT(pinned == src->last_with_datap);
-		tmp = evbuffer_chain_new(chain->off);
+		tmp = evbuffer_chain_new(src, chain->off);
 		if (!tmp)
 			return -1;
 		memcpy(tmp->buffer, chain->buffer + chain->misalign,
@@ -1166,7 +1168,7 @@ evbuffer_pullup(struct evbuffer *buf, ev_ssize_t size)
 		size -= old_off;
 		chain = chain->next;
 	} else {
-		if ((tmp = evbuffer_chain_new(size)) == NULL) {
+		if ((tmp = evbuffer_chain_new(buf, size)) == NULL) {
 			event_warn("%s: out of memory", __func__);
 			goto done;
 		}
@@ -1486,7 +1488,7 @@ evbuffer_add(struct evbuffer *buf, const void *data_in, size_t datlen)
 	/* If there are no chains allocated for this buffer, allocate one
 	 * big enough to hold all the data. */
 	if (chain == NULL) {
-		chain = evbuffer_chain_new(datlen);
+		chain = evbuffer_chain_new(buf, datlen);
 		if (!chain)
 			goto done;
 		evbuffer_chain_insert(buf, chain);
@@ -1524,7 +1526,7 @@ evbuffer_add(struct evbuffer *buf, const void *data_in, size_t datlen)
 		to_alloc <<= 1;
 	if (datlen > to_alloc)
 		to_alloc = datlen;
-	tmp = evbuffer_chain_new(to_alloc);
+	tmp = evbuffer_chain_new(buf, to_alloc);
 	if (tmp == NULL)
 		goto done;
 
@@ -1566,7 +1568,7 @@ evbuffer_prepend(struct evbuffer *buf, const void *data, size_t datlen)
 	chain = buf->first;
 
 	if (chain == NULL) {
-		chain = evbuffer_chain_new(datlen);
+		chain = evbuffer_chain_new(buf, datlen);
 		if (!chain)
 			goto done;
 		evbuffer_chain_insert(buf, chain);
@@ -1602,7 +1604,7 @@ evbuffer_prepend(struct evbuffer *buf, const void *data, size_t datlen)
 	}
 
 	/* we need to add another chain */
-	if ((tmp = evbuffer_chain_new(datlen)) == NULL)
+	if ((tmp = evbuffer_chain_new(buf, datlen)) == NULL)
 		goto done;
 	buf->first = tmp;
 	if (buf->last_with_datap == &buf->first)
@@ -1721,7 +1723,7 @@ evbuffer_expand_singlechain(struct evbuffer *buf, size_t datlen)
 		 * MAX_TO_COPY_IN_EXPAND bytes. */
 		/* figure out how much space we need */
 		size_t length = chain->off + datlen;
-		struct evbuffer_chain *tmp = evbuffer_chain_new(length);
+		struct evbuffer_chain *tmp = evbuffer_chain_new(buf, length);
 		if (tmp == NULL)
 			goto err;
 
@@ -1767,7 +1769,7 @@ _evbuffer_expand_fast(struct evbuffer *buf, size_t datlen, int n)
 	if (chain == NULL || (chain->flags & EVBUFFER_IMMUTABLE)) {
 		/* There is no last chunk, or we can't touch the last chunk.
 		 * Just add a new chunk. */
-		chain = evbuffer_chain_new(datlen);
+		chain = evbuffer_chain_new(buf, datlen);
 		if (chain == NULL)
 			return (-1);
 
@@ -1810,7 +1812,7 @@ _evbuffer_expand_fast(struct evbuffer *buf, size_t datlen, int n)
 		 * chains; we can add another. */
 		EVUTIL_ASSERT(chain == NULL);
 
-		tmp = evbuffer_chain_new(datlen - avail);
+		tmp = evbuffer_chain_new(buf, datlen - avail);
 		if (tmp == NULL)
 			return (-1);
 
@@ -1839,7 +1841,7 @@ _evbuffer_expand_fast(struct evbuffer *buf, size_t datlen, int n)
 			EVUTIL_ASSERT(chain->off == 0);
 			evbuffer_chain_free(chain);
 		}
-		tmp = evbuffer_chain_new(datlen - avail);
+		tmp = evbuffer_chain_new(buf, datlen - avail);
 		if (tmp == NULL) {
 			if (rmv_all) {
 				ZERO_CHAIN(buf);
@@ -2602,7 +2604,8 @@ evbuffer_add_reference(struct evbuffer *outbuf,
 	struct evbuffer_chain_reference *info;
 	int result = -1;
 
-	chain = evbuffer_chain_new(sizeof(struct evbuffer_chain_reference));
+	chain = evbuffer_chain_new(outbuf,
+	    sizeof(struct evbuffer_chain_reference));
 	if (!chain)
 		return (-1);
 	chain->flags |= EVBUFFER_REFERENCE | EVBUFFER_IMMUTABLE;
@@ -2618,7 +2621,7 @@ evbuffer_add_reference(struct evbuffer *outbuf,
 	if (outbuf->freeze_end) {
 		/* don't call chain_free; we do not want to actually invoke
 		 * the cleanup function */
-		mm_free(chain);
+		mm_free_with(chain->mm, chain);
 		goto done;
 	}
 	evbuffer_chain_insert(outbuf, chain);
@@ -2652,7 +2655,8 @@ evbuffer_add_file(struct evbuffer *outbuf, int fd,
 
 #if defined(USE_SENDFILE)
 	if (use_sendfile) {
-		chain = evbuffer_chain_new(sizeof(struct evbuffer_chain_fd));
+		chain = evbuffer_chain_new(outbuf,
+		    sizeof(struct evbuffer_chain_fd));
 		if (chain == NULL) {
 			event_warn("%s: out of memory", __func__);
 			return (-1);
@@ -2669,7 +2673,7 @@ evbuffer_add_file(struct evbuffer *outbuf, int fd,
 
 		EVBUFFER_LOCK(outbuf);
 		if (outbuf->freeze_end) {
-			mm_free(chain);
+			mm_free_with(chain->mm, chain);
 			ok = 0;
 		} else {
 			outbuf->n_add_for_cb += length;
@@ -2699,7 +2703,8 @@ evbuffer_add_file(struct evbuffer *outbuf, int fd,
 			    __func__, fd, 0, (size_t)(offset + length));
 			return (-1);
 		}
-		chain = evbuffer_chain_new(sizeof(struct evbuffer_chain_fd));
+		chain = evbuffer_chain_new(outbuf,
+		    sizeof(struct evbuffer_chain_fd));
 		if (chain == NULL) {
 			event_warn("%s: out of memory", __func__);
 			munmap(mapped, length);
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2009-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+   @file buffer_uring.c
+
+   This module implements io_uring read and write functions for evbuffer
+   objects on Linux.  It works like buffer_iocp.c: the chains involved in
+   an operation are pinned and the affected end of the buffer is frozen
+   until the kernel reports completion.
+*/
+
+#include "event2/event-config.h"
+#include "event2/buffer.h"
+#include "event2/buffer_compat.h"
+#include "event2/util.h"
+#include "event2/thread.h"
+#include "util-internal.h"
+#include "evthread-internal.h"
+#include "evbuffer-internal.h"
+#include "uring-internal.h"
+#include "mm-internal.h"
+
+#include <string.h>
+
+/** Unpin all the chains noted as pinned in 'io'. */
+static void
+pin_release(struct evbuffer_uring_io *io, unsigned flag)
+{
+	int i;
+	struct evbuffer_chain *next, *chain = io->first_pinned;
+
+	for (i = 0; i < io->n_buffers; ++i) {
+		EVUTIL_ASSERT(chain);
+		next = chain->next;
+		_evbuffer_chain_unpin(chain, flag);
+		chain = next;
+	}
+}
+
+void
+evbuffer_uring_commit_read(struct evbuffer *evbuf,
+    struct evbuffer_uring_io *io, ev_ssize_t nBytes)
+{
+	struct evbuffer_chain **chainp;
+	size_t remaining, len;
+	unsigned i;
+
+	EVBUFFER_LOCK(evbuf);
+	if (nBytes < 0)
+		nBytes = 0;
+
+	evbuffer_unfreeze(evbuf, 0);
+
+	chainp = evbuf->last_with_datap;
+	if (!((*chainp)->flags & EVBUFFER_MEM_PINNED_R))
+		chainp = &(*chainp)->next;
+	remaining = nBytes;
+	for (i = 0; remaining > 0 && i < (unsigned)io->n_buffers; ++i) {
+		EVUTIL_ASSERT(*chainp);
+		len = io->buffers[i].iov_len;
+		if (remaining < len)
+			len = remaining;
+		(*chainp)->off += len;
+		evbuf->last_with_datap = chainp;
+		remaining -= len;
+		chainp = &(*chainp)->next;
+	}
+
+	pin_release(io, EVBUFFER_MEM_PINNED_R);
+
+	evbuf->total_len += nBytes;
+	evbuf->n_add_for_cb += nBytes;
+
+	_evbuffer_decref_and_unlock(evbuf);
+}
+
+void
+evbuffer_uring_commit_write(struct evbuffer *evbuf,
+    struct evbuffer_uring_io *io, ev_ssize_t nBytes)
+{
+	EVBUFFER_LOCK(evbuf);
+	evbuffer_unfreeze(evbuf, 1);
+	if (nBytes > 0)
+		evbuffer_drain(evbuf, nBytes);
+	pin_release(io, EVBUFFER_MEM_PINNED_W);
+	_evbuffer_decref_and_unlock(evbuf);
+}
+
+int
+evbuffer_uring_launch_write(struct evbuffer *buf, struct event_base *base,
+    evutil_socket_t fd, ev_ssize_t at_most, struct evbuffer_uring_io *io)
+{
+	int r = -1;
+	int i;
+	struct evbuffer_chain *chain;
+
+	EVBUFFER_LOCK(buf);
+	if (buf->freeze_start)
+		goto done;
+	if (!buf->total_len) {
+		/* Nothing to write */
+		r = 0;
+		goto done;
+	} else if (at_most < 0 || (size_t)at_most > buf->total_len) {
+		at_most = buf->total_len;
+	}
+	evbuffer_freeze(buf, 1);
+
+	io->first_pinned = NULL;
+	io->n_buffers = 0;
+	memset(io->buffers, 0, sizeof(io->buffers));
+
+	chain = io->first_pinned = buf->first;
+
+	for (i=0; i < URING_MAX_IOVEC && chain; ++i, chain=chain->next) {
+		struct iovec *b = &io->buffers[i];
+		b->iov_base = chain->buffer + chain->misalign;
+		_evbuffer_chain_pin(chain, EVBUFFER_MEM_PINNED_W);
+
+		if ((size_t)at_most > chain->off) {
+			b->iov_len = chain->off;
+			at_most -= chain->off;
+		} else {
+			b->iov_len = at_most;
+			++i;
+			break;
+		}
+	}
+
+	io->n_buffers = i;
+	_evbuffer_incref(buf);
+	if (event_uring_writev(base, fd, io->buffers, i, &io->op) < 0) {
+		pin_release(io, EVBUFFER_MEM_PINNED_W);
+		evbuffer_unfreeze(buf, 1);
+		evbuffer_free(buf); /* decref */
+		goto done;
+	}
+
+	r = 0;
+done:
+	EVBUFFER_UNLOCK(buf);
+	return r;
+}
+
+int
+evbuffer_uring_launch_read(struct evbuffer *buf, struct event_base *base,
+    evutil_socket_t fd, size_t at_most, struct evbuffer_uring_io *io)
+{
+	int r = -1, i;
+	int nvecs;
+	int npin=0;
+	struct evbuffer_chain *chain=NULL, **chainp;
+	struct evbuffer_iovec vecs[URING_MAX_IOVEC];
+
+	EVBUFFER_LOCK(buf);
+	if (buf->freeze_end)
+		goto done;
+
+	io->first_pinned = NULL;
+	io->n_buffers = 0;
+	memset(io->buffers, 0, sizeof(io->buffers));
+
+	if (_evbuffer_expand_fast(buf, at_most, URING_MAX_IOVEC) == -1)
+		goto done;
+	evbuffer_freeze(buf, 0);
+
+	nvecs = _evbuffer_read_setup_vecs(buf, at_most,
+	    vecs, URING_MAX_IOVEC, &chainp, 1);
+	for (i=0;i<nvecs;++i) {
+		io->buffers[i].iov_base = vecs[i].iov_base;
+		io->buffers[i].iov_len = vecs[i].iov_len;
+	}
+
+	io->n_buffers = nvecs;
+	io->first_pinned = chain = *chainp;
+
+	npin=0;
+	for ( ; chain; chain = chain->next) {
+		_evbuffer_chain_pin(chain, EVBUFFER_MEM_PINNED_R);
+		++npin;
+	}
+	EVUTIL_ASSERT(npin == nvecs);
+
+	_evbuffer_incref(buf);
+	if (event_uring_readv(base, fd, io->buffers, nvecs, &io->op) < 0) {
+		pin_release(io, EVBUFFER_MEM_PINNED_R);
+		evbuffer_unfreeze(buf, 0);
+		evbuffer_free(buf); /* decref */
+		goto done;
+	}
+
+	r = 0;
+done:
+	EVBUFFER_UNLOCK(buf);
+	return r;
+}
@@ -188,13 +188,17 @@ struct bufferevent_private {
 
 	/** Rate-limiting information for this bufferevent */
 	struct bufferevent_rate_limit *rate_limiting;
+	/** The memory functions of the event_base that this bufferevent was
+	 * allocated with, or NULL for the global ones. */
+	const struct event_mem_functions *mm;
 };
 
 /** Possible operations for a control callback. */
 enum bufferevent_ctrl_op {
 	BEV_CTRL_SET_FD,
 	BEV_CTRL_GET_FD,
-	BEV_CTRL_GET_UNDERLYING
+	BEV_CTRL_GET_UNDERLYING,
+	BEV_CTRL_CANCEL_ALL
 };
 
 /** Possible data types for a control callback */
@@ -258,6 +262,13 @@ extern const struct bufferevent_ops bufferevent_ops_pair;
 #define BEV_IS_FILTER(bevp) ((bevp)->be_ops == &bufferevent_ops_filter)
 #define BEV_IS_PAIR(bevp) ((bevp)->be_ops == &bufferevent_ops_pair)
 
+#ifdef _EVENT_HAVE_IO_URING
+extern const struct bufferevent_ops bufferevent_ops_uring;
+#define BEV_IS_URING(bevp) ((bevp)->be_ops == &bufferevent_ops_uring)
+#else
+#define BEV_IS_URING(bevp) 0
+#endif
+
 #ifdef WIN32
 extern const struct bufferevent_ops bufferevent_ops_async;
 #define BEV_IS_ASYNC(bevp) ((bevp)->be_ops == &bufferevent_ops_async)
@@ -357,6 +368,11 @@ int _bufferevent_generic_adj_timeouts(struct bufferevent *bev);
  * bufferevent_private. */
 #define BEV_UPCAST(b) EVUTIL_UPCAST((b), struct bufferevent_private, bev)
 
+/** Internal: Extra flags for the events that a bufferevent uses internally.
+ * If the bufferevent has no lock, its callbacks must not be run by another
+ * thread of an event_base_group. */
+#define BEV_EVENT_AFFINITY(b) (BEV_UPCAST(b)->lock ? 0 : EV_PINNED)
+
 #ifdef _EVENT_DISABLE_THREAD_SUPPORT
 #define BEV_LOCK(b) _EVUTIL_NIL_STMT
 #define BEV_UNLOCK(b) _EVUTIL_NIL_STMT
@@ -285,6 +285,11 @@ bufferevent_init_common(struct bufferevent_private *bufev_private,
 		}
 	}
 
+	/* Keep the data of bufferevents on 'base' in its memory too. */
+	bufev_private->mm = _event_base_get_mm(base);
+	bufev->input->mm = bufev_private->mm;
+	bufev->output->mm = bufev_private->mm;
+
 	bufev_private->refcnt = 1;
 	bufev->ev_base = base;
 
@@ -626,7 +631,8 @@ _bufferevent_decref_and_unlock(struct bufferevent *bufev)
 		    EVTHREAD_LOCKTYPE_RECURSIVE);
 
 	/* Free the actual allocated memory. */
-	mm_free(((char*)bufev) - bufev->be_ops->mem_offset);
+	mm_free_with(bufev_private->mm,
+	    ((char*)bufev) - bufev->be_ops->mem_offset);
 
 	/* Release the reference to underlying now that we no longer need the
 	 * reference to it.  We wait this long mainly in case our lock is
@@ -651,11 +657,23 @@ bufferevent_decref(struct bufferevent *bufev)
 	return _bufferevent_decref_and_unlock(bufev);
 }
 
+/* Ask the implementation to take back any I/O it has handed to the
+ * kernel, so that its references to the bufferevent go away. */
+static void
+_bufferevent_cancel_all(struct bufferevent *bev)
+{
+	union bufferevent_ctrl_data d;
+	memset(&d, 0, sizeof(d));
+	if (bev->be_ops->ctrl)
+		bev->be_ops->ctrl(bev, BEV_CTRL_CANCEL_ALL, &d);
+}
+
 void
 bufferevent_free(struct bufferevent *bufev)
 {
 	BEV_LOCK(bufev);
 	bufferevent_setcb(bufev, NULL, NULL, NULL, NULL);
+	_bufferevent_cancel_all(bufev);
 	_bufferevent_decref_and_unlock(bufev);
 }
 
@@ -690,6 +708,7 @@ bufferevent_enable_locking(struct bufferevent *bufev, void *lock)
 		EVTHREAD_ALLOC_LOCK(lock, EVTHREAD_LOCKTYPE_RECURSIVE);
 		if (!lock)
 			return -1;
+		EVTHREAD_SET_LOCK_CLASS(lock, EVTHREAD_LOCK_CLASS_BUFFEREVENT);
 		BEV_UPCAST(bufev)->lock = lock;
 		BEV_UPCAST(bufev)->own_lock = 1;
 	} else {
@@ -777,9 +796,9 @@ bufferevent_generic_write_timeout_cb(evutil_socket_t fd, short event, void *ctx)
 void
 _bufferevent_init_generic_timeout_cbs(struct bufferevent *bev)
 {
-	evtimer_assign(&bev->ev_read, bev->ev_base,
+	event_assign(&bev->ev_read, bev->ev_base, -1, BEV_EVENT_AFFINITY(bev),
 	    bufferevent_generic_read_timeout_cb, bev);
-	evtimer_assign(&bev->ev_write, bev->ev_base,
+	event_assign(&bev->ev_write, bev->ev_base, -1, BEV_EVENT_AFFINITY(bev),
 	    bufferevent_generic_write_timeout_cb, bev);
 }
 
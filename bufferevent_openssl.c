@@ -868,9 +868,11 @@ set_open_callbacks(struct bufferevent_openssl *bev_ssl, evutil_socket_t fd)
 			event_del(&bev->ev_write);
 		}
 		event_assign(&bev->ev_read, bev->ev_base, fd,
-		    EV_READ|EV_PERSIST, be_openssl_readeventcb, bev_ssl);
+		    EV_READ|EV_PERSIST|BEV_EVENT_AFFINITY(bev),
+		    be_openssl_readeventcb, bev_ssl);
 		event_assign(&bev->ev_write, bev->ev_base, fd,
-		    EV_WRITE|EV_PERSIST, be_openssl_writeeventcb, bev_ssl);
+		    EV_WRITE|EV_PERSIST|BEV_EVENT_AFFINITY(bev),
+		    be_openssl_writeeventcb, bev_ssl);
 		if (rpending)
 			r1 = _bufferevent_add_event(&bev->ev_read, &bev->timeout_read);
 		if (wpending)
@@ -970,9 +972,11 @@ set_handshake_callbacks(struct bufferevent_openssl *bev_ssl, evutil_socket_t fd)
 			event_del(&bev->ev_write);
 		}
 		event_assign(&bev->ev_read, bev->ev_base, fd,
-		    EV_READ|EV_PERSIST, be_openssl_handshakeeventcb, bev_ssl);
+		    EV_READ|EV_PERSIST|BEV_EVENT_AFFINITY(bev),
+		    be_openssl_handshakeeventcb, bev_ssl);
 		event_assign(&bev->ev_write, bev->ev_base, fd,
-		    EV_WRITE|EV_PERSIST, be_openssl_handshakeeventcb, bev_ssl);
+		    EV_WRITE|EV_PERSIST|BEV_EVENT_AFFINITY(bev),
+		    be_openssl_handshakeeventcb, bev_ssl);
 		if (fd >= 0) {
 			r1 = _bufferevent_add_event(&bev->ev_read, &bev->timeout_read);
 			r2 = _bufferevent_add_event(&bev->ev_write, &bev->timeout_write);
@@ -1180,7 +1184,8 @@ bufferevent_openssl_new_impl(struct event_base *base,
 	if (underlying != NULL && fd >= 0)
 		return NULL; /* Only one can be set. */
 
-	if (!(bev_ssl = mm_calloc(1, sizeof(struct bufferevent_openssl))))
+	if (!(bev_ssl = mm_calloc_with(_event_base_get_mm(base), 1,
+		    sizeof(struct bufferevent_openssl))))
 		goto err;
 
 	bev_p = &bev_ssl->bev;
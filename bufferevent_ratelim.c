@@ -586,8 +586,8 @@ bufferevent_set_rate_limit(struct bufferevent *bev,
 		EVUTIL_ASSERT(event_initialized(&rlim->refill_bucket_event));
 		event_del(&rlim->refill_bucket_event);
 	}
-	evtimer_assign(&rlim->refill_bucket_event, bev->ev_base,
-	    _bev_refill_callback, bevp);
+	event_assign(&rlim->refill_bucket_event, bev->ev_base, -1,
+	    BEV_EVENT_AFFINITY(bev), _bev_refill_callback, bevp);
 
 	if (rlim->limit.read_limit > 0) {
 		bufferevent_unsuspend_read(bev, BEV_SUSPEND_BW);
@@ -638,6 +638,7 @@ bufferevent_rate_limit_group_new(struct event_base *base,
 	event_add(&g->master_refill_event, &cfg->tick_timeout);
 
 	EVTHREAD_ALLOC_LOCK(g->lock, EVTHREAD_LOCKTYPE_RECURSIVE);
+	EVTHREAD_SET_LOCK_CLASS(g->lock, EVTHREAD_LOCK_CLASS_RATELIM_GROUP);
 	return g;
 }
 
@@ -708,8 +709,8 @@ bufferevent_add_to_rate_limit_group(struct bufferevent *bev,
 			BEV_UNLOCK(bev);
 			return -1;
 		}
-		evtimer_assign(&rlim->refill_bucket_event, bev->ev_base,
-		    _bev_refill_callback, bevp);
+		event_assign(&rlim->refill_bucket_event, bev->ev_base, -1,
+		    BEV_EVENT_AFFINITY(bev), _bev_refill_callback, bevp);
 		bevp->rate_limiting = rlim;
 	}
 
@@ -63,16 +63,19 @@
 #include "event2/util.h"
 #include "event2/bufferevent.h"
 #include "event2/buffer.h"
+#include "event2/buffer_compat.h"
 #include "event2/bufferevent_struct.h"
 #include "event2/bufferevent_compat.h"
 #include "event2/event.h"
 #include "log-internal.h"
 #include "mm-internal.h"
 #include "bufferevent-internal.h"
+#include "evbuffer-internal.h"
 #include "util-internal.h"
 #ifdef WIN32
 #include "iocp-internal.h"
 #endif
+#include "uring-internal.h"
 
 /* prototypes */
 static int be_socket_enable(struct bufferevent *, short);
@@ -239,6 +242,15 @@ bufferevent_writecb(evutil_socket_t fd, short event, void *arg)
 						BEV_EVENT_CONNECTED);
 				goto done;
 			}
+#endif
+#ifdef _EVENT_HAVE_IO_URING
+			if (BEV_IS_URING(bufev)) {
+				event_del(&bufev->ev_write);
+				bufferevent_uring_set_connected(bufev);
+				_bufferevent_run_eventcb(bufev,
+						BEV_EVENT_CONNECTED);
+				goto done;
+			}
 #endif
 			_bufferevent_run_eventcb(bufev,
 					BEV_EVENT_CONNECTED);
@@ -317,21 +329,28 @@ bufferevent_socket_new(struct event_base *base, evutil_socket_t fd,
 	if (base && event_base_get_iocp(base))
 		return bufferevent_async_new(base, fd, options);
 #endif
+#ifdef _EVENT_HAVE_IO_URING
+	if (base && event_base_wants_uring_bufferevents(base))
+		return bufferevent_uring_new(base, fd, options);
+#endif
 
-	if ((bufev_p = mm_calloc(1, sizeof(struct bufferevent_private)))== NULL)
+	if ((bufev_p = mm_calloc_with(_event_base_get_mm(base), 1,
+		    sizeof(struct bufferevent_private)))== NULL)
 		return NULL;
 
 	if (bufferevent_init_common(bufev_p, base, &bufferevent_ops_socket,
 				    options) < 0) {
-		mm_free(bufev_p);
+		mm_free_with(_event_base_get_mm(base), bufev_p);
 		return NULL;
 	}
 	bufev = &bufev_p->bev;
 
 	event_assign(&bufev->ev_read, bufev->ev_base, fd,
-	    EV_READ|EV_PERSIST, bufferevent_readcb, bufev);
+	    EV_READ|EV_PERSIST|BEV_EVENT_AFFINITY(bufev),
+	    bufferevent_readcb, bufev);
 	event_assign(&bufev->ev_write, bufev->ev_base, fd,
-	    EV_WRITE|EV_PERSIST, bufferevent_writecb, bufev);
+	    EV_WRITE|EV_PERSIST|BEV_EVENT_AFFINITY(bufev),
+	    bufferevent_writecb, bufev);
 
 	evbuffer_add_cb(bufev->output, bufferevent_socket_outbuf_cb, bufev);
 
@@ -391,7 +410,17 @@ bufferevent_socket_connect(struct bufferevent *bev,
 	 * on a non-blocking connect() when ConnectEx() is unavailable. */
 	if (BEV_IS_ASYNC(bev)) {
 		event_assign(&bev->ev_write, bev->ev_base, fd,
-		    EV_WRITE|EV_PERSIST, bufferevent_writecb, bev);
+		    EV_WRITE|EV_PERSIST|BEV_EVENT_AFFINITY(bev),
+		    bufferevent_writecb, bev);
+	}
+#endif
+#ifdef _EVENT_HAVE_IO_URING
+	/* Completion-based bufferevents connect the ordinary way, by
+	 * waiting for the socket to become writable. */
+	if (BEV_IS_URING(bev)) {
+		event_assign(&bev->ev_write, bev->ev_base, fd,
+		    EV_WRITE|EV_PERSIST|BEV_EVENT_AFFINITY(bev),
+		    bufferevent_writecb, bev);
 	}
 #endif
 	bufferevent_setfd(bev, fd);
@@ -617,9 +646,11 @@ be_socket_setfd(struct bufferevent *bufev, evutil_socket_t fd)
 	event_del(&bufev->ev_write);
 
 	event_assign(&bufev->ev_read, bufev->ev_base, fd,
-	    EV_READ|EV_PERSIST, bufferevent_readcb, bufev);
+	    EV_READ|EV_PERSIST|BEV_EVENT_AFFINITY(bufev),
+	    bufferevent_readcb, bufev);
 	event_assign(&bufev->ev_write, bufev->ev_base, fd,
-	    EV_WRITE|EV_PERSIST, bufferevent_writecb, bufev);
+	    EV_WRITE|EV_PERSIST|BEV_EVENT_AFFINITY(bufev),
+	    bufferevent_writecb, bufev);
 
 	if (fd >= 0)
 		bufferevent_enable(bufev, bufev->enabled);
@@ -659,6 +690,10 @@ bufferevent_base_set(struct event_base *base, struct bufferevent *bufev)
 		goto done;
 
 	bufev->ev_base = base;
+	/* New data goes in the new base's memory; chains that are already
+	 * there remember where they came from. */
+	bufev->input->mm = _event_base_get_mm(base);
+	bufev->output->mm = _event_base_get_mm(base);
 
 	res = event_base_set(base, &bufev->ev_read);
 	if (res == -1)
@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2009-2010 Niels Provos and Nick Mathewson
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _EVENT_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <sys/queue.h>
+
+#include "event2/util.h"
+#include "event2/bufferevent.h"
+#include "event2/buffer.h"
+#include "event2/bufferevent_struct.h"
+#include "event2/event.h"
+#include "event-internal.h"
+#include "log-internal.h"
+#include "mm-internal.h"
+#include "bufferevent-internal.h"
+#include "util-internal.h"
+#include "uring-internal.h"
+
+/*
+  A bufferevent that does its socket I/O through the io_uring of its
+  event_base.  Instead of waiting for readiness and then calling readv or
+  writev, we post the readv directly into free space at the end of the
+  input buffer, and the writev directly from the chains of the output
+  buffer, and hear about them when they complete.  This is the io_uring
+  counterpart of bufferevent_async.c.
+ */
+
+/* prototypes */
+static int be_uring_enable(struct bufferevent *, short);
+static int be_uring_disable(struct bufferevent *, short);
+static void be_uring_destruct(struct bufferevent *);
+static int be_uring_flush(struct bufferevent *, short, enum bufferevent_flush_mode);
+static int be_uring_ctrl(struct bufferevent *, enum bufferevent_ctrl_op, union bufferevent_ctrl_data *);
+
+struct bufferevent_uring {
+	struct bufferevent_private bev;
+	evutil_socket_t fd;
+	struct evbuffer_uring_io read_io;
+	struct evbuffer_uring_io write_io;
+	unsigned read_in_progress : 1;
+	unsigned write_in_progress : 1;
+	unsigned ok : 1;
+	unsigned read_added : 1;
+	unsigned write_added : 1;
+};
+
+const struct bufferevent_ops bufferevent_ops_uring = {
+	"socket_uring",
+	evutil_offsetof(struct bufferevent_uring, bev.bev),
+	be_uring_enable,
+	be_uring_disable,
+	be_uring_destruct,
+	_bufferevent_generic_adj_timeouts,
+	be_uring_flush,
+	be_uring_ctrl,
+};
+
+static inline struct bufferevent_uring *
+upcast(struct bufferevent *bev)
+{
+	struct bufferevent_uring *bev_u;
+	if (bev->be_ops != &bufferevent_ops_uring)
+		return NULL;
+	bev_u = EVUTIL_UPCAST(bev, struct bufferevent_uring, bev.bev);
+	return bev_u;
+}
+
+static inline struct bufferevent_uring *
+upcast_read(struct event_uring_op *op)
+{
+	struct bufferevent_uring *bev_u;
+	bev_u = EVUTIL_UPCAST(op, struct bufferevent_uring, read_io.op);
+	EVUTIL_ASSERT(BEV_IS_URING(&bev_u->bev.bev));
+	return bev_u;
+}
+
+static inline struct bufferevent_uring *
+upcast_write(struct event_uring_op *op)
+{
+	struct bufferevent_uring *bev_u;
+	bev_u = EVUTIL_UPCAST(op, struct bufferevent_uring, write_io.op);
+	EVUTIL_ASSERT(BEV_IS_URING(&bev_u->bev.bev));
+	return bev_u;
+}
+
+/* An operation in flight is not an event, so we count it as a virtual
+ * event to keep the loop from exiting while we wait for it. */
+static void
+bev_uring_del_write(struct bufferevent_uring *bevu)
+{
+	struct bufferevent *bev = &bevu->bev.bev;
+
+	if (bevu->write_added) {
+		bevu->write_added = 0;
+		event_base_del_virtual(bev->ev_base);
+	}
+}
+
+static void
+bev_uring_del_read(struct bufferevent_uring *bevu)
+{
+	struct bufferevent *bev = &bevu->bev.bev;
+
+	if (bevu->read_added) {
+		bevu->read_added = 0;
+		event_base_del_virtual(bev->ev_base);
+	}
+}
+
+static void
+bev_uring_add_write(struct bufferevent_uring *bevu)
+{
+	struct bufferevent *bev = &bevu->bev.bev;
+
+	if (!bevu->write_added) {
+		bevu->write_added = 1;
+		event_base_add_virtual(bev->ev_base);
+	}
+}
+
+static void
+bev_uring_add_read(struct bufferevent_uring *bevu)
+{
+	struct bufferevent *bev = &bevu->bev.bev;
+
+	if (!bevu->read_added) {
+		bevu->read_added = 1;
+		event_base_add_virtual(bev->ev_base);
+	}
+}
+
+static void
+bev_uring_consider_writing(struct bufferevent_uring *bevu)
+{
+	size_t at_most;
+	int limit;
+	struct bufferevent *bev = &bevu->bev.bev;
+
+	/* Don't write if there's a write in progress, or we do not
+	 * want to write, or when there's nothing left to write. */
+	if (bevu->write_in_progress)
+		return;
+	if (!bevu->ok || !(bev->enabled&EV_WRITE) ||
+	    !evbuffer_get_length(bev->output)) {
+		bev_uring_del_write(bevu);
+		return;
+	}
+
+	at_most = evbuffer_get_length(bev->output);
+
+	limit = _bufferevent_get_write_max(&bevu->bev);
+	if (at_most >= (size_t)limit && limit >= 0)
+		at_most = limit;
+
+	if (bevu->bev.write_suspended) {
+		bev_uring_del_write(bevu);
+		return;
+	}
+
+	bufferevent_incref(bev);
+	if (evbuffer_uring_launch_write(bev->output, bev->ev_base, bevu->fd,
+		at_most, &bevu->write_io)) {
+		bufferevent_decref(bev);
+		bevu->ok = 0;
+		_bufferevent_run_eventcb(bev, BEV_EVENT_ERROR);
+	} else {
+		bevu->write_in_progress = 1;
+		bev_uring_add_write(bevu);
+	}
+}
+
+static void
+bev_uring_consider_reading(struct bufferevent_uring *bevu)
+{
+	size_t cur_size;
+	size_t read_high;
+	size_t at_most;
+	int limit;
+	struct bufferevent *bev = &bevu->bev.bev;
+
+	/* Don't read if there is a read in progress, or we do not
+	 * want to read. */
+	if (bevu->read_in_progress)
+		return;
+	if (!bevu->ok || !(bev->enabled&EV_READ)) {
+		bev_uring_del_read(bevu);
+		return;
+	}
+
+	/* Don't read if we're full */
+	cur_size = evbuffer_get_length(bev->input);
+	read_high = bev->wm_read.high;
+	if (read_high) {
+		if (cur_size >= read_high) {
+			bev_uring_del_read(bevu);
+			return;
+		}
+		at_most = read_high - cur_size;
+	} else {
+		at_most = 16384;
+	}
+
+	limit = _bufferevent_get_read_max(&bevu->bev);
+	if (at_most >= (size_t)limit && limit >= 0)
+		at_most = limit;
+
+	if (bevu->bev.read_suspended) {
+		bev_uring_del_read(bevu);
+		return;
+	}
+
+	bufferevent_incref(bev);
+	if (evbuffer_uring_launch_read(bev->input, bev->ev_base, bevu->fd,
+		at_most, &bevu->read_io)) {
+		bevu->ok = 0;
+		bufferevent_decref(bev);
+		_bufferevent_run_eventcb(bev, BEV_EVENT_ERROR);
+	} else {
+		bevu->read_in_progress = 1;
+		bev_uring_add_read(bevu);
+	}
+}
+
+static void
+be_uring_outbuf_callback(struct evbuffer *buf,
+    const struct evbuffer_cb_info *cbinfo,
+    void *arg)
+{
+	struct bufferevent *bev = arg;
+	struct bufferevent_uring *bev_uring = upcast(bev);
+
+	/* If we added data to the outbuf and were not writing before,
+	 * we may want to write now. */
+
+	_bufferevent_incref_and_lock(bev);
+
+	if (cbinfo->n_added)
+		bev_uring_consider_writing(bev_uring);
+
+	_bufferevent_decref_and_unlock(bev);
+}
+
+static void
+be_uring_inbuf_callback(struct evbuffer *buf,
+    const struct evbuffer_cb_info *cbinfo,
+    void *arg)
+{
+	struct bufferevent *bev = arg;
+	struct bufferevent_uring *bev_uring = upcast(bev);
+
+	/* If we drained data from the inbuf and were not reading before,
+	 * we may want to read now */
+
+	_bufferevent_incref_and_lock(bev);
+
+	if (cbinfo->n_deleted)
+		bev_uring_consider_reading(bev_uring);
+
+	_bufferevent_decref_and_unlock(bev);
+}
+
+static int
+be_uring_enable(struct bufferevent *buf, short what)
+{
+	struct bufferevent_uring *bev_uring = upcast(buf);
+
+	if (!bev_uring->ok)
+		return -1;
+
+	/* NOTE: This interferes with non-blocking connect */
+	if (what & EV_READ)
+		BEV_RESET_GENERIC_READ_TIMEOUT(buf);
+	if (what & EV_WRITE)
+		BEV_RESET_GENERIC_WRITE_TIMEOUT(buf);
+
+	/* If we newly enable reading or writing, and we aren't reading or
+	   writing already, consider launching a new read or write. */
+
+	if (what & EV_READ)
+		bev_uring_consider_reading(bev_uring);
+	if (what & EV_WRITE)
+		bev_uring_consider_writing(bev_uring);
+	return 0;
+}
+
+static int
+be_uring_disable(struct bufferevent *bev, short what)
+{
+	struct bufferevent_uring *bev_uring = upcast(bev);
+
+	/* Unlike IOCP, we can take back an operation we have posted.  If
+	 * it has already completed, its data is kept and reported as
+	 * usual. */
+	if (what & EV_READ) {
+		BEV_DEL_GENERIC_READ_TIMEOUT(bev);
+		if (bev_uring->read_in_progress)
+			event_uring_cancel(bev->ev_base, &bev_uring->read_io.op);
+		bev_uring_del_read(bev_uring);
+	}
+	if (what & EV_WRITE) {
+		BEV_DEL_GENERIC_WRITE_TIMEOUT(bev);
+		if (bev_uring->write_in_progress)
+			event_uring_cancel(bev->ev_base, &bev_uring->write_io.op);
+		bev_uring_del_write(bev_uring);
+	}
+
+	return 0;
+}
+
+static void
+be_uring_destruct(struct bufferevent *bev)
+{
+	struct bufferevent_uring *bev_uring = upcast(bev);
+	struct bufferevent_private *bev_p = BEV_UPCAST(bev);
+
+	EVUTIL_ASSERT(!bev_uring->write_in_progress &&
+			!bev_uring->read_in_progress);
+
+	bev_uring_del_read(bev_uring);
+	bev_uring_del_write(bev_uring);
+
+	if ((bev_p->options & BEV_OPT_CLOSE_ON_FREE) && bev_uring->fd >= 0)
+		evutil_closesocket(bev_uring->fd);
+	/* ev_write may be the connect event rather than a timeout, and
+	 * ev_read is only set up once the socket is usable, so check each
+	 * one. */
+	if (event_initialized(&bev->ev_read))
+		event_del(&bev->ev_read);
+	if (event_initialized(&bev->ev_write))
+		event_del(&bev->ev_write);
+}
+
+static int
+be_uring_flush(struct bufferevent *bev, short what,
+    enum bufferevent_flush_mode mode)
+{
+	return 0;
+}
+
+static void
+read_complete(struct event_uring_op *op, int res)
+{
+	struct bufferevent_uring *bev_u = upcast_read(op);
+	struct bufferevent *bev = &bev_u->bev.bev;
+	short what = BEV_EVENT_READING;
+
+	BEV_LOCK(bev);
+	EVUTIL_ASSERT(bev_u->read_in_progress);
+
+	evbuffer_uring_commit_read(bev->input, &bev_u->read_io, res);
+	bev_u->read_in_progress = 0;
+
+	if (res == -ECANCELED) {
+		/* We took this read back; maybe someone wants a new one. */
+		bev_uring_consider_reading(bev_u);
+	} else if (bev_u->ok) {
+		if (res > 0) {
+			BEV_RESET_GENERIC_READ_TIMEOUT(bev);
+			_bufferevent_decrement_read_buckets(&bev_u->bev, res);
+			if ((bev->enabled & EV_READ) &&
+			    evbuffer_get_length(bev->input) >= bev->wm_read.low)
+				_bufferevent_run_readcb(bev);
+			bev_uring_consider_reading(bev_u);
+		} else if (res < 0) {
+			EVUTIL_SET_SOCKET_ERROR(-res);
+			what |= BEV_EVENT_ERROR;
+			bev_u->ok = 0;
+			_bufferevent_run_eventcb(bev, what);
+		} else {
+			what |= BEV_EVENT_EOF;
+			bev_u->ok = 0;
+			_bufferevent_run_eventcb(bev, what);
+		}
+	}
+	if (!bev_u->read_in_progress)
+		bev_uring_del_read(bev_u);
+
+	_bufferevent_decref_and_unlock(bev);
+}
+
+static void
+write_complete(struct event_uring_op *op, int res)
+{
+	struct bufferevent_uring *bev_u = upcast_write(op);
+	struct bufferevent *bev = &bev_u->bev.bev;
+	short what = BEV_EVENT_WRITING;
+
+	BEV_LOCK(bev);
+	EVUTIL_ASSERT(bev_u->write_in_progress);
+	evbuffer_uring_commit_write(bev->output, &bev_u->write_io, res);
+	bev_u->write_in_progress = 0;
+
+	if (res == -ECANCELED) {
+		bev_uring_consider_writing(bev_u);
+	} else if (bev_u->ok) {
+		if (res > 0) {
+			BEV_RESET_GENERIC_WRITE_TIMEOUT(bev);
+			_bufferevent_decrement_write_buckets(&bev_u->bev, res);
+			if (evbuffer_get_length(bev->output) <=
+			    bev->wm_write.low)
+				_bufferevent_run_writecb(bev);
+			bev_uring_consider_writing(bev_u);
+		} else if (res < 0) {
+			EVUTIL_SET_SOCKET_ERROR(-res);
+			what |= BEV_EVENT_ERROR;
+			bev_u->ok = 0;
+			_bufferevent_run_eventcb(bev, what);
+		} else {
+			what |= BEV_EVENT_EOF;
+			bev_u->ok = 0;
+			_bufferevent_run_eventcb(bev, what);
+		}
+	}
+	if (!bev_u->write_in_progress)
+		bev_uring_del_write(bev_u);
+
+	_bufferevent_decref_and_unlock(bev);
+}
+
+struct bufferevent *
+bufferevent_uring_new(struct event_base *base,
+    evutil_socket_t fd, int options)
+{
+	struct bufferevent_uring *bev_u;
+	struct bufferevent *bev;
+
+	if (!event_base_uses_uring(base))
+		return NULL;
+
+	if (!(bev_u = mm_calloc_with(_event_base_get_mm(base), 1,
+		    sizeof(struct bufferevent_uring))))
+		return NULL;
+
+	bev = &bev_u->bev.bev;
+	if (bufferevent_init_common(&bev_u->bev, base, &bufferevent_ops_uring,
+		options)<0) {
+		mm_free_with(_event_base_get_mm(base), bev_u);
+		return NULL;
+	}
+
+	evbuffer_add_cb(bev->input, be_uring_inbuf_callback, bev);
+	evbuffer_add_cb(bev->output, be_uring_outbuf_callback, bev);
+
+	event_uring_op_init(&bev_u->read_io.op, read_complete);
+	event_uring_op_init(&bev_u->write_io.op, write_complete);
+
+	bev_u->fd = fd;
+	bev_u->ok = fd >= 0;
+	if (bev_u->ok)
+		_bufferevent_init_generic_timeout_cbs(bev);
+
+	return bev;
+}
+
+void
+bufferevent_uring_set_connected(struct bufferevent *bev)
+{
+	struct bufferevent_uring *bev_uring = upcast(bev);
+	bev_uring->ok = 1;
+	_bufferevent_init_generic_timeout_cbs(bev);
+	/* Now's a good time to consider reading/writing */
+	be_uring_enable(bev, bev->enabled);
+}
+
+static int
+be_uring_ctrl(struct bufferevent *bev, enum bufferevent_ctrl_op op,
+    union bufferevent_ctrl_data *data)
+{
+	struct bufferevent_uring *bev_uring = upcast(bev);
+
+	switch (op) {
+	case BEV_CTRL_GET_FD:
+		data->fd = bev_uring->fd;
+		return 0;
+	case BEV_CTRL_SET_FD:
+		bev_uring->fd = data->fd;
+		return 0;
+	case BEV_CTRL_CANCEL_ALL:
+		if (bev_uring->read_in_progress)
+			event_uring_cancel(bev->ev_base, &bev_uring->read_io.op);
+		if (bev_uring->write_in_progress)
+			event_uring_cancel(bev->ev_base,
+			    &bev_uring->write_io.op);
+		return 0;
+	case BEV_CTRL_GET_UNDERLYING:
+	default:
+		return -1;
+	}
+}
@@ -88,6 +88,9 @@ void event_changelist_init(struct event_changelist *changelist);
  * after making all the changes in the changelist. */
 void event_changelist_remove_all(struct event_changelist *changelist,
     struct event_base *base);
+/** Return true iff the fd or signal whose changelist fdinfo is 'p' has a
+ * change waiting in the changelist. */
+int event_changelist_fd_is_pending(void *p);
 /** Free all memory held in a changelist. */
 void event_changelist_freemem(struct event_changelist *changelist);
 
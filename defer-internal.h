@@ -32,6 +32,7 @@ extern "C" {
 
 #include "event2/event-config.h"
 #include <sys/queue.h>
+#include "mpsc-internal.h"
 
 struct deferred_cb;
 
@@ -48,6 +49,12 @@ struct deferred_cb {
 	deferred_cb_fn cb;
 	/** The function's second argument. */
 	void *arg;
+	/** Link used while this deferred_cb waits on its event_base's list of
+	 * callbacks scheduled from other threads. */
+	struct ev_mpsc_node remote_node;
+	/** True iff this deferred_cb is on that list.  Only changed with
+	 * atomic operations. */
+	volatile int remote_queued;
 };
 
 /** A deferred_cb_queue is a list of deferred_cb that we can add to and run. */
@@ -73,7 +73,8 @@ const struct eventop devpollops = {
 	devpoll_dealloc,
 	1, /* need reinit */
 	EV_FEATURE_FDS|EV_FEATURE_O1,
-	0
+	0,
+	NULL /* rearm */
 };
 
 #define NEVENT	32000
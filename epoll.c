@@ -44,6 +44,10 @@
 #ifdef _EVENT_HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
+#if defined(_EVENT_HAVE_SYS_TIMERFD_H) && defined(_EVENT_HAVE_TIMERFD_CREATE)
+#include <sys/timerfd.h>
+#define USING_TIMERFD
+#endif
 
 #include "event-internal.h"
 #include "evsignal-internal.h"
@@ -56,12 +60,25 @@
 struct epollop {
 	struct epoll_event *events;
 	int nevents;
+	/* The most events we will grow 'events' to hold. */
+	int max_nevents;
 	int epfd;
+	/* EPOLLONESHOT if the base is set up for leader/follower dispatch,
+	 * so that no fd is reported twice before its callbacks have run;
+	 * otherwise 0. */
+	int oneshot;
+#ifdef USING_TIMERFD
+	/* A timerfd in the epoll set, or -1 if we are not using one.  When
+	 * we have it, we use it to wait for timeouts with microsecond
+	 * precision, since epoll_wait() only takes milliseconds. */
+	int timerfd;
+#endif
 };
 
 static void *epoll_init(struct event_base *);
 static int epoll_dispatch(struct event_base *, struct timeval *);
 static void epoll_dealloc(struct event_base *);
+static int epoll_rearm(struct event_base *, evutil_socket_t, short, void *);
 
 const struct eventop epollops = {
 	"epoll",
@@ -72,7 +89,8 @@ const struct eventop epollops = {
 	epoll_dealloc,
 	1, /* need reinit */
 	EV_FEATURE_ET|EV_FEATURE_O1,
-	EVENT_CHANGELIST_FDINFO_SIZE
+	EVENT_CHANGELIST_FDINFO_SIZE,
+	epoll_rearm
 };
 
 #define INITIAL_NEVENT 32
@@ -91,6 +109,7 @@ epoll_init(struct event_base *base)
 {
 	int epfd;
 	struct epollop *epollop;
+	int nevents;
 
 	/* Initialize the kernel queue.  (The size field is ignored since
 	 * 2.6.8.) */
@@ -106,14 +125,51 @@ epoll_init(struct event_base *base)
 		return (NULL);
 
 	epollop->epfd = epfd;
-
-	/* Initialize fields */
-	epollop->events = mm_calloc(INITIAL_NEVENT, sizeof(struct epoll_event));
+	if (base->flags & EVENT_BASE_FLAG_LEADER_FOLLOWER)
+		epollop->oneshot = EPOLLONESHOT;
+
+	/* Initialize fields.  If we were told how many events to expect at
+	 * once, start with room for them, and let ourselves grow past
+	 * MAX_NEVENT if that's what it takes. */
+	nevents = INITIAL_NEVENT;
+	if (base->events_per_wakeup_hint > nevents)
+		nevents = base->events_per_wakeup_hint;
+	epollop->max_nevents = MAX_NEVENT;
+	if (nevents > epollop->max_nevents)
+		epollop->max_nevents = nevents;
+	epollop->events = mm_calloc_with(base->mm, nevents,
+	    sizeof(struct epoll_event));
 	if (epollop->events == NULL) {
 		mm_free(epollop);
 		return (NULL);
 	}
-	epollop->nevents = INITIAL_NEVENT;
+	epollop->nevents = nevents;
+
+#ifdef USING_TIMERFD
+	epollop->timerfd = -1;
+	if (base->flags & EVENT_BASE_FLAG_PRECISE_TIMER) {
+		int fd;
+		fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (fd >= 0) {
+			struct epoll_event epev;
+			memset(&epev, 0, sizeof(epev));
+			epev.data.fd = fd;
+			epev.events = EPOLLIN;
+			if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &epev) < 0) {
+				event_warn("epoll_ctl(timerfd)");
+				close(fd);
+			} else {
+				epollop->timerfd = fd;
+			}
+		} else if (errno != EINVAL && errno != ENOSYS) {
+			/* EINVAL and ENOSYS just mean that we were built
+			 * with timerfd support but are running on a kernel
+			 * without it; we quietly fall back to millisecond
+			 * timeouts. */
+			event_warn("timerfd_create");
+		}
+	}
+#endif
 
 	evsig_init(base);
 
@@ -242,6 +298,8 @@ epoll_apply_changes(struct event_base *base)
 		memset(&epev, 0, sizeof(epev));
 		epev.data.fd = ch->fd;
 		epev.events = events;
+		if (op != EPOLL_CTL_DEL)
+			epev.events |= epollop->oneshot;
 		if (epoll_ctl(epollop->epfd, op, ch->fd, &epev) == -1) {
 			if (op == EPOLL_CTL_MOD && errno == ENOENT) {
 				/* If a MOD operation fails with ENOENT, the
@@ -307,6 +365,38 @@ epoll_apply_changes(struct event_base *base)
 	return (0);
 }
 
+static int
+epoll_rearm(struct event_base *base, evutil_socket_t fd, short events,
+    void *p)
+{
+	struct epollop *epollop = base->evbase;
+	struct epoll_event epev;
+
+	if (!epollop->oneshot)
+		return (0);
+	/* A change that is still on the changelist will set the events, and
+	 * the one-shot bit with them, when we apply it. */
+	if (event_changelist_fd_is_pending(p))
+		return (0);
+
+	memset(&epev, 0, sizeof(epev));
+	epev.data.fd = fd;
+	if (events & EV_READ)
+		epev.events |= EPOLLIN;
+	if (events & EV_WRITE)
+		epev.events |= EPOLLOUT;
+	if (events & EV_ET)
+		epev.events |= EPOLLET;
+	epev.events |= EPOLLONESHOT;
+	if (epoll_ctl(epollop->epfd, EPOLL_CTL_MOD, fd, &epev) == -1 &&
+	    errno != ENOENT && errno != EBADF) {
+		event_warn("Epoll MOD(%d) on fd %d to rearm it failed",
+		    (int)epev.events, (int)fd);
+		return (-1);
+	}
+	return (0);
+}
+
 static int
 epoll_dispatch(struct event_base *base, struct timeval *tv)
 {
@@ -315,6 +405,31 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 	int i, res;
 	long timeout = -1;
 
+#ifdef USING_TIMERFD
+	if (epollop->timerfd >= 0) {
+		struct itimerspec is;
+		is.it_interval.tv_sec = 0;
+		is.it_interval.tv_nsec = 0;
+		if (tv == NULL) {
+			/* No timeout; disarm the timer. */
+			is.it_value.tv_sec = 0;
+			is.it_value.tv_nsec = 0;
+		} else {
+			if (tv->tv_sec == 0 && tv->tv_usec == 0) {
+				/* A zero it_value would disarm the timer
+				 * rather than fire it; just poll. */
+				timeout = 0;
+			}
+			is.it_value.tv_sec = tv->tv_sec;
+			is.it_value.tv_nsec = tv->tv_usec * 1000;
+		}
+		/* Rearming also resets the expiration count, so we never
+		 * need to read() from the timerfd. */
+		if (timerfd_settime(epollop->timerfd, 0, &is, NULL) < 0) {
+			event_warn("timerfd_settime");
+		}
+	} else
+#endif
 	if (tv != NULL) {
 		timeout = evutil_tv_to_msec(tv);
 		if (timeout < 0 || timeout > MAX_EPOLL_TIMEOUT_MSEC) {
@@ -349,6 +464,11 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 		int what = events[i].events;
 		short ev = 0;
 
+#ifdef USING_TIMERFD
+		if (events[i].data.fd == epollop->timerfd)
+			continue;
+#endif
+
 		if (what & (EPOLLHUP|EPOLLERR)) {
 			ev = EV_READ | EV_WRITE;
 		} else {
@@ -364,13 +484,17 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 		evmap_io_active(base, events[i].data.fd, ev | EV_ET);
 	}
 
-	if (res == epollop->nevents && epollop->nevents < MAX_NEVENT) {
+	if (res == epollop->nevents &&
+	    epollop->nevents < epollop->max_nevents) {
 		/* We used all of the event space this time.  We should
 		   be ready for more events next time. */
 		int new_nevents = epollop->nevents * 2;
 		struct epoll_event *new_events;
 
-		new_events = mm_realloc(epollop->events,
+		if (new_nevents > epollop->max_nevents)
+			new_nevents = epollop->max_nevents;
+
+		new_events = mm_realloc_with(base->mm, epollop->events,
 		    new_nevents * sizeof(struct epoll_event));
 		if (new_events) {
 			epollop->events = new_events;
@@ -389,9 +513,13 @@ epoll_dealloc(struct event_base *base)
 
 	evsig_dealloc(base);
 	if (epollop->events)
-		mm_free(epollop->events);
+		mm_free_with(base->mm, epollop->events);
 	if (epollop->epfd >= 0)
 		close(epollop->epfd);
+#ifdef USING_TIMERFD
+	if (epollop->timerfd >= 0)
+		close(epollop->timerfd);
+#endif
 
 	memset(epollop, 0, sizeof(struct epollop));
 	mm_free(epollop);
@@ -74,6 +74,7 @@ struct evbuffer_cb_entry {
 };
 
 struct bufferevent;
+struct event_mem_functions;
 struct evbuffer_chain;
 struct evbuffer {
 	/** The first chain in this buffer's linked list of chains. */
@@ -149,6 +150,9 @@ struct evbuffer {
 	/** The parent bufferevent object this evbuffer belongs to.
 	 * NULL if the evbuffer stands alone. */
 	struct bufferevent *parent;
+	/** The memory functions to allocate new chains with, or NULL for
+	 * the global ones. */
+	const struct event_mem_functions *mm;
 };
 
 /** A single item in an evbuffer. */
@@ -190,6 +194,10 @@ struct evbuffer_chain {
 	 * may point to NULL.
 	 */
 	unsigned char *buffer;
+	/** The memory functions this chain was allocated with, or NULL for
+	 * the global ones.  Chains can move between evbuffers, so each one
+	 * remembers its own. */
+	const struct event_mem_functions *mm;
 };
 
 /* this is currently used by both mmap and sendfile */
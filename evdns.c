@@ -1619,6 +1619,7 @@ evdns_add_server_port_with_base(struct event_base *base, evutil_socket_t socket,
 		return NULL;
 	}
 	EVTHREAD_ALLOC_LOCK(port->lock, EVTHREAD_LOCKTYPE_RECURSIVE);
+	EVTHREAD_SET_LOCK_CLASS(port->lock, EVTHREAD_LOCK_CLASS_EVDNS);
 	return port;
 }
 
@@ -3719,6 +3720,7 @@ evdns_base_new(struct event_base *event_base, int initialize_nameservers)
 	base->req_waiting_head = NULL;
 
 	EVTHREAD_ALLOC_LOCK(base->lock, EVTHREAD_LOCKTYPE_RECURSIVE);
+	EVTHREAD_SET_LOCK_CLASS(base->lock, EVTHREAD_LOCK_CLASS_EVDNS);
 	EVDNS_LOCK(base);
 
 	/* Set max requests inflight and allocate req_heads. */
@@ -35,6 +35,7 @@ extern "C" {
 #include <sys/queue.h>
 #include "event2/event_struct.h"
 #include "minheap-internal.h"
+#include "mpsc-internal.h"
 #include "evsignal-internal.h"
 #include "mm-internal.h"
 #include "defer-internal.h"
@@ -96,6 +97,12 @@ struct eventop {
 	    to the add and del functions above.
 	 */
 	size_t fdinfo_len;
+	/** Optional: start reporting 'fd' again for 'events' after it was
+	 * reported once.  Backends that have this report each ready fd only
+	 * once, until it is rearmed, when the base was configured with
+	 * EVENT_BASE_FLAG_LEADER_FOLLOWER.  The function should return 0 on
+	 * success and -1 on error. */
+	int (*rearm)(struct event_base *, evutil_socket_t fd, short events, void *fdinfo);
 };
 
 #ifdef WIN32
@@ -113,16 +120,25 @@ struct eventop {
 struct event_map_entry;
 HT_HEAD(event_io_map, event_map_entry);
 #else
-#define event_io_map event_signal_map
+/* Used to map fds to a list of events when EVMAP_USE_HT is not defined.
+   Rather than pointing to a separate allocation for each fd, the map keeps
+   the per-fd state inline, in one array indexed by fd, so that finding the
+   events for a ready fd touches a single entry.
+*/
+struct event_io_map {
+	/* An array of nentries entries of entry_size bytes each: a struct
+	 * evmap_io, followed by the backend's fdinfo. */
+	char *entries;
+	/* The number of entries available in entries */
+	int nentries;
+	/* The size of each entry, or 0 if we have not allocated any. */
+	int entry_size;
+};
 #endif
 
-/* Used to map signal numbers to a list of events.  If EVMAP_USE_HT is not
-   defined, this structure is also used as event_io_map, which maps fds to a
-   list of events.
-*/
+/* Used to map signal numbers to a list of events. */
 struct event_signal_map {
-	/* An array of evmap_io * or of evmap_signal *; empty entries are
-	 * set to NULL. */
+	/* An array of evmap_signal *; empty entries are set to NULL. */
 	void **entries;
 	/* The number of entries available in entries */
 	int nentries;
@@ -145,7 +161,33 @@ struct common_timeout_list {
 	struct event_base *base;
 };
 
+/* How often a base has seen a timeout duration passed to event_add(), so
+ * that durations that keep recurring can be made into common timeouts
+ * without the caller having to ask. */
+struct timeout_duration_count {
+	/* The duration, as passed to event_add(). */
+	struct timeval duration;
+	/* How many times we have seen it since it took this slot. */
+	unsigned count;
+	/* The common timeout we made for it, or NULL if we haven't. */
+	const struct timeval *common;
+};
+
+/* The callbacks on a base that ran longer than a threshold, in a ring
+ * buffer.  See event_base_set_slow_callback_threshold(). */
+struct event_slow_callback_log {
+	/* Callbacks that run at least this long get recorded. */
+	ev_uint64_t threshold_nsec;
+	/* How many callbacks we have recorded in all.  The next one goes in
+	 * records[n_recorded % size]. */
+	ev_uint64_t n_recorded;
+	/* The number of entries in records. */
+	int size;
+	struct event_slow_callback records[1];
+};
+
 struct event_change;
+struct timerwheel;
 
 /* List of 'changes' since the last call to eventop.dispatch.  Only maintained
  * if the backend is using changesets. */
@@ -163,6 +205,35 @@ extern int _event_debug_mode_on;
 #define EVENT_DEBUG_MODE_IS_ON() (0)
 #endif
 
+/** A list of freed objects of one size that an event_base keeps around to
+ * hand out again instead of calling mm_malloc.  Each object on the list
+ * stores the pointer to the next one in its first bytes. */
+struct event_freelist {
+	void *head;
+	/** How many objects are on the list. */
+	int n_free;
+	/** The most objects we will keep on the list; 0 disables it. */
+	int max_free;
+	/** How many objects we have handed out, and how many of those came
+	 * from the list. */
+	ev_uint64_t n_allocated;
+	ev_uint64_t n_reused;
+};
+
+/** A callback that a thread is running on a leader/follower base.  Each
+ * thread keeps its own on the stack, and links it into the base's
+ * lf_running list while the callback runs. */
+struct event_lf_running {
+	TAILQ_ENTRY(event_lf_running) next;
+	/** The event whose callback is running; it may be freed by now. */
+	struct event *ev;
+	/** The fd of that event, or -1 if it was not an I/O event. */
+	evutil_socket_t fd;
+	/** The thread running the callback. */
+	unsigned long thread;
+};
+TAILQ_HEAD(event_lf_runningq, event_lf_running);
+
 struct event_base {
 	/** Function pointers and other data to describe this event_base's
 	 * backend. */
@@ -215,6 +286,12 @@ struct event_base {
 	int n_common_timeouts;
 	/** The total size of common_timeout_queues. */
 	int n_common_timeouts_allocated;
+	/** A hash table of recently added timeout durations, or NULL if we
+	 * have not added any yet. */
+	struct timeout_duration_count *timeout_durations;
+	/** How many of our common timeouts we made on our own, from
+	 * timeout_durations. */
+	int n_auto_common_timeouts;
 
 	/** List of defered_cb that are active.  We run these after the active
 	 * events. */
@@ -234,9 +311,65 @@ struct event_base {
 
 	/** Priority queue of events with timeouts. */
 	struct min_heap timeheap;
+	/** True while event_add_batch() or event_del_batch() holds the lock
+	 * and is changing timeheap without keeping it in order. */
+	int timeheap_unordered;
+	/** Timing wheel of events with timeouts; used instead of timeheap if
+	 * this base was configured with EVENT_BASE_FLAG_TIMER_WHEEL. */
+	struct timerwheel *timewheel;
+
+	/** Statistics about the loop, if this base was configured with
+	 * EVENT_BASE_FLAG_COLLECT_STATS; otherwise NULL. */
+	struct event_base_stats *stats;
+	/** Callbacks that ran for too long, or NULL if we aren't looking. */
+	struct event_slow_callback_log *slow_callbacks;
+	/** The trace we are recording, or NULL if we aren't; see
+	 * event_base_trace_start(). */
+	struct event_trace *trace;
+
+	/** Freed struct events, and freed event_base_once() objects, for
+	 * reuse; see event_config_set_object_cache(). */
+	struct event_freelist event_cache;
+	struct event_freelist once_cache;
+
+	/** The memory functions to allocate the base and the objects that
+	 * belong to it with, or NULL for the global ones. */
+	const struct event_mem_functions *mm;
+
+	/** The most callbacks to run before we poll the backend again, or 0
+	 * for no limit. */
+	int max_dispatch_callbacks;
+	/** How long to run callbacks before we poll the backend again, in
+	 * nanoseconds, or 0 for no limit. */
+	ev_uint64_t max_dispatch_nsec;
+	/** The limits above only apply to priorities this number or
+	 * higher. */
+	int limit_callbacks_after_prio;
+
+	/** How long to spin before blocking, in nanoseconds, if this base
+	 * was configured with EVENT_BASE_FLAG_BUSY_POLL; otherwise 0. */
+	ev_uint64_t busy_poll_nsec;
+	/** How many zero-timeout polls found something for us to do. */
+	ev_uint64_t busy_poll_hits;
+	/** How many times we blocked after spinning for busy_poll_nsec. */
+	ev_uint64_t busy_poll_blocks;
+
+	/** How many events the backend should expect to get back from one
+	 * wait, as set with event_config_set_size_hints(), or 0 if we have
+	 * no idea. */
+	int events_per_wakeup_hint;
 
 	/** Stored timeval: used to avoid calling gettimeofday too often. */
 	struct timeval tv_cache;
+	/** True if we read the time from CLOCK_MONOTONIC_COARSE; see
+	 * EVENT_BASE_FLAG_COARSE_TIME. */
+	int coarse_clock;
+	/** The difference between the wall clock and the clock we use for
+	 * tv_cache, so that we can tell the wall clock time without asking
+	 * the kernel.  Zero unless we use a monotonic clock. */
+	struct timeval tv_clock_diff;
+	/** The second of tv_cache in which we last set tv_clock_diff. */
+	time_t last_updated_clock_diff;
 
 #ifndef _EVENT_DISABLE_THREAD_SUPPORT
 	/* threading support */
@@ -251,6 +384,40 @@ struct event_base {
 	void *current_event_cond;
 	/** Number of threads blocking on current_event_cond. */
 	int current_event_waiters;
+
+	/** Activations of our events, and deferred callbacks, that other
+	 * threads have handed us without taking th_base_lock.  The loop
+	 * moves them to the active queues once per iteration. */
+	struct ev_mpsc_queue remote_active;
+	struct ev_mpsc_queue remote_deferred;
+
+	/** The event_base_group this base belongs to, or NULL. */
+	struct event_base_group *group;
+	/** True if this base's loop is blocked waiting for events.  Protected
+	 * by the lock of 'group'. */
+	int group_idle;
+	/** An event from another base in the group whose callback this base's
+	 * thread is running right now.  Protected by that event's base's
+	 * lock. */
+	struct event *stolen_event;
+	/** A condition that gets signalled when another thread is done with
+	 * a callback it stole from us, and the number of threads waiting on
+	 * it. */
+	void *stolen_event_cond;
+	int stolen_event_waiters;
+
+	/* Leader/follower dispatch; see EVENT_BASE_FLAG_LEADER_FOLLOWER. */
+	/** The number of threads running event_base_loop on this base. */
+	int lf_n_threads;
+	/** True while one of them is waiting in the backend. */
+	int lf_leader_polling;
+	/** True while one of them is running deferred callbacks. */
+	int lf_deferred_running;
+	/** Signalled when the leader is done waiting, or when a callback
+	 * finishes and leaves other work behind. */
+	void *lf_leader_cond;
+	/** The callbacks that threads are running right now. */
+	struct event_lf_runningq lf_running;
 #endif
 
 #ifdef WIN32
@@ -275,6 +442,19 @@ struct event_base {
 	int (*th_notify_fn)(struct event_base *base);
 };
 
+/** A set of event_bases, each run by its own thread, that can take active
+ * callbacks from one another. */
+struct event_base_group {
+	/** Protects n_idle and the group_idle field of each base.  No other
+	 * lock is ever acquired while this one is held. */
+	void *lock;
+	/** Number of bases whose loops are blocked waiting for events. */
+	int n_idle;
+	/** The number of bases, and the bases themselves. */
+	int n_bases;
+	struct event_base **bases;
+};
+
 struct event_config_entry {
 	TAILQ_ENTRY(event_config_entry) next;
 
@@ -289,6 +469,21 @@ struct event_config {
 	int n_cpus_hint;
 	enum event_method_feature require_features;
 	enum event_base_config_flag flags;
+	/** How long to spin with EVENT_BASE_FLAG_BUSY_POLL, if set. */
+	struct timeval busy_poll_budget;
+	/** Limits on how long to run callbacks before polling again, as set
+	 * with event_config_set_max_dispatch_interval(); 0 means no limit. */
+	struct timeval max_dispatch_interval;
+	int max_dispatch_callbacks;
+	int limit_callbacks_after_prio;
+	/** The size limit of each object cache, or 0 for no caches. */
+	int max_cached_objects;
+	/** Memory functions for the base, or NULL for the global ones. */
+	const struct event_mem_functions *mm;
+	/** Sizing hints from event_config_set_size_hints(), or 0. */
+	int expected_fds;
+	int expected_timers;
+	int events_per_wakeup;
 };
 
 /* Internal use only: Functions that might be missing from <sys/queue.h> */
@@ -321,6 +516,26 @@ void event_active_nolock(struct event *ev, int res, short count);
 void event_base_add_virtual(struct event_base *base);
 void event_base_del_virtual(struct event_base *base);
 
+/** Append a record of type 'type' (an enum event_trace_type) to the trace
+ * of 'base', which must have one.  Requires the lock on 'base'.  Returns
+ * the time it recorded. */
+ev_uint64_t _event_trace_record(struct event_base *base, int type,
+    evutil_socket_t fd, ev_uint64_t value, ev_uint64_t extra);
+/** Return the current time, on the clock of the trace records. */
+ev_uint64_t _event_trace_now(void);
+/** Release the trace of 'base', if any, without taking its lock. */
+void _event_trace_free(struct event_base *base);
+
+/** Record an event in the trace of 'base', if it has one. */
+#define EVENT_TRACE(base, type, fd, value, extra) do {			\
+		if ((base)->trace)					\
+			_event_trace_record((base), (type), (fd),	\
+			    (ev_uint64_t)(value), (ev_uint64_t)(extra));	\
+	} while (0)
+
+/** The address of the callback of 'ev', as a number for the trace. */
+#define EVENT_TRACE_CB(ev) ((ev_uint64_t)(ev_uintptr_t)(ev)->ev_callback)
+
 #ifdef __cplusplus
 }
 #endif
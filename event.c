@@ -66,6 +66,7 @@
 #include "evmap-internal.h"
 #include "iocp-internal.h"
 #include "changelist-internal.h"
+#include "timerwheel-internal.h"
 #include "ht-internal.h"
 #include "util-internal.h"
 
@@ -81,6 +82,9 @@ extern const struct eventop pollops;
 #ifdef _EVENT_HAVE_EPOLL
 extern const struct eventop epollops;
 #endif
+#ifdef _EVENT_HAVE_IO_URING
+extern const struct eventop iouringops;
+#endif
 #ifdef _EVENT_HAVE_WORKING_KQUEUE
 extern const struct eventop kqops;
 #endif
@@ -102,6 +106,9 @@ static const struct eventop *eventops[] = {
 #ifdef _EVENT_HAVE_EPOLL
 	&epollops,
 #endif
+#ifdef _EVENT_HAVE_IO_URING
+	&iouringops,
+#endif
 #ifdef _EVENT_HAVE_DEVPOLL
 	&devpollops,
 #endif
@@ -143,7 +150,37 @@ static void	timeout_correct(struct event_base *, struct timeval *);
 static inline void	event_signal_closure(struct event_base *, struct event *ev);
 static inline void	event_persist_closure(struct event_base *, struct event *ev);
 
+static void	event_freelist_clear(struct event_freelist *,
+    const struct event_mem_functions *);
+
 static int	evthread_notify_base(struct event_base *base);
+static inline int timeheap_settle(struct event_base *base);
+static void	deferred_cb_schedule_nolock(struct deferred_cb_queue *,
+    struct deferred_cb *);
+
+#if !defined(_EVENT_DISABLE_THREAD_SUPPORT) && defined(EVUTIL_HAVE_ATOMICS)
+/* Other threads can hand work to a base's loop without taking its lock. */
+#define USE_REMOTE_QUEUES
+static void	event_base_drain_remote(struct event_base *);
+/* Move anything other threads have handed us onto the active queues.
+ * Requires th_base_lock. */
+#define EVBASE_DRAIN_REMOTE(base) do {					\
+		if (!ev_mpsc_empty(&(base)->remote_active) ||		\
+		    !ev_mpsc_empty(&(base)->remote_deferred))		\
+			event_base_drain_remote(base);			\
+	} while (0)
+#else
+#define EVBASE_DRAIN_REMOTE(base) _EVUTIL_NIL_STMT
+#endif
+
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+static struct event_base *event_stolen_by(struct event_base *, struct event *);
+static int	event_base_group_steal(struct event_base *);
+static void	event_base_group_set_idle(struct event_base *, int);
+static void	event_base_group_wake_idle(struct event_base *);
+static int	event_base_loop_lf(struct event_base *, int);
+static int	event_running_elsewhere(struct event_base *, struct event *);
+#endif
 
 #ifndef _EVENT_DISABLE_DEBUG_MODE
 /* These functions implement a hashtable of which 'struct event *' structures
@@ -348,8 +385,13 @@ gettime(struct event_base *base, struct timeval *tp)
 #if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
 	if (use_monotonic) {
 		struct timespec	ts;
+		clockid_t id = CLOCK_MONOTONIC;
 
-		if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+#ifdef CLOCK_MONOTONIC_COARSE
+		if (base->coarse_clock)
+			id = CLOCK_MONOTONIC_COARSE;
+#endif
+		if (clock_gettime(id, &ts) == -1)
 			return (-1);
 
 		tp->tv_sec = ts.tv_sec;
@@ -361,6 +403,105 @@ gettime(struct event_base *base, struct timeval *tp)
 	return (evutil_gettimeofday(tp, NULL));
 }
 
+/* Set up 'base' to read the coarse monotonic clock, if it asked for it
+ * and we have one. */
+static void
+detect_coarse_clock(struct event_base *base)
+{
+#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_COARSE)
+	struct timespec	ts;
+
+	/* The coarse clock doesn't count from the same point as the real
+	 * one would on every system, but we use one or the other for the
+	 * whole life of the base, so it doesn't matter. */
+	if (use_monotonic && (base->flags & EVENT_BASE_FLAG_COARSE_TIME) &&
+	    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0)
+		base->coarse_clock = 1;
+#endif
+}
+
+/** Return the current time in nanoseconds, ignoring the time cache; used
+ * for the statistics of EVENT_BASE_FLAG_COLLECT_STATS. */
+static ev_uint64_t
+stats_now(void)
+{
+	struct timeval tv;
+#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	if (use_monotonic) {
+		struct timespec	ts;
+
+		if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+			return (ev_uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+#endif
+	evutil_gettimeofday(&tv, NULL);
+	return (ev_uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+/** Return the bucket of event_base_stats.callback_hist for a callback that
+ * took 'nsec' nanoseconds. */
+static inline int
+stats_hist_bucket(ev_uint64_t nsec)
+{
+	int shift = 0, idx;
+
+	if (nsec < 8)
+		return (int)nsec;
+	while ((nsec >> shift) >= 16)
+		++shift;
+	idx = ((shift + 1) << 3) + (int)((nsec >> shift) & 7);
+	return idx < EVENT_STATS_HISTOGRAM_SIZE ?
+	    idx : EVENT_STATS_HISTOGRAM_SIZE - 1;
+}
+
+#define STATS_PRI(pri) ((pri) < EVENT_STATS_N_PRIORITIES ? \
+	    (pri) : EVENT_STATS_N_PRIORITIES - 1)
+
+int
+event_base_get_stats(struct event_base *base, struct event_base_stats *stats)
+{
+	int r = -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->stats) {
+		memcpy(stats, base->stats, sizeof(struct event_base_stats));
+		r = 0;
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
+ev_uint64_t
+event_base_stats_percentile(const struct event_base_stats *stats,
+    double fraction)
+{
+	ev_uint64_t total = 0, want, seen = 0;
+	int i, shift;
+
+	for (i = 0; i < EVENT_STATS_HISTOGRAM_SIZE; ++i)
+		total += stats->callback_hist[i];
+	if (!total)
+		return 0;
+	if (fraction < 0.0)
+		fraction = 0.0;
+	if (fraction > 1.0)
+		fraction = 1.0;
+	want = (ev_uint64_t)(fraction * total + 0.5);
+	if (want < 1)
+		want = 1;
+
+	for (i = 0; i < EVENT_STATS_HISTOGRAM_SIZE - 1; ++i) {
+		seen += stats->callback_hist[i];
+		if (seen >= want)
+			break;
+	}
+	if (i < 8)
+		return i;
+	/* The largest value that falls in bucket i. */
+	shift = (i >> 3) - 1;
+	return (((ev_uint64_t)(9 + (i & 7))) << shift) - 1;
+}
+
 int
 event_base_gettimeofday_cached(struct event_base *base, struct timeval *tv)
 {
@@ -377,6 +518,25 @@ event_base_gettimeofday_cached(struct event_base *base, struct timeval *tv)
 	return r;
 }
 
+int
+event_base_get_wallclock_cached(struct event_base *base, struct timeval *tv)
+{
+	int r = 0;
+	if (!base) {
+		base = current_base;
+		if (!current_base)
+			return evutil_gettimeofday(tv, NULL);
+	}
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->tv_cache.tv_sec == 0)
+		r = evutil_gettimeofday(tv, NULL);
+	else
+		evutil_timeradd(&base->tv_cache, &base->tv_clock_diff, tv);
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
 /** Make 'base' have no current cached time. */
 static inline void
 clear_time_cache(struct event_base *base)
@@ -391,6 +551,18 @@ update_time_cache(struct event_base *base)
 	base->tv_cache.tv_sec = 0;
 	if (!(base->flags & EVENT_BASE_FLAG_NO_CACHE_TIME))
 	    gettime(base, &base->tv_cache);
+
+	/* Measure how far the wall clock is from ours once a second, so
+	 * that event_base_get_wallclock_cached() doesn't have to. */
+	if (use_monotonic && base->tv_cache.tv_sec &&
+	    base->tv_cache.tv_sec != base->last_updated_clock_diff) {
+		struct timeval wall;
+		if (evutil_gettimeofday(&wall, NULL) == 0) {
+			evutil_timersub(&wall, &base->tv_cache,
+			    &base->tv_clock_diff);
+			base->last_updated_clock_diff = base->tv_cache.tv_sec;
+		}
+	}
 }
 
 struct event_base *
@@ -529,35 +701,86 @@ event_base_new_with_config(const struct event_config *cfg)
 	}
 #endif
 
-	if ((base = mm_calloc(1, sizeof(struct event_base))) == NULL) {
+	if ((base = mm_calloc_with(cfg ? cfg->mm : NULL, 1,
+		    sizeof(struct event_base))) == NULL) {
 		event_warn("%s: calloc", __func__);
 		return NULL;
 	}
+	base->mm = cfg ? cfg->mm : NULL;
 	detect_monotonic();
+	if (cfg)
+		base->flags = cfg->flags;
+	detect_coarse_clock(base);
 	gettime(base, &base->event_tv);
 
 	min_heap_ctor(&base->timeheap);
 	TAILQ_INIT(&base->eventqueue);
 	base->sig.ev_signal_pair[0] = -1;
 	base->sig.ev_signal_pair[1] = -1;
+#ifdef EVSIG_USE_SIGNALFD
+	base->sig.ev_signalfd = -1;
+#endif
 	base->th_notify_fd[0] = -1;
 	base->th_notify_fd[1] = -1;
 
 	event_deferred_cb_queue_init(&base->defer_queue);
 	base->defer_queue.notify_fn = notify_base_cbq_callback;
 	base->defer_queue.notify_arg = base;
-	if (cfg)
-		base->flags = cfg->flags;
 
 	evmap_io_initmap(&base->io);
 	evmap_signal_initmap(&base->sigmap);
 	event_changelist_init(&base->changelist);
 
+	if (cfg && (cfg->flags & EVENT_BASE_FLAG_TIMER_WHEEL)) {
+		base->timewheel = mm_malloc(sizeof(struct timerwheel));
+		if (base->timewheel == NULL) {
+			event_warn("%s: malloc", __func__);
+			event_base_free(base);
+			return NULL;
+		}
+		timerwheel_init(base->timewheel, &base->event_tv);
+	}
+
+	if (cfg && (cfg->flags & EVENT_BASE_FLAG_COLLECT_STATS)) {
+		base->stats = mm_calloc(1, sizeof(struct event_base_stats));
+		if (base->stats == NULL) {
+			event_warn("%s: calloc", __func__);
+			event_base_free(base);
+			return NULL;
+		}
+	}
+
+	if (cfg) {
+		base->max_dispatch_callbacks = cfg->max_dispatch_callbacks;
+		base->max_dispatch_nsec =
+		    (ev_uint64_t)cfg->max_dispatch_interval.tv_sec *
+		    1000000000 +
+		    (ev_uint64_t)cfg->max_dispatch_interval.tv_usec * 1000;
+		base->limit_callbacks_after_prio =
+		    cfg->limit_callbacks_after_prio;
+		base->event_cache.max_free = cfg->max_cached_objects;
+		base->once_cache.max_free = cfg->max_cached_objects;
+		base->events_per_wakeup_hint = cfg->events_per_wakeup;
+	}
+
+	if (cfg && (cfg->flags & EVENT_BASE_FLAG_BUSY_POLL)) {
+		if (evutil_timerisset(&cfg->busy_poll_budget))
+			base->busy_poll_nsec =
+			    (ev_uint64_t)cfg->busy_poll_budget.tv_sec *
+			    1000000000 +
+			    (ev_uint64_t)cfg->busy_poll_budget.tv_usec * 1000;
+		else
+			base->busy_poll_nsec = 50000;
+	}
+
 	base->evbase = NULL;
 
 	should_check_environment =
 	    !(cfg && (cfg->flags & EVENT_BASE_FLAG_IGNORE_ENV));
 
+	if (should_check_environment && evutil_getenv("EVENT_PRECISE_TIMER"))
+		base->flags |= EVENT_BASE_FLAG_PRECISE_TIMER;
+
 	for (i = 0; eventops[i] && !base->evbase; i++) {
 		if (cfg != NULL) {
 			/* determine if this backend should be avoided */
@@ -567,6 +790,10 @@ event_base_new_with_config(const struct event_config *cfg)
 			if ((eventops[i]->features & cfg->require_features)
 			    != cfg->require_features)
 				continue;
+			/* leader/follower dispatch needs one-shot fds */
+			if ((cfg->flags & EVENT_BASE_FLAG_LEADER_FOLLOWER) &&
+			    !eventops[i]->rearm)
+				continue;
 		}
 
 		/* also obey the environment variables */
@@ -589,6 +816,16 @@ event_base_new_with_config(const struct event_config *cfg)
 	if (evutil_getenv("EVENT_SHOW_METHOD"))
 		event_msgx("libevent using: %s", base->evsel->name);
 
+	/* Size the fd map and the timeout heap for what the user told us to
+	 * expect, so they don't have to grow one step at a time later. */
+	if (cfg && (evmap_io_reserve(base, cfg->expected_fds) < 0 ||
+		(cfg->expected_timers > 0 && min_heap_reserve(&base->timeheap,
+		    (unsigned)cfg->expected_timers) < 0))) {
+		event_warn("%s: reserve", __func__);
+		event_base_free(base);
+		return NULL;
+	}
+
 	/* allocate a single active event queue */
 	if (event_base_priority_init(base, 1) < 0) {
 		event_base_free(base);
@@ -602,6 +839,8 @@ event_base_new_with_config(const struct event_config *cfg)
 		int r;
 		EVTHREAD_ALLOC_LOCK(base->th_base_lock,
 		    EVTHREAD_LOCKTYPE_RECURSIVE);
+		EVTHREAD_SET_LOCK_CLASS(base->th_base_lock,
+		    EVTHREAD_LOCK_CLASS_BASE);
 		base->defer_queue.lock = base->th_base_lock;
 		EVTHREAD_ALLOC_COND(base->current_event_cond);
 		r = evthread_make_base_notifiable(base);
@@ -610,6 +849,23 @@ event_base_new_with_config(const struct event_config *cfg)
 			return NULL;
 		}
 	}
+	if (base->flags & EVENT_BASE_FLAG_LEADER_FOLLOWER) {
+		TAILQ_INIT(&base->lf_running);
+		EVTHREAD_ALLOC_COND(base->lf_leader_cond);
+		if (base->th_base_lock == NULL ||
+		    base->lf_leader_cond == NULL) {
+			event_warnx("%s: leader/follower dispatch needs "
+			    "locking", __func__);
+			event_base_free(base);
+			return NULL;
+		}
+	}
+#else
+	if (base->flags & EVENT_BASE_FLAG_LEADER_FOLLOWER) {
+		event_warnx("%s: built without thread support", __func__);
+		event_base_free(base);
+		return NULL;
+	}
 #endif
 
 #ifdef WIN32
@@ -667,6 +923,12 @@ event_base_free(struct event_base *base)
 	/* XXX(niels) - check for internal events first */
 	EVUTIL_ASSERT(base);
 
+	/* Activations that other threads queued for us become ordinary
+	 * active events, which we delete below. */
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	EVBASE_DRAIN_REMOTE(base);
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
 #ifdef WIN32
 	event_base_stop_iocp(base);
 #endif
@@ -695,6 +957,12 @@ event_base_free(struct event_base *base)
 		event_del(ev);
 		++n_deleted;
 	}
+	if (base->timewheel) {
+		while ((ev = timerwheel_any(base->timewheel)) != NULL) {
+			event_del(ev);
+			++n_deleted;
+		}
+	}
 	for (i = 0; i < base->n_common_timeouts; ++i) {
 		struct common_timeout_list *ctl =
 		    base->common_timeout_queues[i];
@@ -713,6 +981,8 @@ event_base_free(struct event_base *base)
 	}
 	if (base->common_timeout_queues)
 		mm_free(base->common_timeout_queues);
+	if (base->timeout_durations)
+		mm_free(base->timeout_durations);
 
 	for (i = 0; i < base->nactivequeues; ++i) {
 		for (ev = TAILQ_FIRST(&base->activequeues[i]); ev; ) {
@@ -737,6 +1007,10 @@ event_base_free(struct event_base *base)
 
 	EVUTIL_ASSERT(min_heap_empty(&base->timeheap));
 	min_heap_dtor(&base->timeheap);
+	if (base->timewheel) {
+		EVUTIL_ASSERT(timerwheel_size(base->timewheel) == 0);
+		mm_free(base->timewheel);
+	}
 
 	mm_free(base->activequeues);
 
@@ -748,8 +1022,19 @@ event_base_free(struct event_base *base)
 
 	EVTHREAD_FREE_LOCK(base->th_base_lock, EVTHREAD_LOCKTYPE_RECURSIVE);
 	EVTHREAD_FREE_COND(base->current_event_cond);
+	EVTHREAD_FREE_COND(base->stolen_event_cond);
+	EVTHREAD_FREE_COND(base->lf_leader_cond);
+
+	if (base->stats)
+		mm_free(base->stats);
+	if (base->slow_callbacks)
+		mm_free(base->slow_callbacks);
+	_event_trace_free(base);
 
-	mm_free(base);
+	event_freelist_clear(&base->event_cache, base->mm);
+	event_freelist_clear(&base->once_cache, base->mm);
+
+	mm_free_with(base->mm, base);
 }
 
 /* reinitialize the event base after a fork */
@@ -947,6 +1232,71 @@ event_config_set_num_cpus_hint(struct event_config *cfg, int cpus)
 	return (0);
 }
 
+int
+event_config_set_max_dispatch_interval(struct event_config *cfg,
+    const struct timeval *max_interval, int max_callbacks, int min_priority)
+{
+	if (!cfg || min_priority < 0)
+		return (-1);
+	if (max_interval) {
+		if (max_interval->tv_sec < 0 || max_interval->tv_usec < 0 ||
+		    max_interval->tv_usec >= 1000000)
+			return (-1);
+		cfg->max_dispatch_interval = *max_interval;
+	} else {
+		evutil_timerclear(&cfg->max_dispatch_interval);
+	}
+	cfg->max_dispatch_callbacks = max_callbacks > 0 ? max_callbacks : 0;
+	cfg->limit_callbacks_after_prio = min_priority;
+	return (0);
+}
+
+#ifndef _EVENT_DISABLE_MM_REPLACEMENT
+int
+event_config_set_mem_functions(struct event_config *cfg,
+    const struct event_mem_functions *mm)
+{
+	if (!cfg || (mm && (!mm->malloc_fn || !mm->realloc_fn ||
+		    !mm->free_fn)))
+		return (-1);
+	cfg->mm = mm;
+	return (0);
+}
+#endif
+
+int
+event_config_set_object_cache(struct event_config *cfg, int max_cached)
+{
+	if (!cfg || max_cached < 0)
+		return (-1);
+	cfg->max_cached_objects = max_cached;
+	return (0);
+}
+
+int
+event_config_set_busy_poll_budget(struct event_config *cfg,
+    const struct timeval *budget)
+{
+	if (!cfg || !budget || budget->tv_sec < 0 || budget->tv_usec < 0 ||
+	    budget->tv_usec >= 1000000)
+		return (-1);
+	cfg->busy_poll_budget = *budget;
+	return (0);
+}
+
+int
+event_config_set_size_hints(struct event_config *cfg, int expected_fds,
+    int expected_timers, int events_per_wakeup)
+{
+	if (!cfg || expected_fds < 0 || expected_timers < 0 ||
+	    events_per_wakeup < 0)
+		return (-1);
+	cfg->expected_fds = expected_fds;
+	cfg->expected_timers = expected_timers;
+	cfg->events_per_wakeup = events_per_wakeup;
+	return (0);
+}
+
 int
 event_priority_init(int npriorities)
 {
@@ -1112,6 +1462,8 @@ common_timeout_callback(evutil_socket_t fd, short what, void *arg)
 			(ev->ev_timeout.tv_usec&MICROSECONDS_MASK) > now.tv_usec))
 			break;
 		event_del_internal(ev);
+		EVENT_TRACE(base, EVENT_TRACE_TIMER, ev->ev_fd,
+		    EVENT_TRACE_CB(ev), 0);
 		event_active_nolock(ev, EV_TIMEOUT, 1);
 	}
 	if (ev)
@@ -1121,8 +1473,8 @@ common_timeout_callback(evutil_socket_t fd, short what, void *arg)
 
 #define MAX_COMMON_TIMEOUTS 256
 
-const struct timeval *
-event_base_init_common_timeout(struct event_base *base,
+static const struct timeval *
+event_base_init_common_timeout_nolock(struct event_base *base,
     const struct timeval *duration)
 {
 	int i;
@@ -1130,7 +1482,7 @@ event_base_init_common_timeout(struct event_base *base,
 	const struct timeval *result=NULL;
 	struct common_timeout_list *new_ctl;
 
-	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	EVENT_BASE_ASSERT_LOCKED(base);
 	if (duration->tv_usec > 1000000) {
 		memcpy(&tv, duration, sizeof(struct timeval));
 		if (is_common_timeout(duration, base))
@@ -1191,10 +1543,82 @@ done:
 	if (result)
 		EVUTIL_ASSERT(is_common_timeout(result, base));
 
+	return result;
+}
+
+const struct timeval *
+event_base_init_common_timeout(struct event_base *base,
+    const struct timeval *duration)
+{
+	const struct timeval *result;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	result = event_base_init_common_timeout_nolock(base, duration);
 	EVBASE_RELEASE_LOCK(base, th_base_lock);
 	return result;
 }
 
+/* Number of slots in timeout_durations.  Must be a power of two. */
+#define TIMEOUT_DURATION_SLOTS 64
+/* How many times we need to see a duration before we make it common. */
+#define AUTO_COMMON_TIMEOUT_THRESHOLD 32
+/* The most common timeouts we will make on our own for one base. */
+#define MAX_AUTO_COMMON_TIMEOUTS 32
+
+/* Helper for event_add_internal: if the relative timeout 'tv' is one that
+ * gets added to 'base' over and over, return a common timeout for the same
+ * duration, creating it if need be, so that events using it get queued in
+ * O(1).  Otherwise, return 'tv'.
+ *
+ * timeout_durations is a direct-mapped table: a duration that collides with
+ * a busier one just keeps losing its slot, and a slot whose duration has
+ * been made common keeps it. */
+static const struct timeval *
+event_base_promote_timeout(struct event_base *base, const struct timeval *tv)
+{
+	struct timeout_duration_count *slot;
+	const struct timeval *common;
+	unsigned h;
+
+	if (tv->tv_sec < 0 || tv->tv_usec < 0 || tv->tv_usec >= 1000000 ||
+	    (tv->tv_sec == 0 && tv->tv_usec == 0))
+		return tv;
+
+	if (!base->timeout_durations) {
+		base->timeout_durations = mm_calloc(TIMEOUT_DURATION_SLOTS,
+		    sizeof(struct timeout_duration_count));
+		if (!base->timeout_durations)
+			return tv;
+	}
+
+	h = ((unsigned)tv->tv_sec * 2654435761u) ^ (unsigned)tv->tv_usec;
+	slot = &base->timeout_durations[h & (TIMEOUT_DURATION_SLOTS - 1)];
+	if (slot->duration.tv_sec != tv->tv_sec ||
+	    slot->duration.tv_usec != tv->tv_usec) {
+		if (!slot->common) {
+			slot->duration = *tv;
+			slot->count = 1;
+		}
+		return tv;
+	}
+	if (slot->common)
+		return slot->common;
+
+	if (++slot->count < AUTO_COMMON_TIMEOUT_THRESHOLD ||
+	    base->n_auto_common_timeouts >= MAX_AUTO_COMMON_TIMEOUTS ||
+	    base->n_common_timeouts >= MAX_COMMON_TIMEOUTS)
+		return tv;
+
+	common = event_base_init_common_timeout_nolock(base, tv);
+	if (!common)
+		return tv;
+	event_debug(("%s: made %d.%06d seconds a common timeout", __func__,
+		(int)tv->tv_sec, (int)tv->tv_usec));
+	slot->common = common;
+	++base->n_auto_common_timeouts;
+	return common;
+}
+
 /* Closure function invoked when we're activating a persistent event. */
 static inline void
 event_persist_closure(struct event_base *base, struct event *ev)
@@ -1238,23 +1662,86 @@ event_persist_closure(struct event_base *base, struct event *ev)
 	(*ev->ev_callback)((int)ev->ev_fd, ev->ev_res, ev->ev_arg);
 }
 
+/* Helper for event_process_active_single_queue, event_lf_run_one and
+ * event_base_group_steal: account for a callback described by 'rec' in the
+ * statistics and slow-callback log of 'base'.  Requires the lock on
+ * 'base'. */
+static void
+event_base_note_callback(struct event_base *base,
+    const struct event_slow_callback *rec)
+{
+	struct event_slow_callback_log *log = base->slow_callbacks;
+
+	if (base->stats) {
+		base->stats->callback_hist[
+		    stats_hist_bucket(rec->duration_nsec)]++;
+		base->stats->n_callbacks[STATS_PRI(rec->priority)]++;
+	}
+	if (log && rec->duration_nsec >= log->threshold_nsec) {
+		log->records[log->n_recorded % log->size] = *rec;
+		log->n_recorded++;
+	}
+}
+
+/* Return the first event in 'activeq' whose callback no other base of our
+ * group is running, or NULL if there is none.  Requires the lock on
+ * 'base'. */
+static inline struct event *
+event_first_runnable(struct event_base *base, struct event_list *activeq)
+{
+	struct event *ev = TAILQ_FIRST(activeq);
+
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+	/* A persistent event can become active again while another base
+	 * still runs the callback it stole; leave it queued until then. */
+	if (base->group) {
+		while (ev && event_stolen_by(base, ev))
+			ev = TAILQ_NEXT(ev, ev_active_next);
+	}
+#endif
+	return ev;
+}
+
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+/* Return true iff some active event of 'base' can run now.  Requires the
+ * lock on 'base'. */
+static int
+event_base_has_runnable(struct event_base *base)
+{
+	int i;
+
+	for (i = 0; i < base->nactivequeues; ++i) {
+		if (event_first_runnable(base, &base->activequeues[i]))
+			return 1;
+	}
+	return 0;
+}
+#endif
+
 /*
   Helper for event_process_active to process all the events in a single queue,
   releasing the lock as we go.  This function requires that the lock be held
-  when it's invoked.  Returns -1 if we get a signal or an event_break that
-  means we should stop processing any active events now.  Otherwise returns
-  the number of non-internal events that we processed.
+  when it's invoked.  Events whose callback another base of our group is
+  running stay on the queue for later.  Stops after 'max_to_process' callbacks (if nonzero), or
+  once stats_now() reaches 'endtime' (if nonzero), so that the loop can poll
+  again.  Returns -1 if we get a signal or an event_break that means we
+  should stop processing any active events now.  Otherwise returns the
+  number of non-internal events that we processed.
 */
 static int
 event_process_active_single_queue(struct event_base *base,
-    struct event_list *activeq)
+    struct event_list *activeq, int max_to_process, ev_uint64_t endtime)
 {
 	struct event *ev;
-	int count = 0;
+	int count = 0, timed;
+	ev_uint64_t started = 0, trace_begin = 0, trace_cb = 0;
+	evutil_socket_t trace_fd = -1;
+	struct event_slow_callback rec;
 
 	EVUTIL_ASSERT(activeq != NULL);
 
-	for (ev = TAILQ_FIRST(activeq); ev; ev = TAILQ_FIRST(activeq)) {
+	for (ev = event_first_runnable(base, activeq); ev;
+	     ev = event_first_runnable(base, activeq)) {
 		if (ev->ev_events & EV_PERSIST)
 			event_queue_remove(base, ev, EVLIST_ACTIVE);
 		else
@@ -1262,6 +1749,15 @@ event_process_active_single_queue(struct event_base *base,
 		if (!(ev->ev_flags & EVLIST_INTERNAL))
 			++count;
 
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+		/* We're about to be busy for a while; if there is more
+		 * queued up behind this callback, let an idle base in our
+		 * group come and take some of it. */
+		if (base->group && base->group->n_idle &&
+		    base->event_count_active)
+			event_base_group_wake_idle(base);
+#endif
+
 		event_debug((
 			 "event_process_active: event: %p, %s%scall %p",
 			ev,
@@ -1274,6 +1770,25 @@ event_process_active_single_queue(struct event_base *base,
 		base->current_event_waiters = 0;
 #endif
 
+		/* The callback may free 'ev', so take down what we need
+		 * to know about it now. */
+		timed = base->stats || base->slow_callbacks;
+		if (timed) {
+			rec.callback = ev->ev_callback;
+			rec.arg = ev->ev_arg;
+			rec.fd = ev->ev_fd;
+			rec.events = ev->ev_res;
+			rec.priority = ev->ev_pri;
+			started = stats_now();
+		}
+		if (base->trace) {
+			trace_fd = ev->ev_fd;
+			trace_cb = EVENT_TRACE_CB(ev);
+			trace_begin = _event_trace_record(base,
+			    EVENT_TRACE_CALLBACK_BEGIN, trace_fd, trace_cb,
+			    ev->ev_res);
+		}
+
 		switch (ev->ev_closure) {
 		case EV_CLOSURE_SIGNAL:
 			event_signal_closure(base, ev);
@@ -1290,6 +1805,17 @@ event_process_active_single_queue(struct event_base *base,
 		}
 
 		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+
+		if (timed) {
+			rec.duration_nsec = stats_now() - started;
+			event_base_note_callback(base, &rec);
+		}
+		if (trace_begin) {
+			EVENT_TRACE(base, EVENT_TRACE_CALLBACK_END, trace_fd,
+			    trace_begin, trace_cb);
+			trace_begin = 0;
+		}
+
 #ifndef _EVENT_DISABLE_THREAD_SUPPORT
 		base->current_event = NULL;
 		if (base->current_event_waiters) {
@@ -1300,6 +1826,10 @@ event_process_active_single_queue(struct event_base *base,
 
 		if (base->event_break)
 			return -1;
+		if (max_to_process && count >= max_to_process)
+			return count;
+		if (count && endtime && stats_now() >= endtime)
+			return count;
 	}
 	return count;
 }
@@ -1346,23 +1876,63 @@ event_process_active(struct event_base *base)
 {
 	/* Caller must hold th_base_lock */
 	struct event_list *activeq = NULL;
-	int i, c;
+	int i, c, maxcb = 0, ran = 0;
+	ev_uint64_t started = 0, endtime = 0, trace_begin = 0;
 
 	for (i = 0; i < base->nactivequeues; ++i) {
 		if (TAILQ_FIRST(&base->activequeues[i]) != NULL) {
 			activeq = &base->activequeues[i];
-			c = event_process_active_single_queue(base, activeq);
+			if (i >= base->limit_callbacks_after_prio) {
+				maxcb = base->max_dispatch_callbacks;
+				if (base->max_dispatch_nsec && !endtime)
+					endtime = stats_now() +
+					    base->max_dispatch_nsec;
+			}
+			if (base->stats)
+				started = stats_now();
+			c = event_process_active_single_queue(base, activeq,
+			    maxcb, endtime);
+			if (base->stats)
+				base->stats->active_nsec[STATS_PRI(i)] +=
+				    stats_now() - started;
 			if (c < 0)
 				return;
-			else if (c > 0)
+			else if (c > 0) {
+				ran = 1;
 				break; /* Processed a real event; do not
 					* consider lower-priority events */
+			}
 			/* If we get here, all of the events we processed
 			 * were internal.  Continue. */
 		}
 	}
 
-	event_process_deferred_callbacks(&base->defer_queue,&base->event_break);
+	if (base->trace && base->defer_queue.active_count)
+		trace_begin = _event_trace_now();
+	if (base->stats) {
+		started = stats_now();
+		c = event_process_deferred_callbacks(&base->defer_queue,
+		    &base->event_break);
+		base->stats->deferred_nsec += stats_now() - started;
+		if (c > 0)
+			base->stats->n_deferred += c;
+	} else {
+		c = event_process_deferred_callbacks(&base->defer_queue,
+		    &base->event_break);
+	}
+	if (trace_begin)
+		EVENT_TRACE(base, EVENT_TRACE_DEFERRED, -1, trace_begin, c);
+
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+	/* If all we have left to run is being run by other bases of our
+	 * group, wait for one of them to finish, rather than poll the
+	 * backend again and again until then. */
+	if (!ran && c <= 0 && base->group && base->event_count_active &&
+	    !base->event_break && !event_base_has_runnable(base)) {
+		++base->stolen_event_waiters;
+		EVTHREAD_COND_WAIT(base->stolen_event_cond, base->th_base_lock);
+	}
+#endif
 }
 
 /*
@@ -1464,18 +2034,43 @@ event_loop(int flags)
 	return event_base_loop(current_base, flags);
 }
 
+/* Helper for EVENT_BASE_FLAG_BUSY_POLL: return true iff the loop should
+ * poll again with a zero timeout rather than block, because it has not yet
+ * spent busy_poll_nsec looking for work.  '*idle_since' is when we started
+ * looking, or 0 if we just found some. */
+static int
+busy_poll_should_spin(struct event_base *base, ev_uint64_t *idle_since)
+{
+	ev_uint64_t now = stats_now();
+
+	if (!*idle_since) {
+		*idle_since = now;
+		return 1;
+	}
+	return now - *idle_since < base->busy_poll_nsec;
+}
+
 int
 event_base_loop(struct event_base *base, int flags)
 {
 	const struct eventop *evsel = base->evsel;
 	struct timeval tv;
 	struct timeval *tv_p;
-	int res, done, retval = 0;
+	int res, done, retval = 0, stole = 0, spinning = 0, blocking;
+	ev_uint64_t started = 0, idle_since = 0, wait_began = 0;
 
 	/* Grab the lock.  We will release it inside evsel.dispatch, and again
 	 * as we invoke user callbacks. */
 	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
 
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+	if (base->flags & EVENT_BASE_FLAG_LEADER_FOLLOWER) {
+		retval = event_base_loop_lf(base, flags);
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+		return (retval);
+	}
+#endif
+
 	if (base->running_loop) {
 		event_warn("%s: reentrant invocation.  Only one event_base_loop"
 		    " can run on each event_base at once.", __func__);
@@ -1508,17 +2103,40 @@ event_base_loop(struct event_base *base, int flags)
 			break;
 		}
 
+		EVBASE_DRAIN_REMOTE(base);
+
+		EVENT_TRACE(base, EVENT_TRACE_LOOP, -1,
+		    N_ACTIVE_CALLBACKS(base), 0);
+
 		timeout_correct(base, &tv);
 
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+		/* If we have nothing of our own to run, help out another base
+		 * in our group before we think about blocking. */
+		if (base->group && !N_ACTIVE_CALLBACKS(base))
+			stole = event_base_group_steal(base);
+		else
+			stole = 0;
+#endif
+
 		tv_p = &tv;
-		if (!N_ACTIVE_CALLBACKS(base) && !(flags & EVLOOP_NONBLOCK)) {
+		if (!N_ACTIVE_CALLBACKS(base) && !stole &&
+		    !(flags & EVLOOP_NONBLOCK)) {
 			timeout_next(base, &tv_p);
+			spinning = base->busy_poll_nsec &&
+			    (!tv_p || evutil_timerisset(tv_p)) &&
+			    busy_poll_should_spin(base, &idle_since);
+			if (spinning) {
+				tv_p = &tv;
+				evutil_timerclear(&tv);
+			}
 		} else {
 			/*
 			 * if we have active events, we just poll new events
 			 * without waiting.
 			 */
 			evutil_timerclear(&tv);
+			spinning = 0;
 		}
 
 		/* If we have no events, we just exit */
@@ -1533,8 +2151,40 @@ event_base_loop(struct event_base *base, int flags)
 
 		clear_time_cache(base);
 
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+		if (base->group && (!tv_p || evutil_timerisset(tv_p)))
+			event_base_group_set_idle(base, 1);
+#endif
+
+		/* Some backends overwrite *tv_p; decide now. */
+		blocking = !tv_p || evutil_timerisset(tv_p);
+
+		if (base->stats)
+			started = stats_now();
+		if (base->trace)
+			wait_began = _event_trace_now();
+
 		res = evsel->dispatch(base, tv_p);
 
+		if (wait_began) {
+			EVENT_TRACE(base, EVENT_TRACE_DISPATCH, -1,
+			    wait_began, N_ACTIVE_CALLBACKS(base));
+			wait_began = 0;
+		}
+
+		if (base->stats) {
+			ev_uint64_t waited = stats_now() - started;
+			base->stats->n_dispatches++;
+			base->stats->dispatch_nsec += waited;
+			if (waited > base->stats->dispatch_max_nsec)
+				base->stats->dispatch_max_nsec = waited;
+		}
+
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+		if (base->group)
+			event_base_group_set_idle(base, 0);
+#endif
+
 		if (res == -1) {
 			event_debug(("%s: dispatch returned unsuccessfully.",
 				__func__));
@@ -1546,6 +2196,17 @@ event_base_loop(struct event_base *base, int flags)
 
 		timeout_process(base);
 
+		if (base->busy_poll_nsec) {
+			if (spinning) {
+				if (N_ACTIVE_CALLBACKS(base))
+					++base->busy_poll_hits;
+			} else if (blocking) {
+				++base->busy_poll_blocks;
+			}
+			if (!spinning || N_ACTIVE_CALLBACKS(base))
+				idle_since = 0;
+		}
+
 		if (N_ACTIVE_CALLBACKS(base)) {
 			event_process_active(base);
 			if (!base->event_count_active && (flags & EVLOOP_ONCE))
@@ -1564,13 +2225,628 @@ done:
 	return (retval);
 }
 
-/* Sets up an event for processing once */
-struct event_once {
-	struct event ev;
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+/* Return true iff some thread is running the callback of 'ev', or of
+ * another event on the same fd, on the leader/follower base 'base'.
+ * Requires the lock on 'base'. */
+static int
+event_lf_is_running(struct event_base *base, struct event *ev)
+{
+	struct event_lf_running *r;
+	int is_io = (ev->ev_events & (EV_READ|EV_WRITE)) != 0;
 
-	void (*cb)(evutil_socket_t, short, void *);
-	void *arg;
-};
+	TAILQ_FOREACH(r, &base->lf_running, next) {
+		if (r->ev == ev || (is_io && r->fd == ev->ev_fd))
+			return 1;
+	}
+	return 0;
+}
+
+/* Return true iff some thread is running a callback for an event on 'fd'
+ * on the leader/follower base 'base'.  Requires the lock on 'base'. */
+static int
+event_lf_fd_is_busy(struct event_base *base, evutil_socket_t fd)
+{
+	struct event_lf_running *r;
+
+	TAILQ_FOREACH(r, &base->lf_running, next) {
+		if (r->fd == fd)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+  Run the callback of the first active event on the leader/follower base
+  'base' that no other thread is busy with, in priority order.  Called with
+  the lock on 'base' held; releases it while the callback runs.  Returns 1
+  if we ran a callback, 0 if there was none we could run.
+ */
+static int
+event_lf_run_one(struct event_base *base)
+{
+	struct event_lf_running me;
+	struct event *ev = NULL;
+	ev_uint64_t trace_begin = 0, trace_cb = 0, started = 0;
+	struct event_slow_callback rec;
+	int i, timed;
+
+	for (i = 0; i < base->nactivequeues && !ev; ++i) {
+		struct event *e;
+		TAILQ_FOREACH(e, &base->activequeues[i], ev_active_next) {
+			if (!event_lf_is_running(base, e)) {
+				ev = e;
+				break;
+			}
+		}
+	}
+	if (!ev)
+		return 0;
+
+	/* Take it off the active queue before we delete it, so that the
+	 * delete doesn't rearm the fd under us. */
+	event_queue_remove(base, ev, EVLIST_ACTIVE);
+	if (!(ev->ev_events & EV_PERSIST))
+		event_del_internal(ev);
+
+	/* The callback may free 'ev'; 'me' remembers its fd for us. */
+	me.ev = ev;
+	me.fd = (ev->ev_events & (EV_READ|EV_WRITE)) ? ev->ev_fd : -1;
+	me.thread = EVTHREAD_GET_ID();
+	TAILQ_INSERT_TAIL(&base->lf_running, &me, next);
+
+	event_debug(("%s: thread %lu running event %p", __func__,
+		me.thread, ev));
+
+	timed = base->stats || base->slow_callbacks;
+	if (timed) {
+		rec.callback = ev->ev_callback;
+		rec.arg = ev->ev_arg;
+		rec.fd = ev->ev_fd;
+		rec.events = ev->ev_res;
+		rec.priority = ev->ev_pri;
+		started = stats_now();
+	}
+	if (base->trace) {
+		trace_cb = EVENT_TRACE_CB(ev);
+		trace_begin = _event_trace_record(base,
+		    EVENT_TRACE_CALLBACK_BEGIN, ev->ev_fd, trace_cb,
+		    ev->ev_res);
+	}
+
+	switch (ev->ev_closure) {
+	case EV_CLOSURE_SIGNAL:
+		event_signal_closure(base, ev);
+		break;
+	case EV_CLOSURE_PERSIST:
+		event_persist_closure(base, ev);
+		break;
+	default:
+	case EV_CLOSURE_NONE:
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+		(*ev->ev_callback)((int)ev->ev_fd, ev->ev_res, ev->ev_arg);
+		break;
+	}
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	TAILQ_REMOVE(&base->lf_running, &me, next);
+	if (timed) {
+		rec.duration_nsec = stats_now() - started;
+		event_base_note_callback(base, &rec);
+		if (base->stats)
+			base->stats->active_nsec[STATS_PRI(rec.priority)] +=
+			    rec.duration_nsec;
+	}
+	if (trace_begin)
+		EVENT_TRACE(base, EVENT_TRACE_CALLBACK_END, me.fd, trace_begin,
+		    trace_cb);
+	if (base->current_event_waiters) {
+		base->current_event_waiters = 0;
+		EVTHREAD_COND_BROADCAST(base->current_event_cond);
+	}
+	/* Let the backend report the fd again once nobody is using it. */
+	if (me.fd >= 0 && !event_lf_fd_is_busy(base, me.fd))
+		evmap_io_rearm(base, me.fd);
+	/* Events that had to wait for us can run now, and we may have added
+	 * or removed the last event, so let the others look again. */
+	if (base->lf_n_threads > 1)
+		EVTHREAD_COND_BROADCAST(base->lf_leader_cond);
+	return 1;
+}
+
+/*
+  The loop of a base with EVENT_BASE_FLAG_LEADER_FOLLOWER.  Every thread
+  that calls event_base_loop() runs this.  A thread runs whatever callback
+  it can; when there are none, it becomes the leader and waits in the
+  backend, unless another thread already does, in which case it waits for
+  that leader to come back with new events.  Called and returns with the
+  lock on 'base' held.
+ */
+static int
+event_base_loop_lf(struct event_base *base, int flags)
+{
+	const struct eventop *evsel = base->evsel;
+	struct timeval tv;
+	struct timeval *tv_p;
+	int res, c, retval = 0, ran = 0, polled = 0;
+	ev_uint64_t wait_began = 0, started = 0;
+
+	if (base->lf_n_threads++ == 0) {
+		base->running_loop = 1;
+		base->event_gotterm = base->event_break = 0;
+		clear_time_cache(base);
+		if (base->sig.ev_signal_added && base->sig.ev_n_signals_added)
+			evsig_set_base(base);
+	}
+
+	for (;;) {
+		/* Terminate the loop if we have been asked to */
+		if (base->event_gotterm || base->event_break)
+			break;
+
+		EVBASE_DRAIN_REMOTE(base);
+
+		EVENT_TRACE(base, EVENT_TRACE_LOOP, -1,
+		    N_ACTIVE_CALLBACKS(base), 0);
+
+		if (event_lf_run_one(base)) {
+			ran = 1;
+			continue;
+		}
+
+		/* Deferred callbacks assume they run one at a time. */
+		if (base->defer_queue.active_count &&
+		    !base->lf_deferred_running) {
+			base->lf_deferred_running = 1;
+			if (base->stats)
+				started = stats_now();
+			c = event_process_deferred_callbacks(&base->defer_queue,
+			    &base->event_break);
+			if (base->stats) {
+				base->stats->deferred_nsec +=
+				    stats_now() - started;
+				if (c > 0)
+					base->stats->n_deferred += c;
+			}
+			if (c > 0)
+				ran = 1;
+			base->lf_deferred_running = 0;
+			continue;
+		}
+
+		if (ran && (flags & EVLOOP_ONCE))
+			break;
+		if (polled && (flags & EVLOOP_NONBLOCK))
+			break;
+
+		/* If we have no events, we just exit, unless a callback
+		 * running in another thread might still add some. */
+		if (!event_haveevents(base) && !N_ACTIVE_CALLBACKS(base)) {
+			if (TAILQ_EMPTY(&base->lf_running)) {
+				event_debug(("%s: no events registered.",
+					__func__));
+				retval = 1;
+				break;
+			}
+			EVTHREAD_COND_WAIT(base->lf_leader_cond,
+			    base->th_base_lock);
+			continue;
+		}
+
+		if (base->lf_leader_polling) {
+			if (flags & EVLOOP_NONBLOCK)
+				break;
+			EVTHREAD_COND_WAIT(base->lf_leader_cond,
+			    base->th_base_lock);
+			continue;
+		}
+
+		/* We are the leader.  Anything still active is waiting on a
+		 * callback that another thread will finish and then run, so
+		 * we need not poll for it. */
+		timeout_correct(base, &tv);
+		tv_p = &tv;
+		if (flags & EVLOOP_NONBLOCK)
+			evutil_timerclear(&tv);
+		else
+			timeout_next(base, &tv_p);
+
+		base->lf_leader_polling = 1;
+		base->th_owner_id = EVTHREAD_GET_ID();
+
+		/* update last old time */
+		gettime(base, &base->event_tv);
+		clear_time_cache(base);
+
+		if (base->stats)
+			started = stats_now();
+		if (base->trace)
+			wait_began = _event_trace_now();
+
+		res = evsel->dispatch(base, tv_p);
+
+		if (wait_began) {
+			EVENT_TRACE(base, EVENT_TRACE_DISPATCH, -1,
+			    wait_began, N_ACTIVE_CALLBACKS(base));
+			wait_began = 0;
+		}
+
+		if (base->stats) {
+			ev_uint64_t waited = stats_now() - started;
+			base->stats->n_dispatches++;
+			base->stats->dispatch_nsec += waited;
+			if (waited > base->stats->dispatch_max_nsec)
+				base->stats->dispatch_max_nsec = waited;
+		}
+		base->lf_leader_polling = 0;
+		polled = 1;
+		EVTHREAD_COND_BROADCAST(base->lf_leader_cond);
+
+		if (res == -1) {
+			event_debug(("%s: dispatch returned unsuccessfully.",
+				__func__));
+			retval = -1;
+			break;
+		}
+
+		update_time_cache(base);
+
+		timeout_process(base);
+	}
+
+	if (--base->lf_n_threads == 0) {
+		clear_time_cache(base);
+		base->running_loop = 0;
+	}
+	EVTHREAD_COND_BROADCAST(base->lf_leader_cond);
+
+	return (retval);
+}
+
+/* Return the base whose thread is running the callback of 'ev' on behalf
+ * of ev's own base 'base', or NULL if there is none.  Requires the lock on
+ * 'base'. */
+static struct event_base *
+event_stolen_by(struct event_base *base, struct event *ev)
+{
+	struct event_base_group *group = base->group;
+	int i;
+
+	for (i = 0; i < group->n_bases; ++i) {
+		if (group->bases[i]->stolen_event == ev)
+			return group->bases[i];
+	}
+	return NULL;
+}
+
+/* Return true iff the callback of 'ev', which is active on 'base', may be
+ * run by another thread of the group.  Requires the lock on 'base'. */
+static int
+event_is_stealable(struct event_base *base, struct event *ev)
+{
+	if (ev->ev_flags & EVLIST_INTERNAL)
+		return 0;
+	if (ev->ev_events & (EV_SIGNAL|EV_PINNED))
+		return 0;
+	/* A persistent event can be active again while its callback is
+	 * still running; never run it twice at once. */
+	if (ev == base->current_event || event_stolen_by(base, ev))
+		return 0;
+	return 1;
+}
+
+/*
+  Try to take one active callback from the busiest other base in our group,
+  and run it in this thread.  We look at the end of the victim's queue,
+  since its own thread will get to those callbacks last.  Called from the
+  loop with the lock on 'base' held; releases it while we work, and
+  returns with it held again.  Returns 1 if we ran a callback, 0 if not.
+ */
+static int
+event_base_group_steal(struct event_base *base)
+{
+	struct event_base_group *group = base->group;
+	struct event_base *victim = NULL;
+	struct event *ev = NULL;
+	struct event_slow_callback rec;
+	ev_uint64_t started = 0, trace_begin = 0, trace_cb = 0;
+	evutil_socket_t trace_fd = -1;
+	int i, timed, most = 0;
+
+	/* This read is unlocked: it is only a hint. */
+	for (i = 0; i < group->n_bases; ++i) {
+		struct event_base *b = group->bases[i];
+		if (b != base && b->event_count_active > most) {
+			most = b->event_count_active;
+			victim = b;
+		}
+	}
+	if (!victim)
+		return 0;
+
+	/* Never hold two base locks at once. */
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	EVBASE_ACQUIRE_LOCK(victim, th_base_lock);
+
+	for (i = 0; i < victim->nactivequeues && !ev; ++i) {
+		struct event *e;
+		for (e = TAILQ_LAST(&victim->activequeues[i], event_list); e;
+		     e = TAILQ_PREV(e, event_list, ev_active_next)) {
+			if (event_is_stealable(victim, e)) {
+				ev = e;
+				break;
+			}
+		}
+	}
+	if (!ev) {
+		EVBASE_RELEASE_LOCK(victim, th_base_lock);
+		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+		return 0;
+	}
+
+	if (ev->ev_events & EV_PERSIST)
+		event_queue_remove(victim, ev, EVLIST_ACTIVE);
+	else
+		event_del_internal(ev);
+	base->stolen_event = ev;
+
+	event_debug(("%s: base %p running event %p of base %p", __func__,
+		base, ev, victim));
+
+	/* The callback counts as one of the victim's, whichever thread
+	 * runs it.  It may free 'ev', so take down what we need now. */
+	timed = victim->stats || victim->slow_callbacks;
+	if (timed) {
+		rec.callback = ev->ev_callback;
+		rec.arg = ev->ev_arg;
+		rec.fd = ev->ev_fd;
+		rec.events = ev->ev_res;
+		rec.priority = ev->ev_pri;
+		started = stats_now();
+	}
+	if (victim->trace) {
+		trace_fd = ev->ev_fd;
+		trace_cb = EVENT_TRACE_CB(ev);
+		trace_begin = _event_trace_record(victim,
+		    EVENT_TRACE_CALLBACK_BEGIN, trace_fd, trace_cb, ev->ev_res);
+	}
+
+	switch (ev->ev_closure) {
+	case EV_CLOSURE_PERSIST:
+		event_persist_closure(victim, ev);
+		break;
+	default:
+	case EV_CLOSURE_NONE:
+		EVBASE_RELEASE_LOCK(victim, th_base_lock);
+		(*ev->ev_callback)((int)ev->ev_fd, ev->ev_res, ev->ev_arg);
+		break;
+	}
+
+	EVBASE_ACQUIRE_LOCK(victim, th_base_lock);
+	base->stolen_event = NULL;
+	if (timed) {
+		rec.duration_nsec = stats_now() - started;
+		event_base_note_callback(victim, &rec);
+		if (victim->stats)
+			victim->stats->active_nsec[STATS_PRI(rec.priority)] +=
+			    rec.duration_nsec;
+	}
+	if (trace_begin)
+		EVENT_TRACE(victim, EVENT_TRACE_CALLBACK_END, trace_fd,
+		    trace_begin, trace_cb);
+	if (victim->stolen_event_waiters) {
+		victim->stolen_event_waiters = 0;
+		EVTHREAD_COND_BROADCAST(victim->stolen_event_cond);
+	}
+	EVBASE_RELEASE_LOCK(victim, th_base_lock);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	return 1;
+}
+
+/* Note whether the loop of 'base' is about to block, or has just stopped
+ * blocking. */
+static void
+event_base_group_set_idle(struct event_base *base, int idle)
+{
+	struct event_base_group *group = base->group;
+
+	EVLOCK_LOCK(group->lock, 0);
+	if (base->group_idle != idle) {
+		base->group_idle = idle;
+		group->n_idle += idle ? 1 : -1;
+	}
+	EVLOCK_UNLOCK(group->lock, 0);
+}
+
+/* Wake up one idle base in the group of 'base', so that it can come and
+ * take some of our active callbacks.  Requires the lock on 'base'. */
+static void
+event_base_group_wake_idle(struct event_base *base)
+{
+	struct event_base_group *group = base->group;
+	struct event_base *idle = NULL;
+	int i;
+
+	EVLOCK_LOCK(group->lock, 0);
+	for (i = 0; i < group->n_bases; ++i) {
+		if (group->bases[i]->group_idle) {
+			idle = group->bases[i];
+			idle->group_idle = 0;
+			--group->n_idle;
+			break;
+		}
+	}
+	EVLOCK_UNLOCK(group->lock, 0);
+
+	/* We can't take the idle base's lock while we hold our own, so we
+	 * call its notify function directly.  At worst, that wakes it up
+	 * once more than it needed. */
+	if (idle)
+		idle->th_notify_fn(idle);
+}
+#endif
+
+struct event_base_group *
+event_base_group_new(int n_bases, const struct event_config *cfg)
+{
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+	struct event_base_group *group;
+	int i;
+
+	if (n_bases < 1)
+		return NULL;
+
+	if ((group = mm_calloc(1, sizeof(struct event_base_group))) == NULL)
+		return NULL;
+	group->bases = mm_calloc(n_bases, sizeof(struct event_base *));
+	if (group->bases == NULL) {
+		mm_free(group);
+		return NULL;
+	}
+
+	EVTHREAD_ALLOC_LOCK(group->lock, 0);
+	if (group->lock == NULL) {
+		event_warnx("%s: locking is not enabled", __func__);
+		goto err;
+	}
+
+	for (i = 0; i < n_bases; ++i) {
+		struct event_base *base = event_base_new_with_config(cfg);
+		if (base == NULL)
+			goto err;
+		group->bases[group->n_bases++] = base;
+		if (base->th_base_lock == NULL || base->th_notify_fn == NULL) {
+			event_warnx("%s: event_base is not threadsafe",
+			    __func__);
+			goto err;
+		}
+		EVTHREAD_ALLOC_COND(base->stolen_event_cond);
+		if (base->stolen_event_cond == NULL)
+			goto err;
+		base->group = group;
+	}
+
+	return group;
+err:
+	event_base_group_free(group);
+	return NULL;
+#else
+	event_warnx("%s: built without thread support", __func__);
+	return NULL;
+#endif
+}
+
+void
+event_base_group_free(struct event_base_group *group)
+{
+	int i;
+
+	for (i = 0; i < group->n_bases; ++i)
+		event_base_free(group->bases[i]);
+	EVTHREAD_FREE_LOCK(group->lock, 0);
+	mm_free(group->bases);
+	mm_free(group);
+}
+
+int
+event_base_group_get_n_bases(const struct event_base_group *group)
+{
+	return group->n_bases;
+}
+
+struct event_base *
+event_base_group_get_base(struct event_base_group *group, int idx)
+{
+	if (idx < 0 || idx >= group->n_bases)
+		return NULL;
+	return group->bases[idx];
+}
+
+int
+event_base_group_dispatch(struct event_base_group *group, int idx)
+{
+	struct event_base *base = event_base_group_get_base(group, idx);
+	int r;
+
+	if (base == NULL)
+		return -1;
+
+	/* Keep the loop running even when the base has no events of its
+	 * own: there may be work to take from the rest of the group. */
+	event_base_add_virtual(base);
+	r = event_base_loop(base, 0);
+	event_base_del_virtual(base);
+
+	return r < 0 ? -1 : 0;
+}
+
+int
+event_base_group_loopbreak(struct event_base_group *group)
+{
+	int i, r = 0;
+
+	for (i = 0; i < group->n_bases; ++i) {
+		if (event_base_loopbreak(group->bases[i]) < 0)
+			r = -1;
+	}
+	return r;
+}
+
+/* Return an object of 'size' bytes, from 'fl' if it has one.  Requires
+ * the lock of the base that owns 'fl'. */
+static void *
+event_freelist_get(struct event_freelist *fl,
+    const struct event_mem_functions *mm, size_t size)
+{
+	void *p;
+
+	++fl->n_allocated;
+	if ((p = fl->head) != NULL) {
+		fl->head = *(void **)p;
+		--fl->n_free;
+		++fl->n_reused;
+		return p;
+	}
+	return mm_malloc_with(mm, size);
+}
+
+/* Put 'p', which came from mm_malloc_with(mm), onto 'fl' if there is room;
+ * otherwise free it. */
+static void
+event_freelist_put(struct event_freelist *fl,
+    const struct event_mem_functions *mm, void *p)
+{
+	if (fl->n_free >= fl->max_free) {
+		mm_free_with(mm, p);
+		return;
+	}
+	*(void **)p = fl->head;
+	fl->head = p;
+	++fl->n_free;
+}
+
+static void
+event_freelist_clear(struct event_freelist *fl,
+    const struct event_mem_functions *mm)
+{
+	void *p, *next;
+
+	for (p = fl->head; p; p = next) {
+		next = *(void **)p;
+		mm_free_with(mm, p);
+	}
+	fl->head = NULL;
+	fl->n_free = 0;
+}
+
+/* Sets up an event for processing once */
+struct event_once {
+	struct event ev;
+
+	void (*cb)(evutil_socket_t, short, void *);
+	void *arg;
+};
 
 /* One-time callback to implement event_base_once: invokes the user callback,
  * then deletes the allocated storage */
@@ -1578,10 +2854,17 @@ static void
 event_once_cb(evutil_socket_t fd, short events, void *arg)
 {
 	struct event_once *eonce = arg;
+	struct event_base *base = eonce->ev.ev_base;
 
 	(*eonce->cb)(fd, events, eonce->arg);
 	event_debug_unassign(&eonce->ev);
-	mm_free(eonce);
+	if (base->once_cache.max_free) {
+		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+		event_freelist_put(&base->once_cache, base->mm, eonce);
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+	} else {
+		mm_free_with(base->mm, eonce);
+	}
 }
 
 /* not threadsafe, event scheduled once. */
@@ -1608,8 +2891,22 @@ event_base_once(struct event_base *base, evutil_socket_t fd, short events,
 	if (events & (EV_SIGNAL|EV_PERSIST))
 		return (-1);
 
-	if ((eonce = mm_calloc(1, sizeof(struct event_once))) == NULL)
+	if (!base)
+		base = current_base;
+	if (!base)
+		return (-1);
+
+	if (base->once_cache.max_free) {
+		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+		eonce = event_freelist_get(&base->once_cache, base->mm,
+		    sizeof(struct event_once));
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+	} else {
+		eonce = mm_malloc_with(base->mm, sizeof(struct event_once));
+	}
+	if (eonce == NULL)
 		return (-1);
+	memset(eonce, 0, sizeof(struct event_once));
 
 	eonce->cb = callback;
 	eonce->arg = arg;
@@ -1627,14 +2924,14 @@ event_base_once(struct event_base *base, evutil_socket_t fd, short events,
 		event_assign(&eonce->ev, base, fd, events, event_once_cb, eonce);
 	} else {
 		/* Bad event combination */
-		mm_free(eonce);
+		mm_free_with(base->mm, eonce);
 		return (-1);
 	}
 
 	if (res == 0)
 		res = event_add(&eonce->ev, tv);
 	if (res != 0) {
-		mm_free(eonce);
+		mm_free_with(base->mm, eonce);
 		return (res);
 	}
 
@@ -1659,6 +2956,9 @@ event_assign(struct event *ev, struct event_base *base, evutil_socket_t fd, shor
 	ev->ev_flags = EVLIST_INIT;
 	ev->ev_ncalls = 0;
 	ev->ev_pncalls = NULL;
+	ev->ev_slack = 0;
+	ev->ev_remote_queued = 0;
+	ev->ev_remote_res = 0;
 
 	if (events & EV_SIGNAL) {
 		if ((events & (EV_READ|EV_WRITE)) != 0) {
@@ -1716,11 +3016,22 @@ struct event *
 event_new(struct event_base *base, evutil_socket_t fd, short events, void (*cb)(evutil_socket_t, short, void *), void *arg)
 {
 	struct event *ev;
-	ev = mm_malloc(sizeof(struct event));
+
+	if (!base)
+		base = current_base;
+	if (base && base->event_cache.max_free) {
+		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+		ev = event_freelist_get(&base->event_cache, base->mm,
+		    sizeof(struct event));
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+	} else {
+		ev = mm_malloc_with(_event_base_get_mm(base),
+		    sizeof(struct event));
+	}
 	if (ev == NULL)
 		return (NULL);
 	if (event_assign(ev, base, fd, events, cb, arg) < 0) {
-		mm_free(ev);
+		mm_free_with(_event_base_get_mm(base), ev);
 		return (NULL);
 	}
 
@@ -1730,13 +3041,20 @@ event_new(struct event_base *base, evutil_socket_t fd, short events, void (*cb)(
 void
 event_free(struct event *ev)
 {
+	struct event_base *base = ev->ev_base;
+
 	_event_debug_assert_is_setup(ev);
 
 	/* make sure that this event won't be coming back to haunt us. */
 	event_del(ev);
 	_event_debug_note_teardown(ev);
-	mm_free(ev);
-
+	if (base && base->event_cache.max_free) {
+		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+		event_freelist_put(&base->event_cache, base->mm, ev);
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+	} else {
+		mm_free_with(_event_base_get_mm(base), ev);
+	}
 }
 
 void
@@ -1886,6 +3204,44 @@ event_add(struct event *ev, const struct timeval *tv)
 
 	EVBASE_ACQUIRE_LOCK(ev->ev_base, th_base_lock);
 
+	if (tv)
+		ev->ev_slack = 0;
+	res = event_add_internal(ev, tv, 0);
+
+	EVBASE_RELEASE_LOCK(ev->ev_base, th_base_lock);
+
+	return (res);
+}
+
+int
+event_add_with_slack(struct event *ev, const struct timeval *tv,
+    const struct timeval *slack)
+{
+	int res;
+
+	if (EVUTIL_FAILURE_CHECK(!ev->ev_base)) {
+		event_warnx("%s: event has no event_base set.", __func__);
+		return -1;
+	}
+	if (slack && (slack->tv_sec < 0 || slack->tv_usec < 0 ||
+		slack->tv_usec >= 1000000)) {
+		event_warnx("%s: invalid slack", __func__);
+		return -1;
+	}
+
+	EVBASE_ACQUIRE_LOCK(ev->ev_base, th_base_lock);
+
+	/* Only change the slack along with the timeout: the heap position
+	 * of a pending timeout depends on it. */
+	if (tv) {
+		if (!slack)
+			ev->ev_slack = 0;
+		else if (slack->tv_sec >= (long)(EV_UINT32_MAX / 1000000))
+			ev->ev_slack = EV_UINT32_MAX;
+		else
+			ev->ev_slack = (ev_uint32_t)slack->tv_sec * 1000000 +
+			    slack->tv_usec;
+	}
 	res = event_add_internal(ev, tv, 0);
 
 	EVBASE_RELEASE_LOCK(ev->ev_base, th_base_lock);
@@ -1972,7 +3328,8 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 	 * prepare for timeout insertion further below, if we get a
 	 * failure on any step, we should not change any state.
 	 */
-	if (tv != NULL && !(ev->ev_flags & EVLIST_TIMEOUT)) {
+	if (tv != NULL && !(ev->ev_flags & EVLIST_TIMEOUT) &&
+	    !base->timewheel) {
 		if (min_heap_reserve(&base->timeheap,
 			1 + min_heap_size(&base->timeheap)) == -1)
 			return (-1);  /* ENOMEM == errno */
@@ -1983,10 +3340,12 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 	 * until the callback is done before we mess with the event, or else
 	 * we can race on ev_ncalls and ev_pncalls below. */
 #ifndef _EVENT_DISABLE_THREAD_SUPPORT
-	if (base->current_event == ev && (ev->ev_events & EV_SIGNAL)
-	    && !EVBASE_IN_THREAD(base)) {
+	while ((ev->ev_events & EV_SIGNAL) &&
+	    event_running_elsewhere(base, ev)) {
+		int unordered = timeheap_settle(base);
 		++base->current_event_waiters;
 		EVTHREAD_COND_WAIT(base->current_event_cond, base->th_base_lock);
+		base->timeheap_unordered = unordered;
 	}
 #endif
 
@@ -2013,6 +3372,15 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 		struct timeval now;
 		int common_timeout;
 
+		/*
+		 * if this duration keeps coming up, queue it as a common
+		 * timeout.  (The timer wheel is O(1) already, and slack
+		 * only works on the heap.)
+		 */
+		if (!tv_is_absolute && !base->timewheel && !ev->ev_slack &&
+		    !is_common_timeout(tv, base))
+			tv = event_base_promote_timeout(base, tv);
+
 		/*
 		 * for persistent timeout events, we remember the
 		 * timeout value and re-add the event.
@@ -2028,7 +3396,7 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 		 */
 		if (ev->ev_flags & EVLIST_TIMEOUT) {
 			/* XXX I believe this is needless. */
-			if (min_heap_elt_is_top(ev))
+			if (!base->timewheel && min_heap_elt_is_top(ev))
 				notify = 1;
 			event_queue_remove(base, ev, EVLIST_TIMEOUT);
 		}
@@ -2077,6 +3445,12 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 			if (ev == TAILQ_FIRST(&ctl->events)) {
 				common_timeout_schedule(ctl, &now, ev);
 			}
+		} else if (base->timewheel) {
+			/* The wheel can't tell us whether this is the
+			 * earliest timeout, but it can tell us whether it
+			 * expires before the main thread planned to wake. */
+			if (timerwheel_elt_is_early(base->timewheel, ev))
+				notify = 1;
 		} else {
 			/* See if the earliest timeout is now earlier than it
 			 * was before: if so, we will need to tell the main
@@ -2120,7 +3494,7 @@ static inline int
 event_del_internal(struct event *ev)
 {
 	struct event_base *base;
-	int res = 0, notify = 0;
+	int res = 0, notify = 0, was_active = 0;
 
 	event_debug(("event_del: %p (fd %d), callback %p",
 		ev, (int)ev->ev_fd, ev->ev_callback));
@@ -2131,6 +3505,10 @@ event_del_internal(struct event *ev)
 
 	EVENT_BASE_ASSERT_LOCKED(ev->ev_base);
 
+	/* Another thread may have activated this event without the lock;
+	 * apply that before we take the event out of every queue. */
+	EVBASE_DRAIN_REMOTE(ev->ev_base);
+
 	/* If the main thread is currently executing this event's callback,
 	 * and we are not the main thread, then we want to wait until the
 	 * callback is done before we start removing the event.  That way,
@@ -2138,9 +3516,23 @@ event_del_internal(struct event *ev)
 	 * user-supplied argument. */
 	base = ev->ev_base;
 #ifndef _EVENT_DISABLE_THREAD_SUPPORT
-	if (base->current_event == ev && !EVBASE_IN_THREAD(base)) {
+	while (event_running_elsewhere(base, ev)) {
+		int unordered = timeheap_settle(base);
 		++base->current_event_waiters;
 		EVTHREAD_COND_WAIT(base->current_event_cond, base->th_base_lock);
+		base->timeheap_unordered = unordered;
+	}
+	/* Likewise if another base in our group took the callback. */
+	if (base->group) {
+		struct event_base *thief;
+		while ((thief = event_stolen_by(base, ev)) &&
+		    !EVBASE_IN_THREAD(thief)) {
+			int unordered = timeheap_settle(base);
+			++base->stolen_event_waiters;
+			EVTHREAD_COND_WAIT(base->stolen_event_cond,
+			    base->th_base_lock);
+			base->timeheap_unordered = unordered;
+		}
 	}
 #endif
 
@@ -2165,8 +3557,10 @@ event_del_internal(struct event *ev)
 		event_queue_remove(base, ev, EVLIST_TIMEOUT);
 	}
 
-	if (ev->ev_flags & EVLIST_ACTIVE)
+	if (ev->ev_flags & EVLIST_ACTIVE) {
 		event_queue_remove(base, ev, EVLIST_ACTIVE);
+		was_active = 1;
+	}
 
 	if (ev->ev_flags & EVLIST_INSERTED) {
 		event_queue_remove(base, ev, EVLIST_INSERTED);
@@ -2181,6 +3575,15 @@ event_del_internal(struct event *ev)
 		}
 	}
 
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+	/* The callback we just cancelled would have rearmed its fd for any
+	 * other events on it. */
+	if (was_active && (base->flags & EVENT_BASE_FLAG_LEADER_FOLLOWER) &&
+	    (ev->ev_events & (EV_READ|EV_WRITE)) &&
+	    !event_lf_fd_is_busy(base, ev->ev_fd))
+		evmap_io_rearm(base, ev->ev_fd);
+#endif
+
 	/* if we are not in the right thread, we need to wake up the loop */
 	if (res != -1 && notify && EVBASE_NEED_NOTIFY(base))
 		evthread_notify_base(base);
@@ -2190,6 +3593,231 @@ event_del_internal(struct event *ev)
 	return (res);
 }
 
+/* Return true iff a thread other than ours is running the callback of 'ev'
+ * on its base 'base', so that we must wait before we touch it.  Requires
+ * the lock on 'base'. */
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+static int
+event_running_elsewhere(struct event_base *base, struct event *ev)
+{
+	if (base->flags & EVENT_BASE_FLAG_LEADER_FOLLOWER) {
+		struct event_lf_running *r;
+		unsigned long me = EVTHREAD_GET_ID();
+
+		TAILQ_FOREACH(r, &base->lf_running, next) {
+			if (r->ev == ev && r->thread != me)
+				return 1;
+		}
+		return 0;
+	}
+	return base->current_event == ev && !EVBASE_IN_THREAD(base);
+}
+#endif
+
+/* If a batch left the timeout heap out of order, put it back in order, and
+ * return true if it did.  We call this before we let go of the lock in the
+ * middle of a batch, and set timeheap_unordered again to what this returned
+ * once we have the lock back, so that nobody else ever sees the heap
+ * unordered or changes it without keeping it in order. */
+static inline int
+timeheap_settle(struct event_base *base)
+{
+	if (!base->timeheap_unordered)
+		return 0;
+	min_heap_heapify(&base->timeheap);
+	base->timeheap_unordered = 0;
+	return 1;
+}
+
+/* Return true if changing the timeouts of 'n' events is better done by
+ * reordering the whole heap once than by sifting each one into place. */
+static int
+timeheap_batch_is_bulk(struct event_base *base, int n)
+{
+	return !base->timewheel &&
+	    (unsigned)n * 4 >= min_heap_size(&base->timeheap);
+}
+
+/* Check that every event in 'evs' is set up for the same base, and return
+ * that base, or NULL if they are not. */
+static struct event_base *
+event_batch_get_base(struct event **evs, int n_evs, const char *fn)
+{
+	struct event_base *base = evs[0]->ev_base;
+	int i;
+
+	for (i = 0; i < n_evs; ++i) {
+		if (EVUTIL_FAILURE_CHECK(!evs[i]->ev_base)) {
+			event_warnx("%s: event has no event_base set.", fn);
+			return NULL;
+		}
+		if (EVUTIL_FAILURE_CHECK(evs[i]->ev_base != base)) {
+			event_warnx("%s: events are on different bases.", fn);
+			return NULL;
+		}
+	}
+	return base;
+}
+
+int
+event_add_batch(struct event **evs, int n_evs, const struct timeval *tv)
+{
+	struct event_base *base;
+	struct event *old_top = NULL;
+	int i, bulk = 0, res = 0;
+
+	if (n_evs <= 0)
+		return (0);
+	if (!(base = event_batch_get_base(evs, n_evs, __func__)))
+		return (-1);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+
+	if (tv && !base->timewheel) {
+		/* Make room for every timeout at once. */
+		if (min_heap_reserve(&base->timeheap,
+			min_heap_size(&base->timeheap) + n_evs) == -1) {
+			EVBASE_RELEASE_LOCK(base, th_base_lock);
+			return (-1);
+		}
+		if (timeheap_batch_is_bulk(base, n_evs)) {
+			old_top = min_heap_top(&base->timeheap);
+			base->timeheap_unordered = bulk = 1;
+		}
+	}
+
+	for (i = 0; i < n_evs; ++i) {
+		if (tv)
+			evs[i]->ev_slack = 0;
+		if (event_add_internal(evs[i], tv, 0) == -1)
+			res = -1;
+	}
+
+	if (bulk) {
+		min_heap_heapify(&base->timeheap);
+		base->timeheap_unordered = 0;
+		/* We could not tell which timeout was first as we added them,
+		 * so check once now whether the loop needs to wake earlier. */
+		if (min_heap_top(&base->timeheap) != old_top &&
+		    EVBASE_NEED_NOTIFY(base))
+			evthread_notify_base(base);
+	}
+
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	return (res);
+}
+
+int
+event_del_batch(struct event **evs, int n_evs)
+{
+	struct event_base *base;
+	int i, bulk, res = 0;
+
+	if (n_evs <= 0)
+		return (0);
+	if (!(base = event_batch_get_base(evs, n_evs, __func__)))
+		return (-1);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+
+	/* As in event_del_internal, a deleted timeout never needs to wake
+	 * the loop, so there is nothing to check after the heap is fixed. */
+	bulk = timeheap_batch_is_bulk(base, n_evs);
+	if (bulk)
+		base->timeheap_unordered = 1;
+
+	for (i = 0; i < n_evs; ++i) {
+		if (event_del_internal(evs[i]) == -1)
+			res = -1;
+	}
+
+	if (bulk) {
+		min_heap_heapify(&base->timeheap);
+		base->timeheap_unordered = 0;
+	}
+
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	return (res);
+}
+
+#ifdef USE_REMOTE_QUEUES
+/* Wake up the loop of 'base' from another thread, without its lock, unless
+ * a wakeup is already on its way. */
+static void
+evthread_notify_base_remote(struct event_base *base)
+{
+	if (EVUTIL_ATOMIC_CAS_INT(&base->is_notify_pending, 0, 1) == 0)
+		base->th_notify_fn(base);
+}
+
+/* Give an activation of 'ev' to its base's loop without taking the base
+ * lock.  If 'ev' is already waiting for the loop, just add 'res' to the
+ * results it will be activated with, as event_active_nolock() does for an
+ * event that is already active. */
+static void
+event_active_remote(struct event *ev, int res)
+{
+	struct event_base *base = ev->ev_base;
+	int old;
+
+	/* Add our results before we check whether ev is queued: if the loop
+	 * takes it off the list after that, it will see them. */
+	do {
+		old = ev->ev_remote_res;
+	} while (EVUTIL_ATOMIC_CAS_INT(&ev->ev_remote_res, old, old | res)
+	    != old);
+	if (EVUTIL_ATOMIC_CAS_INT(&ev->ev_remote_queued, 0, 1) != 0)
+		return;
+
+	/* Only the first push after the loop drains the list needs to wake
+	 * the loop up. */
+	if (ev_mpsc_push(&base->remote_active, &ev->ev_remote_node))
+		evthread_notify_base_remote(base);
+}
+
+static void
+event_base_drain_remote(struct event_base *base)
+{
+	struct ev_mpsc_node *node, *next;
+
+	EVENT_BASE_ASSERT_LOCKED(base);
+
+	node = ev_mpsc_take_all(&base->remote_active);
+	for ( ; node; node = next) {
+		struct event *ev = EVUTIL_UPCAST(node, struct event,
+		    ev_remote_node);
+		int res;
+		next = node->next;
+		/* As soon as this is clear, another thread may push ev
+		 * again; we must be done with its node by then.  Anything it
+		 * adds to ev_remote_res before that, we take below. */
+		EVUTIL_ATOMIC_CAS_INT(&ev->ev_remote_queued, 1, 0);
+		do {
+			res = ev->ev_remote_res;
+		} while (EVUTIL_ATOMIC_CAS_INT(&ev->ev_remote_res, res, 0)
+		    != res);
+		/* If another thread added its results after we cleared
+		 * ev_remote_queued, the last time we took ev off the list,
+		 * we took them then and there is nothing left now. */
+		if (res)
+			event_active_nolock(ev, res, 1);
+	}
+
+	node = ev_mpsc_take_all(&base->remote_deferred);
+	for ( ; node; node = next) {
+		struct deferred_cb *cb =
+		    EVUTIL_UPCAST(node, struct deferred_cb, remote_node);
+		next = node->next;
+		/* As soon as this is clear, another thread may push cb
+		 * again; we must be done with its node by then. */
+		EVUTIL_ATOMIC_CAS_INT(&cb->remote_queued, 1, 0);
+		deferred_cb_schedule_nolock(&base->defer_queue, cb);
+	}
+}
+#endif
+
 void
 event_active(struct event *ev, int res, short ncalls)
 {
@@ -2198,6 +3826,18 @@ event_active(struct event *ev, int res, short ncalls)
 		return;
 	}
 
+#ifdef USE_REMOTE_QUEUES
+	/* From outside the loop thread, hand the activation to the loop
+	 * rather than fighting it for the lock.  Signal events need the
+	 * lock to coordinate with their running callback. */
+	if (!(ev->ev_events & EV_SIGNAL) && ev->ev_base->th_notify_fn &&
+	    EVBASE_NEED_NOTIFY(ev->ev_base)) {
+		_event_debug_assert_is_setup(ev);
+		event_active_remote(ev, res);
+		return;
+	}
+#endif
+
 	EVBASE_ACQUIRE_LOCK(ev->ev_base, th_base_lock);
 
 	_event_debug_assert_is_setup(ev);
@@ -2231,9 +3871,11 @@ event_active_nolock(struct event *ev, int res, short ncalls)
 
 	if (ev->ev_events & EV_SIGNAL) {
 #ifndef _EVENT_DISABLE_THREAD_SUPPORT
-		if (base->current_event == ev && !EVBASE_IN_THREAD(base)) {
+		while (event_running_elsewhere(base, ev)) {
+			int unordered = timeheap_settle(base);
 			++base->current_event_waiters;
 			EVTHREAD_COND_WAIT(base->current_event_cond, base->th_base_lock);
+			base->timeheap_unordered = unordered;
 		}
 #endif
 		ev->ev_ncalls = ncalls;
@@ -2263,6 +3905,14 @@ event_deferred_cb_cancel(struct deferred_cb_queue *queue,
 	}
 
 	LOCK_DEFERRED_QUEUE(queue);
+#ifdef USE_REMOTE_QUEUES
+	/* If another thread has just scheduled cb, wait until it is on the
+	 * queue proper, so that we can take it off again. */
+	if (queue->notify_fn == notify_base_cbq_callback) {
+		while (cb->remote_queued)
+			event_base_drain_remote(queue->notify_arg);
+	}
+#endif
 	if (cb->queued) {
 		TAILQ_REMOVE(&queue->deferred_cb_list, cb, cb_next);
 		--queue->active_count;
@@ -2282,7 +3932,31 @@ event_deferred_cb_schedule(struct deferred_cb_queue *queue,
 			return;
 	}
 
+#ifdef USE_REMOTE_QUEUES
+	/* From outside the loop thread, hand cb to the loop without taking
+	 * the queue lock. */
+	if (queue->notify_fn == notify_base_cbq_callback) {
+		struct event_base *base = queue->notify_arg;
+		if (base->th_notify_fn && EVBASE_NEED_NOTIFY(base)) {
+			if (EVUTIL_ATOMIC_CAS_INT(&cb->remote_queued, 0, 1) == 0 &&
+			    ev_mpsc_push(&base->remote_deferred, &cb->remote_node))
+				evthread_notify_base_remote(base);
+			return;
+		}
+	}
+#endif
+
 	LOCK_DEFERRED_QUEUE(queue);
+	deferred_cb_schedule_nolock(queue, cb);
+	UNLOCK_DEFERRED_QUEUE(queue);
+}
+
+/* Helper: schedule cb on queue, if it isn't there already.  Requires the
+ * lock on queue. */
+static void
+deferred_cb_schedule_nolock(struct deferred_cb_queue *queue,
+    struct deferred_cb *cb)
+{
 	if (!cb->queued) {
 		cb->queued = 1;
 		TAILQ_INSERT_TAIL(&queue->deferred_cb_list, cb, cb_next);
@@ -2290,21 +3964,38 @@ event_deferred_cb_schedule(struct deferred_cb_queue *queue,
 		if (queue->notify_fn)
 			queue->notify_fn(queue, queue->notify_arg);
 	}
-	UNLOCK_DEFERRED_QUEUE(queue);
 }
 
 static int
 timeout_next(struct event_base *base, struct timeval **tv_p)
 {
 	/* Caller must hold th_base_lock */
-	struct timeval now;
+	struct timeval now, wheel_next, latest;
+	const struct timeval *next;
 	struct event *ev;
 	struct timeval *tv = *tv_p;
 	int res = 0;
 
-	ev = min_heap_top(&base->timeheap);
+	if (base->timewheel) {
+		if (timerwheel_next_timeout(base->timewheel, &wheel_next) < 0)
+			next = NULL;
+		else
+			next = &wheel_next;
+	} else {
+		/* The heap is ordered by the latest time each timeout may
+		 * run, so we sleep until the top one must run; every timeout
+		 * whose window has opened by then runs along with it. */
+		ev = min_heap_top(&base->timeheap);
+		next = ev ? &ev->ev_timeout : NULL;
+		if (ev && ev->ev_slack) {
+			latest.tv_sec = ev->ev_slack / 1000000;
+			latest.tv_usec = ev->ev_slack % 1000000;
+			evutil_timeradd(&ev->ev_timeout, &latest, &latest);
+			next = &latest;
+		}
+	}
 
-	if (ev == NULL) {
+	if (next == NULL) {
 		/* if no time-based events are active wait for I/O */
 		*tv_p = NULL;
 		goto out;
@@ -2315,12 +4006,12 @@ timeout_next(struct event_base *base, struct timeval **tv_p)
 		goto out;
 	}
 
-	if (evutil_timercmp(&ev->ev_timeout, &now, <=)) {
+	if (evutil_timercmp(next, &now, <=)) {
 		evutil_timerclear(tv);
 		goto out;
 	}
 
-	evutil_timersub(&ev->ev_timeout, &now, tv);
+	evutil_timersub(next, &now, tv);
 
 	EVUTIL_ASSERT(tv->tv_sec >= 0);
 	EVUTIL_ASSERT(tv->tv_usec >= 0);
@@ -2340,8 +4031,6 @@ static void
 timeout_correct(struct event_base *base, struct timeval *tv)
 {
 	/* Caller must hold th_base_lock. */
-	struct event **pev;
-	unsigned int size;
 	struct timeval off;
 	int i;
 
@@ -2360,16 +4049,9 @@ timeout_correct(struct event_base *base, struct timeval *tv)
 		    __func__));
 	evutil_timersub(&base->event_tv, tv, &off);
 
-	/*
-	 * We can modify the key element of the node without destroying
-	 * the minheap property, because we change every element.
-	 */
-	pev = base->timeheap.p;
-	size = base->timeheap.n;
-	for (; size-- > 0; ++pev) {
-		struct timeval *ev_tv = &(**pev).ev_timeout;
-		evutil_timersub(ev_tv, &off, ev_tv);
-	}
+	min_heap_adjust_all(&base->timeheap, &off);
+	if (base->timewheel)
+		timerwheel_adjust(base->timewheel, &off, tv);
 	for (i=0; i<base->n_common_timeouts; ++i) {
 		struct event *ev;
 		struct common_timeout_list *ctl =
@@ -2396,12 +4078,32 @@ timeout_process(struct event_base *base)
 	struct timeval now;
 	struct event *ev;
 
+	if (base->timewheel) {
+		if (!timerwheel_size(base->timewheel))
+			return;
+		gettime(base, &now);
+		timerwheel_advance(base->timewheel, &now);
+		while ((ev = timerwheel_first_expired(base->timewheel))) {
+			event_del_internal(ev);
+
+			event_debug(("timeout_process: call %p",
+				 ev->ev_callback));
+			EVENT_TRACE(base, EVENT_TRACE_TIMER, ev->ev_fd,
+			    EVENT_TRACE_CB(ev), 0);
+			event_active_nolock(ev, EV_TIMEOUT, 1);
+		}
+		return;
+	}
+
 	if (min_heap_empty(&base->timeheap)) {
 		return;
 	}
 
 	gettime(base, &now);
 
+	/* Stop at the first timeout that may not run yet.  With slack, a
+	 * timeout further down the heap may already be due; it will run
+	 * no later than its own window allows, with the next batch. */
 	while ((ev = min_heap_top(&base->timeheap))) {
 		if (evutil_timercmp(&ev->ev_timeout, &now, >))
 			break;
@@ -2411,6 +4113,8 @@ timeout_process(struct event_base *base)
 
 		event_debug(("timeout_process: call %p",
 			 ev->ev_callback));
+		EVENT_TRACE(base, EVENT_TRACE_TIMER, ev->ev_fd,
+		    EVENT_TRACE_CB(ev), 0);
 		event_active_nolock(ev, EV_TIMEOUT, 1);
 	}
 }
@@ -2446,6 +4150,10 @@ event_queue_remove(struct event_base *base, struct event *ev, int queue)
 			    get_common_timeout_list(base, &ev->ev_timeout);
 			TAILQ_REMOVE(&ctl->events, ev,
 			    ev_timeout_pos.ev_next_with_common_timeout);
+		} else if (base->timewheel) {
+			timerwheel_erase(base->timewheel, ev);
+		} else if (base->timeheap_unordered) {
+			min_heap_erase_unordered(&base->timeheap, ev);
 		} else {
 			min_heap_erase(&base->timeheap, ev);
 		}
@@ -2519,7 +4227,11 @@ event_queue_insert(struct event_base *base, struct event *ev, int queue)
 			struct common_timeout_list *ctl =
 			    get_common_timeout_list(base, &ev->ev_timeout);
 			insert_common_timeout_inorder(ctl, ev);
-		} else
+		} else if (base->timewheel)
+			timerwheel_push(base->timewheel, ev);
+		else if (base->timeheap_unordered)
+			min_heap_push_unordered(&base->timeheap, ev);
+		else
 			min_heap_push(&base->timeheap, ev);
 		break;
 	}
@@ -2624,8 +4336,56 @@ event_set_mem_functions(void *(*malloc_fn)(size_t sz),
 	_mm_realloc_fn = realloc_fn;
 	_mm_free_fn = free_fn;
 }
+
+void *
+event_mm_malloc_with_(const struct event_mem_functions *mm, size_t sz)
+{
+	if (mm)
+		return mm->malloc_fn(sz, mm->arg);
+	else
+		return event_mm_malloc_(sz);
+}
+
+void *
+event_mm_calloc_with_(const struct event_mem_functions *mm,
+    size_t count, size_t size)
+{
+	if (mm) {
+		size_t sz = count * size;
+		void *p = mm->malloc_fn(sz, mm->arg);
+		if (p)
+			memset(p, 0, sz);
+		return p;
+	} else
+		return event_mm_calloc_(count, size);
+}
+
+void *
+event_mm_realloc_with_(const struct event_mem_functions *mm, void *ptr,
+    size_t sz)
+{
+	if (mm)
+		return mm->realloc_fn(ptr, sz, mm->arg);
+	else
+		return event_mm_realloc_(ptr, sz);
+}
+
+void
+event_mm_free_with_(const struct event_mem_functions *mm, void *ptr)
+{
+	if (mm)
+		mm->free_fn(ptr, mm->arg);
+	else
+		event_mm_free_(ptr);
+}
 #endif
 
+const struct event_mem_functions *
+_event_base_get_mm(struct event_base *base)
+{
+	return base ? base->mm : NULL;
+}
+
 #if defined(_EVENT_HAVE_EVENTFD) && defined(_EVENT_HAVE_SYS_EVENTFD_H)
 static void
 evthread_notify_drain_eventfd(evutil_socket_t fd, short what, void *arg)
@@ -2761,6 +4521,149 @@ event_base_dump_events(struct event_base *base, FILE *output)
 	}
 }
 
+int
+event_base_set_slow_callback_threshold(struct event_base *base,
+    const struct timeval *threshold, int max_records)
+{
+	struct event_slow_callback_log *log = NULL;
+
+	if (threshold) {
+		if (max_records <= 0 || threshold->tv_sec < 0 ||
+		    threshold->tv_usec < 0)
+			return -1;
+		log = mm_calloc(1, sizeof(struct event_slow_callback_log) +
+		    (max_records - 1) * sizeof(struct event_slow_callback));
+		if (!log) {
+			event_warn("%s: calloc", __func__);
+			return -1;
+		}
+		log->threshold_nsec = (ev_uint64_t)threshold->tv_sec *
+		    1000000000 + (ev_uint64_t)threshold->tv_usec * 1000;
+		log->size = max_records;
+	}
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->slow_callbacks)
+		mm_free(base->slow_callbacks);
+	base->slow_callbacks = log;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	return 0;
+}
+
+/* Helper: copy up to 'max_records' of the newest records in 'log' into
+ * 'records', oldest first, and return how many we copied. */
+static int
+slow_callback_log_copy(const struct event_slow_callback_log *log,
+    struct event_slow_callback *records, int max_records)
+{
+	ev_uint64_t first;
+	int n, i;
+
+	n = log->n_recorded < (ev_uint64_t)log->size ?
+	    (int)log->n_recorded : log->size;
+	if (n > max_records)
+		n = max_records;
+	first = log->n_recorded - n;
+	for (i = 0; i < n; ++i)
+		records[i] = log->records[(first + i) % log->size];
+	return n;
+}
+
+int
+event_base_get_slow_callbacks(struct event_base *base,
+    struct event_slow_callback *records, int max_records)
+{
+	int n = 0;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->slow_callbacks && max_records > 0)
+		n = slow_callback_log_copy(base->slow_callbacks, records,
+		    max_records);
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return n;
+}
+
+void
+event_base_dump_slow_callbacks(struct event_base *base, FILE *output)
+{
+	struct event_slow_callback_log *log;
+	struct event_slow_callback *records = NULL;
+	ev_uint64_t n_recorded = 0, threshold = 0;
+	int i, n = 0;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	log = base->slow_callbacks;
+	if (log) {
+		records = mm_calloc(log->size, sizeof(*records));
+		if (records)
+			n = slow_callback_log_copy(log, records, log->size);
+		n_recorded = log->n_recorded;
+		threshold = log->threshold_nsec;
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	if (!log) {
+		fprintf(output, "Not recording slow callbacks.\n");
+		return;
+	}
+	fprintf(output, "Slow callbacks (%lu usec or more): %lu recorded, "
+	    "last %d:\n", (unsigned long)(threshold / 1000),
+	    (unsigned long)n_recorded, n);
+	for (i = 0; i < n; ++i) {
+		struct event_slow_callback *r = &records[i];
+		fprintf(output, "  %lu usec: callback %p(arg %p) [fd %ld]"
+		    "%s%s%s%s priority %d\n",
+		    (unsigned long)(r->duration_nsec / 1000),
+		    (void*)r->callback, r->arg, (long)r->fd,
+		    (r->events&EV_READ)?" Read":"",
+		    (r->events&EV_WRITE)?" Write":"",
+		    (r->events&EV_SIGNAL)?" Signal":"",
+		    (r->events&EV_TIMEOUT)?" Timeout":"",
+		    r->priority);
+	}
+	if (records)
+		mm_free(records);
+}
+
+int
+event_base_get_object_cache_stats(struct event_base *base,
+    struct event_object_cache_stats *stats)
+{
+	int r = -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->event_cache.max_free) {
+		stats->events_allocated = base->event_cache.n_allocated;
+		stats->events_reused = base->event_cache.n_reused;
+		stats->events_cached = base->event_cache.n_free;
+		stats->once_allocated = base->once_cache.n_allocated;
+		stats->once_reused = base->once_cache.n_reused;
+		stats->once_cached = base->once_cache.n_free;
+		r = 0;
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
+int
+event_base_get_busy_poll_counts(struct event_base *base,
+    ev_uint64_t *spin_hits, ev_uint64_t *blocking_waits)
+{
+	int r = -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->busy_poll_nsec) {
+		if (spin_hits)
+			*spin_hits = base->busy_poll_hits;
+		if (blocking_waits)
+			*blocking_waits = base->busy_poll_blocks;
+		r = 0;
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
 void
 event_base_add_virtual(struct event_base *base)
 {
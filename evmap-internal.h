@@ -49,6 +49,16 @@ void evmap_signal_initmap(struct event_signal_map* ctx);
 void evmap_io_clear(struct event_io_map* ctx);
 void evmap_signal_clear(struct event_signal_map* ctx);
 
+/** Make room in an event_base's io map for at least 'nfds' file
+    descriptors, so that adding events for them later does not need to
+    grow it.
+
+    @param base the event_base to operate on.
+    @param nfds the number of fds to make room for.
+    @return 0 on success, -1 on failure.
+ */
+int evmap_io_reserve(struct event_base *base, int nfds);
+
 /** Add an IO event (some combination of EV_READ or EV_WRITE) to an
     event_base's list of events on a given file descriptor, and tell the
     underlying eventops about the fd if its state has changed.
@@ -77,6 +87,15 @@ int evmap_io_del(struct event_base *base, evutil_socket_t fd, struct event *ev);
 */
 void evmap_io_active(struct event_base *base, evutil_socket_t fd, short events);
 
+/** Make a backend that reports each ready fd only once report 'fd' again,
+    unless one of its events is still waiting for its callback to run.
+    Does nothing if the backend has no rearm function.
+
+    @param base the event_base to operate on.
+    @param fd the file descriptor to rearm.
+ */
+void evmap_io_rearm(struct event_base *base, evutil_socket_t fd);
+
 
 /* These functions behave in the same way as evmap_io_*, except they work on
  * signals rather than fds.  signals use a linear map everywhere; fds use
@@ -68,8 +68,9 @@ struct evmap_signal {
 
 /* On some platforms, fds start at 0 and increment by 1 as they are
    allocated, and old numbers get used.  For these platforms, we
-   implement io maps just like signal maps: as an array of pointers to
-   struct evmap_io.  But on other platforms (windows), sockets are not
+   implement io maps as an array of struct evmap_io, each followed by the
+   backend's fdinfo, indexed by fd.  But on other platforms (windows),
+   sockets are not
    0-indexed, not necessarily consecutive, and not necessarily reused.
    There, we use a hashtable to implement evmap_io.
 */
@@ -172,22 +173,28 @@ void evmap_io_clear(struct event_io_map *ctx)
 		(x) = (struct type *)((map)->entries[slot]);		\
 	} while (0)
 
-/* If we aren't using hashtables, then define the IO_SLOT macros and functions
-   as thin aliases over the SIGNAL_SLOT versions. */
+/* If we aren't using hashtables, then the IO_SLOT macros index straight
+   into the array of entries.  Every entry in the array is constructed when
+   the array grows, so there is nothing for the _AND_CTOR version to do. */
 #ifndef EVMAP_USE_HT
-#define GET_IO_SLOT(x,map,slot,type) GET_SIGNAL_SLOT(x,map,slot,type)
+#define GET_IO_SLOT(x,map,slot,type)					\
+	(x) = (struct type *)((map)->entries + (size_t)(slot) * (map)->entry_size)
 #define GET_IO_SLOT_AND_CTOR(x,map,slot,type,ctor,fdinfo_len)	\
-	GET_SIGNAL_SLOT_AND_CTOR(x,map,slot,type,ctor,fdinfo_len)
+	GET_IO_SLOT(x,map,slot,type)
 #define FDINFO_OFFSET sizeof(struct evmap_io)
 void
 evmap_io_initmap(struct event_io_map* ctx)
 {
-	evmap_signal_initmap(ctx);
+	ctx->entries = NULL;
+	ctx->nentries = 0;
+	ctx->entry_size = 0;
 }
 void
 evmap_io_clear(struct event_io_map* ctx)
 {
-	evmap_signal_clear(ctx);
+	if (ctx->entries != NULL)
+		mm_free(ctx->entries);
+	evmap_io_initmap(ctx);
 }
 #endif
 
@@ -253,6 +260,70 @@ evmap_io_init(struct evmap_io *entry)
 	entry->nwrite = 0;
 }
 
+#ifndef EVMAP_USE_HT
+/** Expand the io map 'map' until it is big enough to store a value in
+	'slot', giving each entry 'fdinfo_len' bytes of backend data.
+ */
+static int
+evmap_io_make_space(struct event_io_map *map, int slot, int fdinfo_len)
+{
+	int nentries, i;
+	char *tmp;
+
+	if (map->nentries > slot)
+		return (0);
+
+	if (!map->entry_size) {
+		/* Keep every entry, and so its list head, aligned. */
+		map->entry_size = (sizeof(struct evmap_io) + fdinfo_len +
+		    sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	}
+	nentries = map->nentries ? map->nentries : 32;
+	while (nentries <= slot)
+		nentries <<= 1;
+
+	tmp = mm_realloc(map->entries, (size_t)nentries * map->entry_size);
+	if (tmp == NULL)
+		return (-1);
+	map->entries = tmp;
+
+	/* The lists may have moved; point the first event on each one, or
+	 * the head of each empty one, back at the head. */
+	for (i = 0; i < map->nentries; ++i) {
+		struct evmap_io *ctx;
+		struct event *first;
+		GET_IO_SLOT(ctx, map, i, evmap_io);
+		if ((first = TAILQ_FIRST(&ctx->events)) != NULL)
+			first->ev_io_next.tqe_prev = &TAILQ_FIRST(&ctx->events);
+		else
+			TAILQ_INIT(&ctx->events);
+	}
+	memset(tmp + (size_t)map->nentries * map->entry_size, 0,
+	    (size_t)(nentries - map->nentries) * map->entry_size);
+	for (i = map->nentries; i < nentries; ++i) {
+		struct evmap_io *ctx;
+		GET_IO_SLOT(ctx, map, i, evmap_io);
+		evmap_io_init(ctx);
+	}
+	map->nentries = nentries;
+
+	return (0);
+}
+#endif
+
+int
+evmap_io_reserve(struct event_base *base, int nfds)
+{
+	if (nfds <= 0)
+		return (0);
+#ifdef EVMAP_USE_HT
+	return event_io_map_HT_GROW(&base->io, (unsigned)nfds);
+#else
+	return evmap_io_make_space(&base->io, nfds - 1,
+	    base->evsel->fdinfo_len);
+#endif
+}
+
 
 /* return -1 on error, 0 on success if nothing changed in the event backend,
  * and 1 on success if something did. */
@@ -273,7 +344,7 @@ evmap_io_add(struct event_base *base, evutil_socket_t fd, struct event *ev)
 
 #ifndef EVMAP_USE_HT
 	if (fd >= io->nentries) {
-		if (evmap_make_space(io, fd, sizeof(struct evmap_io *)) == -1)
+		if (evmap_io_make_space(io, fd, evsel->fdinfo_len) == -1)
 			return (-1);
 	}
 #endif
@@ -389,6 +460,7 @@ evmap_io_active(struct event_base *base, evutil_socket_t fd, short events)
 	struct event_io_map *io = &base->io;
 	struct evmap_io *ctx;
 	struct event *ev;
+	int activated = 0;
 
 #ifndef EVMAP_USE_HT
 	EVUTIL_ASSERT(fd < io->nentries);
@@ -396,10 +468,47 @@ evmap_io_active(struct event_base *base, evutil_socket_t fd, short events)
 	GET_IO_SLOT(ctx, io, fd, evmap_io);
 
 	EVUTIL_ASSERT(ctx);
+	EVENT_TRACE(base, EVENT_TRACE_FD_ACTIVE, fd, events, 0);
 	TAILQ_FOREACH(ev, &ctx->events, ev_io_next) {
-		if (ev->ev_events & events)
+		if (ev->ev_events & events) {
 			event_active_nolock(ev, ev->ev_events & events, 1);
+			activated = 1;
+		}
 	}
+	/* A backend that reports each fd once will not report this one
+	 * again until it is rearmed; if no callback is going to run to do
+	 * that, do it now. */
+	if (!activated && (base->flags & EVENT_BASE_FLAG_LEADER_FOLLOWER))
+		evmap_io_rearm(base, fd);
+}
+
+void
+evmap_io_rearm(struct event_base *base, evutil_socket_t fd)
+{
+	struct event_io_map *io = &base->io;
+	struct evmap_io *ctx;
+	struct event *ev;
+	short events = 0;
+
+	if (!base->evsel->rearm || fd < 0)
+		return;
+#ifndef EVMAP_USE_HT
+	if (fd >= io->nentries)
+		return;
+#endif
+	GET_IO_SLOT(ctx, io, fd, evmap_io);
+	if (!ctx)
+		return;
+
+	TAILQ_FOREACH(ev, &ctx->events, ev_io_next) {
+		/* Its callback will rearm the fd once it has run. */
+		if (ev->ev_flags & EVLIST_ACTIVE)
+			return;
+		events |= ev->ev_events & (EV_READ|EV_WRITE|EV_ET);
+	}
+	if (events & (EV_READ|EV_WRITE))
+		base->evsel->rearm(base, fd, events,
+		    ((char*)ctx) + sizeof(struct evmap_io));
 }
 
 /* code specific to signals */
@@ -477,6 +586,10 @@ void *
 evmap_io_get_fdinfo(struct event_io_map *map, evutil_socket_t fd)
 {
 	struct evmap_io *ctx;
+#ifndef EVMAP_USE_HT
+	if (fd < 0 || fd >= map->nentries)
+		return NULL;
+#endif
 	GET_IO_SLOT(ctx, map, fd, evmap_io);
 	if (ctx)
 		return ((char*)ctx) + sizeof(struct evmap_io);
@@ -500,6 +613,13 @@ event_changelist_init(struct event_changelist *changelist)
 	changelist->n_changes = 0;
 }
 
+int
+event_changelist_fd_is_pending(void *p)
+{
+	struct event_changelist_fdinfo *fdinfo = p;
+	return fdinfo->idxplus1 != 0;
+}
+
 /** Helper: return the changelist_fdinfo corresponding to a given change. */
 static inline struct event_changelist_fdinfo *
 event_change_get_fdinfo(struct event_base *base,
@@ -537,10 +657,9 @@ event_changelist_check(struct event_base *base)
 	}
 
 	for (i = 0; i < base->io.nentries; ++i) {
-		struct evmap_io *io = base->io.entries[i];
+		struct evmap_io *io;
 		struct event_changelist_fdinfo *f;
-		if (!io)
-			continue;
+		GET_IO_SLOT(io, &base->io, i, evmap_io);
 		f = (void*)
 		    ( ((char*)io) + sizeof(struct evmap_io) );
 		if (f->idxplus1) {
@@ -126,6 +126,7 @@ const struct eventop evportops = {
 	1, /* need reinit */
 	0, /* features */
 	0, /* fdinfo length */
+	NULL, /* rearm */
 };
 
 /*
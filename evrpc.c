@@ -793,7 +793,8 @@ evrpc_make_request(struct evrpc_request_wrapper *ctx)
 	struct evrpc_pool *pool = ctx->pool;
 
 	/* initialize the event structure for this rpc */
-	evtimer_assign(&ctx->ev_timeout, pool->base, evrpc_request_timeout, ctx);
+	event_assign(&ctx->ev_timeout, pool->base, -1, EV_PINNED,
+	    evrpc_request_timeout, ctx);
 
 	/* we better have some available connections on the pool */
 	EVUTIL_ASSERT(TAILQ_FIRST(&pool->connections) != NULL);
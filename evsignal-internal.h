@@ -27,11 +27,16 @@
 #ifndef _EVSIGNAL_H_
 #define _EVSIGNAL_H_
 
+#include "event2/event-config.h"
 #ifndef evutil_socket_t
 #include "event2/util.h"
 #endif
 #include <signal.h>
 
+#if defined(_EVENT_HAVE_SYS_SIGNALFD_H) && defined(_EVENT_HAVE_SIGNALFD)
+#define EVSIG_USE_SIGNALFD
+#endif
+
 typedef void (*ev_sighandler_t)(int);
 
 /* Data structure for the default signal-handling implementation in signal.c
@@ -55,10 +60,25 @@ struct evsig_info {
 #endif
 	/* Size of sh_old. */
 	int sh_old_max;
+
+#ifdef EVSIG_USE_SIGNALFD
+	/* If we are using signalfd.c rather than a signal handler, the
+	 * signalfd that ev_signal watches.  Otherwise -1. */
+	int ev_signalfd;
+	/* The signals that ev_signalfd reports. */
+	sigset_t ev_signalfd_mask;
+#endif
 };
 int evsig_init(struct event_base *);
 void evsig_dealloc(struct event_base *);
 
+#ifdef EVSIG_USE_SIGNALFD
+/* Set up 'base' to read its signals from a signalfd.  Returns 0 on success,
+ * -1 if signalfd is unavailable. */
+int evsigfd_init(struct event_base *);
+void evsigfd_dealloc(struct event_base *);
+#endif
+
 void evsig_set_base(struct event_base *base);
 
 #endif /* _EVSIGNAL_H_ */
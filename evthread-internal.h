@@ -345,8 +345,24 @@ EVLOCK_TRY_LOCK(void *lock)
 
 int _evthread_is_debug_lock_held(void *lock);
 void *_evthread_debug_get_real_lock(void *lock);
+
+void _evthread_set_lock_class(void *lock, int lock_class);
+/** Tell the lock profiler which EVTHREAD_LOCK_CLASS_* lockvar belongs to.
+ * Does nothing unless lock profiling is enabled. */
+#define EVTHREAD_SET_LOCK_CLASS(lockvar, lock_class)			\
+	_evthread_set_lock_class((lockvar), (lock_class))
+#else
+#define EVTHREAD_SET_LOCK_CLASS(lockvar, lock_class) _EVUTIL_NIL_STMT
 #endif
 
+struct event_thread_pool;
+/* Add 'n' (which may be negative) to the number of workers 'pool' waits
+ * for when it is freed.  Fails if n > 0 and the pool is shutting down. */
+int _event_thread_pool_add_workers(struct event_thread_pool *pool, int n);
+/* Run jobs from 'pool' until it is freed, as a worker that has already
+ * been counted with _event_thread_pool_add_workers(). */
+void _event_thread_pool_work(struct event_thread_pool *pool);
+
 #ifdef __cplusplus
 }
 #endif
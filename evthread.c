@@ -30,8 +30,14 @@
 
 #include <event2/thread.h>
 
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <sys/queue.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "log-internal.h"
 #include "mm-internal.h"
@@ -46,6 +52,7 @@
 
 /* globals */
 GLOBAL int _evthread_lock_debugging_enabled = 0;
+static int _evthread_lock_profiling_enabled = 0;
 GLOBAL struct evthread_lock_callbacks _evthread_lock_fns = {
 	0, 0, NULL, NULL, NULL, NULL
 };
@@ -62,6 +69,17 @@ static struct evthread_condition_callbacks _original_cond_fns = {
 	0, NULL, NULL, NULL, NULL
 };
 
+/* Used for profiling: the callbacks that the profiling wrappers call.
+ * These are always the real ones, beneath any debugging wrappers. */
+static struct evthread_lock_callbacks _prof_original_lock_fns = {
+	0, 0, NULL, NULL, NULL, NULL
+};
+static struct evthread_condition_callbacks _prof_original_cond_fns = {
+	0, NULL, NULL, NULL, NULL
+};
+
+static int prof_cond_wait(void *_cond, void *_lock, const struct timeval *tv);
+
 void
 evthread_set_id_callback(unsigned long (*id_fn)(void))
 {
@@ -72,8 +90,9 @@ int
 evthread_set_lock_callbacks(const struct evthread_lock_callbacks *cbs)
 {
 	struct evthread_lock_callbacks *target =
-	    _evthread_lock_debugging_enabled
-	    ? &_original_lock_fns : &_evthread_lock_fns;
+	    _evthread_lock_profiling_enabled ? &_prof_original_lock_fns :
+	    _evthread_lock_debugging_enabled ? &_original_lock_fns :
+	    &_evthread_lock_fns;
 
 	if (!cbs) {
 		memset(target, 0, sizeof(_evthread_lock_fns));
@@ -91,8 +110,9 @@ int
 evthread_set_condition_callbacks(const struct evthread_condition_callbacks *cbs)
 {
 	struct evthread_condition_callbacks *target =
-	    _evthread_lock_debugging_enabled
-	    ? &_original_cond_fns : &_evthread_cond_fns;
+	    _evthread_lock_profiling_enabled ? &_prof_original_cond_fns :
+	    _evthread_lock_debugging_enabled ? &_original_cond_fns :
+	    &_evthread_cond_fns;
 
 	if (!cbs) {
 		memset(target, 0, sizeof(_evthread_cond_fns));
@@ -100,6 +120,17 @@ evthread_set_condition_callbacks(const struct evthread_condition_callbacks *cbs)
 	    cbs->signal_condition && cbs->wait_condition) {
 		memcpy(target, cbs, sizeof(_evthread_cond_fns));
 	}
+	if (_evthread_lock_profiling_enabled &&
+	    _evthread_lock_debugging_enabled) {
+		memcpy(&_original_cond_fns, target, sizeof(_evthread_cond_fns));
+		if (target->wait_condition)
+			_original_cond_fns.wait_condition = prof_cond_wait;
+	} else if (_evthread_lock_profiling_enabled) {
+		memcpy(&_evthread_cond_fns, target, sizeof(_evthread_cond_fns));
+		if (target->wait_condition)
+			_evthread_cond_fns.wait_condition = prof_cond_wait;
+		return 0;
+	}
 	if (_evthread_lock_debugging_enabled) {
 		_evthread_cond_fns.alloc_condition = cbs->alloc_condition;
 		_evthread_cond_fns.free_condition = cbs->free_condition;
@@ -269,6 +300,258 @@ _evthread_debug_get_real_lock(void *lock_)
 	return lock->lock;
 }
 
+struct prof_lock {
+	TAILQ_ENTRY(prof_lock) next;
+	unsigned locktype;
+	int lock_class;
+	/* How many times the lock is held, by whoever holds it.  This and the
+	 * fields below are only changed while holding the lock.  XXXX if we
+	 * ever use read-write locks, readers will race on them. */
+	int count;
+	/* When the outermost acquisition happened. */
+	ev_uint64_t acquired_at;
+	struct evthread_lock_stats stats;
+	void *lock;
+};
+
+TAILQ_HEAD(prof_lockq, prof_lock);
+
+/* Every lock allocated since profiling was enabled, and what the freed
+ * ones counted, by class.  Guarded by prof_registry_lock, which is a real
+ * lock so that taking it is not itself profiled. */
+static struct prof_lockq prof_locks = TAILQ_HEAD_INITIALIZER(prof_locks);
+static struct evthread_lock_stats prof_retired[EVTHREAD_LOCK_N_CLASSES];
+static void *prof_registry_lock = NULL;
+
+static ev_uint64_t
+prof_now(void)
+{
+	struct timeval tv;
+#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (ev_uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+	evutil_gettimeofday(&tv, NULL);
+	return (ev_uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+static void
+prof_stats_add(struct evthread_lock_stats *to,
+    const struct evthread_lock_stats *from)
+{
+	to->n_acquired += from->n_acquired;
+	to->n_contended += from->n_contended;
+	to->wait_nsec += from->wait_nsec;
+	to->hold_nsec += from->hold_nsec;
+	if (from->max_wait_nsec > to->max_wait_nsec)
+		to->max_wait_nsec = from->max_wait_nsec;
+	if (from->max_hold_nsec > to->max_hold_nsec)
+		to->max_hold_nsec = from->max_hold_nsec;
+}
+
+static void *
+prof_lock_alloc(unsigned locktype)
+{
+	struct prof_lock *result = mm_calloc(1, sizeof(struct prof_lock));
+	if (!result)
+		return NULL;
+	if (!(result->lock = _prof_original_lock_fns.alloc(locktype))) {
+		mm_free(result);
+		return NULL;
+	}
+	result->locktype = locktype;
+	_prof_original_lock_fns.lock(0, prof_registry_lock);
+	TAILQ_INSERT_TAIL(&prof_locks, result, next);
+	_prof_original_lock_fns.unlock(0, prof_registry_lock);
+	return result;
+}
+
+static void
+prof_lock_free(void *lock_, unsigned locktype)
+{
+	struct prof_lock *lock = lock_;
+	_prof_original_lock_fns.lock(0, prof_registry_lock);
+	TAILQ_REMOVE(&prof_locks, lock, next);
+	prof_stats_add(&prof_retired[lock->lock_class], &lock->stats);
+	_prof_original_lock_fns.unlock(0, prof_registry_lock);
+	_prof_original_lock_fns.free(lock->lock, locktype);
+	mm_free(lock);
+}
+
+/* Note that 'lock' has just been acquired at 'now', after waiting for
+ * 'waited' nanoseconds if 'contended' is set. */
+static void
+prof_lock_mark_locked(struct prof_lock *lock, ev_uint64_t now,
+    int contended, ev_uint64_t waited)
+{
+	++lock->stats.n_acquired;
+	if (contended) {
+		++lock->stats.n_contended;
+		lock->stats.wait_nsec += waited;
+		if (waited > lock->stats.max_wait_nsec)
+			lock->stats.max_wait_nsec = waited;
+	}
+	if (++lock->count == 1)
+		lock->acquired_at = now;
+}
+
+/* Note that 'lock' is about to be released 'count' times. */
+static void
+prof_lock_mark_unlocked(struct prof_lock *lock, int count)
+{
+	ev_uint64_t held;
+
+	lock->count -= count;
+	if (lock->count)
+		return;
+	held = prof_now() - lock->acquired_at;
+	lock->stats.hold_nsec += held;
+	if (held > lock->stats.max_hold_nsec)
+		lock->stats.max_hold_nsec = held;
+}
+
+static int
+prof_lock_lock(unsigned mode, void *lock_)
+{
+	struct prof_lock *lock = lock_;
+	ev_uint64_t started, now;
+	int res;
+
+	/* Try first, so that we only pay for timing the wait when there
+	 * is one. */
+	if (!(res = _prof_original_lock_fns.lock(mode|EVTHREAD_TRY,
+		    lock->lock))) {
+		prof_lock_mark_locked(lock, prof_now(), 0, 0);
+		return 0;
+	}
+	if (mode & EVTHREAD_TRY)
+		return res;
+
+	started = prof_now();
+	if ((res = _prof_original_lock_fns.lock(mode, lock->lock)))
+		return res;
+	now = prof_now();
+	prof_lock_mark_locked(lock, now, 1, now - started);
+	return 0;
+}
+
+static int
+prof_lock_unlock(unsigned mode, void *lock_)
+{
+	struct prof_lock *lock = lock_;
+	prof_lock_mark_unlocked(lock, 1);
+	return _prof_original_lock_fns.unlock(mode, lock->lock);
+}
+
+static int
+prof_cond_wait(void *_cond, void *_lock, const struct timeval *tv)
+{
+	struct prof_lock *lock = _lock;
+	int r, count = lock->count;
+
+	/* The lock is not held while we wait, so don't count the wait as
+	 * holding it, or the reacquisition as a new acquisition. */
+	prof_lock_mark_unlocked(lock, count);
+	r = _prof_original_cond_fns.wait_condition(_cond, lock->lock, tv);
+	lock->count = count;
+	lock->acquired_at = prof_now();
+	return r;
+}
+
+int
+evthread_enable_lock_profiling(void)
+{
+	struct evthread_lock_callbacks cbs = {
+		EVTHREAD_LOCK_API_VERSION,
+		0,
+		prof_lock_alloc,
+		prof_lock_free,
+		prof_lock_lock,
+		prof_lock_unlock
+	};
+	/* The profiler goes directly on top of the real callbacks, beneath
+	 * the debugging wrappers if those are on. */
+	struct evthread_lock_callbacks *lock_fns =
+	    _evthread_lock_debugging_enabled
+	    ? &_original_lock_fns : &_evthread_lock_fns;
+	struct evthread_condition_callbacks *cond_fns =
+	    _evthread_lock_debugging_enabled
+	    ? &_original_cond_fns : &_evthread_cond_fns;
+
+	if (_evthread_lock_profiling_enabled)
+		return 0;
+	if (!lock_fns->alloc) {
+		event_warnx("%s: No lock callbacks are set", __func__);
+		return -1;
+	}
+	if (!(prof_registry_lock = lock_fns->alloc(0)))
+		return -1;
+
+	cbs.supported_locktypes = lock_fns->supported_locktypes;
+	memcpy(&_prof_original_lock_fns, lock_fns,
+	    sizeof(struct evthread_lock_callbacks));
+	memcpy(lock_fns, &cbs, sizeof(struct evthread_lock_callbacks));
+
+	memcpy(&_prof_original_cond_fns, cond_fns,
+	    sizeof(struct evthread_condition_callbacks));
+	if (cond_fns->wait_condition)
+		cond_fns->wait_condition = prof_cond_wait;
+	_evthread_lock_profiling_enabled = 1;
+	return 0;
+}
+
+void
+_evthread_set_lock_class(void *lock_, int lock_class)
+{
+	struct prof_lock *lock;
+
+	if (!_evthread_lock_profiling_enabled || !lock_)
+		return;
+	EVUTIL_ASSERT(lock_class >= 0 && lock_class < EVTHREAD_LOCK_N_CLASSES);
+	if (_evthread_lock_debugging_enabled)
+		lock_ = _evthread_debug_get_real_lock(lock_);
+	lock = lock_;
+	lock->lock_class = lock_class;
+}
+
+int
+evthread_get_lock_stats(int lock_class, struct evthread_lock_stats *stats)
+{
+	struct prof_lock *lock;
+
+	if (!_evthread_lock_profiling_enabled ||
+	    lock_class < 0 || lock_class >= EVTHREAD_LOCK_N_CLASSES)
+		return -1;
+
+	_prof_original_lock_fns.lock(0, prof_registry_lock);
+	memcpy(stats, &prof_retired[lock_class], sizeof(*stats));
+	TAILQ_FOREACH(lock, &prof_locks, next) {
+		if (lock->lock_class != lock_class)
+			continue;
+		++stats->n_locks;
+		prof_stats_add(stats, &lock->stats);
+	}
+	_prof_original_lock_fns.unlock(0, prof_registry_lock);
+	return 0;
+}
+
+void
+evthread_reset_lock_stats(void)
+{
+	struct prof_lock *lock;
+
+	if (!_evthread_lock_profiling_enabled)
+		return;
+
+	_prof_original_lock_fns.lock(0, prof_registry_lock);
+	memset(prof_retired, 0, sizeof(prof_retired));
+	TAILQ_FOREACH(lock, &prof_locks, next)
+		memset(&lock->stats, 0, sizeof(lock->stats));
+	_prof_original_lock_fns.unlock(0, prof_registry_lock);
+}
+
 #ifndef EVTHREAD_EXPOSE_STRUCTS
 unsigned long
 _evthreadimpl_get_id()
@@ -33,11 +33,44 @@ struct event_base;
 #include <event2/thread.h>
 
 #include <stdlib.h>
+#include <errno.h>
+#ifdef _EVENT_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #include "mm-internal.h"
 #include "evthread-internal.h"
 
 static pthread_mutexattr_t attr_recursive;
 
+/* Tell the CPU that we are busy-waiting, so that it can give the other
+ * hyperthread our resources and not punish us for leaving the loop. */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define EVTHREAD_CPU_RELAX() __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define EVTHREAD_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define EVTHREAD_CPU_RELAX() _EVUTIL_NIL_STMT
+#endif
+
+/* The most pauses between two attempts to take an adaptive lock. */
+#define ADAPTIVE_MAX_BACKOFF 64
+/* The fewest pauses an adaptive lock will spend before it blocks. */
+#define ADAPTIVE_MIN_SPINS 16
+#define ADAPTIVE_DEFAULT_MAX_SPINS 1000
+
+/* The most pauses an adaptive lock will spend before it blocks. */
+static int adaptive_max_spins = ADAPTIVE_DEFAULT_MAX_SPINS;
+
+/* A mutex that spins for a while before it blocks.  The mutex comes
+ * first, so that evthread_posix_cond_wait() can use the lock as a
+ * pthread_mutex_t. */
+struct evthread_adaptive_lock {
+	pthread_mutex_t mutex;
+	/* A running average of how many pauses it took to get the lock when
+	 * it was contended.  Only changed while holding the mutex. */
+	int spins;
+};
+
 static void *
 evthread_posix_lock_alloc(unsigned locktype)
 {
@@ -79,6 +112,72 @@ evthread_posix_unlock(unsigned mode, void *_lock)
 	return pthread_mutex_unlock(lock);
 }
 
+static void *
+evthread_posix_adaptive_lock_alloc(unsigned locktype)
+{
+	pthread_mutexattr_t *attr = NULL;
+	struct evthread_adaptive_lock *lock =
+	    mm_malloc(sizeof(struct evthread_adaptive_lock));
+	if (!lock)
+		return NULL;
+	if (locktype & EVTHREAD_LOCKTYPE_RECURSIVE)
+		attr = &attr_recursive;
+	if (pthread_mutex_init(&lock->mutex, attr)) {
+		mm_free(lock);
+		return NULL;
+	}
+	lock->spins = 0;
+	return lock;
+}
+
+static void
+evthread_posix_adaptive_lock_free(void *_lock, unsigned locktype)
+{
+	struct evthread_adaptive_lock *lock = _lock;
+	pthread_mutex_destroy(&lock->mutex);
+	mm_free(lock);
+}
+
+static int
+evthread_posix_adaptive_lock(unsigned mode, void *_lock)
+{
+	struct evthread_adaptive_lock *lock = _lock;
+	int r, i, limit, spins = 0, delay = 1;
+
+	if ((r = pthread_mutex_trylock(&lock->mutex)) != EBUSY ||
+	    (mode & EVTHREAD_TRY))
+		return r;
+
+	/* Spin for up to twice as long as it has usually taken to get the
+	 * lock, pausing longer each time we fail, and then give up and
+	 * block.  Reading lock->spins without the mutex is fine: it is
+	 * only a hint. */
+	limit = lock->spins * 2 + ADAPTIVE_MIN_SPINS;
+	if (limit > adaptive_max_spins)
+		limit = adaptive_max_spins;
+	while (spins < limit) {
+		for (i = 0; i < delay; ++i)
+			EVTHREAD_CPU_RELAX();
+		spins += delay;
+		if (delay < ADAPTIVE_MAX_BACKOFF)
+			delay <<= 1;
+		if ((r = pthread_mutex_trylock(&lock->mutex)) != EBUSY)
+			break;
+	}
+	if (r == EBUSY)
+		r = pthread_mutex_lock(&lock->mutex);
+	if (r == 0)
+		lock->spins += (spins - lock->spins) / 8;
+	return r;
+}
+
+static int
+evthread_posix_adaptive_unlock(unsigned mode, void *_lock)
+{
+	struct evthread_adaptive_lock *lock = _lock;
+	return pthread_mutex_unlock(&lock->mutex);
+}
+
 static unsigned long
 evthread_posix_get_id(void)
 {
@@ -150,17 +249,9 @@ evthread_posix_cond_wait(void *_cond, void *_lock, const struct timeval *tv)
 	}
 }
 
-int
-evthread_use_pthreads(void)
+static int
+evthread_posix_setup(const struct evthread_lock_callbacks *cbs)
 {
-	struct evthread_lock_callbacks cbs = {
-		EVTHREAD_LOCK_API_VERSION,
-		EVTHREAD_LOCKTYPE_RECURSIVE,
-		evthread_posix_lock_alloc,
-		evthread_posix_lock_free,
-		evthread_posix_lock,
-		evthread_posix_unlock
-	};
 	struct evthread_condition_callbacks cond_cbs = {
 		EVTHREAD_CONDITION_API_VERSION,
 		evthread_posix_cond_alloc,
@@ -174,8 +265,81 @@ evthread_use_pthreads(void)
 	if (pthread_mutexattr_settype(&attr_recursive, PTHREAD_MUTEX_RECURSIVE))
 		return -1;
 
-	evthread_set_lock_callbacks(&cbs);
+	evthread_set_lock_callbacks(cbs);
 	evthread_set_condition_callbacks(&cond_cbs);
 	evthread_set_id_callback(evthread_posix_get_id);
 	return 0;
 }
+
+int
+evthread_use_pthreads(void)
+{
+	struct evthread_lock_callbacks cbs = {
+		EVTHREAD_LOCK_API_VERSION,
+		EVTHREAD_LOCKTYPE_RECURSIVE,
+		evthread_posix_lock_alloc,
+		evthread_posix_lock_free,
+		evthread_posix_lock,
+		evthread_posix_unlock
+	};
+	return evthread_posix_setup(&cbs);
+}
+
+int
+evthread_use_pthreads_adaptive(int max_spins)
+{
+	struct evthread_lock_callbacks cbs = {
+		EVTHREAD_LOCK_API_VERSION,
+		EVTHREAD_LOCKTYPE_RECURSIVE,
+		evthread_posix_adaptive_lock_alloc,
+		evthread_posix_adaptive_lock_free,
+		evthread_posix_adaptive_lock,
+		evthread_posix_adaptive_unlock
+	};
+
+	if (max_spins < 0)
+		return -1;
+	if (max_spins == 0)
+		max_spins = ADAPTIVE_DEFAULT_MAX_SPINS;
+#if defined(_EVENT_HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+	/* Nobody can release the lock while we spin on the only CPU. */
+	if (sysconf(_SC_NPROCESSORS_ONLN) == 1)
+		max_spins = 0;
+#endif
+	adaptive_max_spins = max_spins;
+	return evthread_posix_setup(&cbs);
+}
+
+static void *
+evthread_posix_pool_worker(void *pool)
+{
+	_event_thread_pool_work(pool);
+	return NULL;
+}
+
+int
+event_thread_pool_start_pthreads(struct event_thread_pool *pool,
+    int n_threads)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	int i;
+
+	if (pthread_attr_init(&attr))
+		return -1;
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 0; i < n_threads; ++i) {
+		/* Count the worker before it exists, so that a pool freed
+		 * right away still waits for it. */
+		if (_event_thread_pool_add_workers(pool, 1) < 0)
+			break;
+		if (pthread_create(&thread, &attr, evthread_posix_pool_worker,
+			pool)) {
+			_event_thread_pool_add_workers(pool, -1);
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	return i ? i : -1;
+}
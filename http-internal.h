@@ -98,6 +98,9 @@ struct evhttp_connection {
 
 	struct event_base *base;
 	struct evdns_base *dns_base;
+
+	/* the memory functions this connection was allocated with */
+	const struct event_mem_functions *mm;
 };
 
 /* A callback for an http server */
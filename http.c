@@ -418,9 +418,12 @@ evhttp_is_connection_keepalive(struct evkeyvalq* headers)
 	    && evutil_ascii_strncasecmp(connection, "keep-alive", 10) == 0);
 }
 
-/* Add a correct "Date" header to headers, unless it already has one. */
+/* Add a correct "Date" header to headers, unless it already has one.  We
+ * take the time from 'base', so that we don't ask the kernel for it once
+ * per response. */
 static void
-evhttp_maybe_add_date_header(struct evkeyvalq *headers)
+evhttp_maybe_add_date_header(struct event_base *base,
+    struct evkeyvalq *headers)
 {
 	if (evhttp_find_header(headers, "Date") == NULL) {
 		char date[50];
@@ -428,7 +431,12 @@ evhttp_maybe_add_date_header(struct evkeyvalq *headers)
 		struct tm cur;
 #endif
 		struct tm *cur_p;
-		time_t t = time(NULL);
+		struct timeval tv;
+		time_t t;
+		if (event_base_get_wallclock_cached(base, &tv) == 0)
+			t = tv.tv_sec;
+		else
+			t = time(NULL);
 #ifdef WIN32
 		cur_p = gmtime(&t);
 #else
@@ -473,7 +481,8 @@ evhttp_make_header_response(struct evhttp_connection *evcon,
 	/* XXX shouldn't these check for >= rather than == ? - NM */
 	if (req->major == 1) {
 		if (req->minor == 1)
-			evhttp_maybe_add_date_header(req->output_headers);
+			evhttp_maybe_add_date_header(evcon->base,
+			    req->output_headers);
 
 		/*
 		 * if the protocol is 1.0; and the connection was keep-alive
@@ -1022,7 +1031,7 @@ evhttp_connection_free(struct evhttp_connection *evcon)
 	if (evcon->address != NULL)
 		mm_free(evcon->address);
 
-	mm_free(evcon);
+	mm_free_with(evcon->mm, evcon);
 }
 
 void
@@ -1122,7 +1131,10 @@ static void
 evhttp_connection_cb_cleanup(struct evhttp_connection *evcon)
 {
 	if (evcon->retry_max < 0 || evcon->retry_cnt < evcon->retry_max) {
-		evtimer_assign(&evcon->retry_ev, evcon->base, evhttp_connection_retry, evcon);
+		/* evhttp has no locks, so keep the timer on the thread
+		 * that owns the connection. */
+		event_assign(&evcon->retry_ev, evcon->base, -1, EV_PINNED,
+		    evhttp_connection_retry, evcon);
 		/* XXXX handle failure from evhttp_add_event */
 		evhttp_add_event(&evcon->retry_ev,
 		    MIN(3600, 2 << evcon->retry_cnt),
@@ -1809,11 +1821,14 @@ evhttp_connection_base_new(struct event_base *base, struct evdns_base *dnsbase,
 
 	event_debug(("Attempting connection to %s:%d\n", address, port));
 
-	if ((evcon = mm_calloc(1, sizeof(struct evhttp_connection))) == NULL) {
+	if ((evcon = mm_calloc_with(_event_base_get_mm(base), 1,
+		    sizeof(struct evhttp_connection))) == NULL) {
 		event_warn("%s: calloc failed", __func__);
 		goto error;
 	}
 
+	evcon->mm = _event_base_get_mm(base);
+
 	evcon->fd = -1;
 	evcon->port = port;
 
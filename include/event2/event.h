@@ -191,7 +191,86 @@ enum event_base_config_flag {
 	/** Instead of checking the current time every time the event loop is
 	    ready to run timeout callbacks, check after each timeout callback.
 	 */
-	EVENT_BASE_FLAG_NO_CACHE_TIME = 0x08
+	EVENT_BASE_FLAG_NO_CACHE_TIME = 0x08,
+	/** Store timeouts in a hierarchical timing wheel rather than in a
+	    heap.  This makes adding and deleting a timeout O(1) rather than
+	    O(log n), which pays off for bases with very many pending
+	    timeouts.  The price is that timeouts are rounded up to the
+	    next millisecond.
+	 */
+	EVENT_BASE_FLAG_TIMER_WHEEL = 0x10,
+	/** Linux only: if the base ends up using the io_uring backend, make
+	    bufferevent_socket_new() return bufferevents that post their
+	    reads and writes to the ring and get told when they complete,
+	    rather than waiting for readiness and then calling readv or
+	    writev themselves.
+	 */
+	EVENT_BASE_FLAG_URING_BUFFEREVENTS = 0x20,
+	/** Linux only: if the base ends up using the epoll backend, wait
+	    for timeouts with a timerfd rather than with the millisecond
+	    timeout argument of epoll_wait(), so that timeouts fire at
+	    microsecond rather than millisecond resolution.  This costs one
+	    extra system call per loop iteration.  (The io_uring backend
+	    always waits with microsecond precision.)
+
+	    This flag is also set if the EVENT_PRECISE_TIMER environment
+	    variable is set, unless EVENT_BASE_FLAG_IGNORE_ENV is set.
+	 */
+	EVENT_BASE_FLAG_PRECISE_TIMER = 0x40,
+	/** Linux only: read signals from a signalfd in the backend's fd set,
+	    rather than catching them with a signal handler that writes to a
+	    socketpair.  A single read drains every pending signal, and
+	    each base gets its own signals, so more than one base can watch
+	    signals at a time.
+
+	    Signals are blocked with sigprocmask() while an event is watching
+	    them.  That only blocks them in the thread that added the event:
+	    in a program with several threads, you must block the signals in
+	    the other threads as well, or the kernel may deliver them there
+	    instead.  If signalfd is not available, we fall back to the
+	    signal handler.
+	 */
+	EVENT_BASE_FLAG_SIGNALFD = 0x80,
+	/** Keep statistics about where the event loop spends its time, for
+	    event_base_get_stats().  This costs a couple of clock reads per
+	    callback and per iteration of the loop.
+	 */
+	EVENT_BASE_FLAG_COLLECT_STATS = 0x100,
+	/** Instead of blocking in the backend as soon as there is nothing to
+	    do, keep polling it with a zero timeout for a while first.  This
+	    trades CPU time for latency: events that arrive during the spin
+	    are noticed without a wakeup.  Set the length of the spin with
+	    event_config_set_busy_poll_budget(); see also
+	    event_base_get_busy_poll_counts().
+	 */
+	EVENT_BASE_FLAG_BUSY_POLL = 0x200,
+	/** Let several threads call event_base_loop() on this base at once.
+	    One of them at a time waits for events in the backend, while the
+	    others run callbacks.  Two callbacks for the same event, or for
+	    events on the same fd, never run at the same time: the backend
+	    stops reporting an fd once it is ready, and only starts again
+	    after every callback for that fd has run.
+
+	    Callbacks on different fds do run at the same time, so everything
+	    they share must be protected by locks.  Locking must be enabled,
+	    and only backends that can stop reporting an fd this way (epoll)
+	    are used.  EVENT_BASE_FLAG_BUSY_POLL and the limits from
+	    event_config_set_max_dispatch_interval() are ignored.  Statistics
+	    and the slow-callback log still see every callback, whichever
+	    thread ran it, and every wait of the leader in the backend.
+	 */
+	EVENT_BASE_FLAG_LEADER_FOLLOWER = 0x400,
+	/** Linux only: read the time for timeouts and for
+	    event_base_gettimeofday_cached() from CLOCK_MONOTONIC_COARSE,
+	    which is much cheaper to read than CLOCK_MONOTONIC but only
+	    advances once per kernel tick (typically 1 to 10 msec).  The time
+	    is still read once per loop iteration and cached while callbacks
+	    run.  Since that time can lag the real clock by up to one tick,
+	    both when a timeout is added and when it is checked, timeouts may
+	    fire up to one tick early or late.  Ignored where there is no
+	    such clock.
+	 */
+	EVENT_BASE_FLAG_COARSE_TIME = 0x800
 };
 
 /**
@@ -236,6 +315,112 @@ int event_config_set_flag(struct event_config *cfg, int flag);
  */
 int event_config_set_num_cpus_hint(struct event_config *cfg, int cpus);
 
+/**
+ * Limits how much work event_base_loop does between two polls of the
+ * backend.  Normally the loop runs every active callback of the most
+ * urgent non-empty priority before it checks for new I/O and expired
+ * timers again, so a flood of events at one priority can keep it from
+ * looking at anything else.  With a limit, the loop stops after
+ * 'max_callbacks' callbacks or after 'max_interval' has passed, whichever
+ * comes first, polls the backend without blocking, runs the timeouts that
+ * have expired, and then picks up where it left off.
+ *
+ * @param cfg the event configuration object
+ * @param max_interval the longest to run callbacks before polling again,
+ *    or NULL for no time limit.
+ * @param max_callbacks the most callbacks to run before polling again, or
+ *    0 or less for no limit.
+ * @param min_priority the limits only apply to events with this priority
+ *    or a less urgent one (a higher number); use 0 to limit every event.
+ * @return 0 on success, -1 on failure.
+ */
+int event_config_set_max_dispatch_interval(struct event_config *cfg,
+    const struct timeval *max_interval, int max_callbacks,
+    int min_priority);
+
+#ifndef _EVENT_DISABLE_MM_REPLACEMENT
+/**
+   Memory management functions for one event_base.
+
+   @see event_config_set_mem_functions()
+ */
+struct event_mem_functions {
+	/** Replacements for malloc, realloc and free.  Each is passed 'arg'
+	    as its last argument. */
+	void *(*malloc_fn)(size_t sz, void *arg);
+	void *(*realloc_fn)(void *ptr, size_t sz, void *arg);
+	void (*free_fn)(void *ptr, void *arg);
+	void *arg;
+};
+
+/**
+ * Makes the event_base allocate with 'mm' instead of the functions given to
+ * event_set_mem_functions().  This covers the event_base itself, events
+ * made with event_new() and event_base_once(), bufferevents on the base
+ * along with the data in their evbuffers, evhttp connections, and the
+ * epoll backend's array of ready events, which it grows with realloc_fn.
+ * Other allocations still use the global functions.  This lets each thread give
+ * its event_base an arena of its own.
+ *
+ * The functions are called without any lock held, from whatever thread
+ * creates or frees the object.  'mm' is not copied: it, and the allocator
+ * behind it, must stay usable until every object allocated with it has
+ * been freed.  An event allocated with event_new() must be freed while it
+ * is assigned to a base that uses the same functions.
+ *
+ * @param cfg the event configuration object
+ * @param mm the functions to use, or NULL for the global ones
+ * @return 0 on success, -1 on failure.
+ */
+int event_config_set_mem_functions(struct event_config *cfg,
+    const struct event_mem_functions *mm);
+#endif
+
+/**
+ * Makes the event_base keep up to 'max_cached' freed objects of each kind
+ * it allocates per event (the struct event from event_new(), and the
+ * bookkeeping for event_base_once()) so that it can hand them out again
+ * without going back to the allocator.  The default, 0, caches nothing.
+ *
+ * An event returns to the cache of the base it is assigned to when it is
+ * freed.  Cached objects are released when the base is freed.
+ *
+ * @param cfg the event configuration object
+ * @param max_cached the most freed objects of each kind to keep
+ * @return 0 on success, -1 on failure.
+ * @see event_base_get_object_cache_stats()
+ */
+int event_config_set_object_cache(struct event_config *cfg, int max_cached);
+
+/**
+ * Sets how long an event_base created with EVENT_BASE_FLAG_BUSY_POLL spins
+ * looking for events before it blocks.  The default is 50 microseconds.
+ *
+ * @param cfg the event configuration object
+ * @param budget how long to spin each time the loop runs out of work
+ * @return 0 on success, -1 on failure.
+ */
+int event_config_set_busy_poll_budget(struct event_config *cfg,
+    const struct timeval *budget);
+
+/**
+ * Tells the event_base how big it is going to get, so that it can size its
+ * internal tables once when it is created instead of growing them step by
+ * step as events are added.  Each hint may be 0 to keep the default.
+ *
+ * @param cfg the event configuration object
+ * @param expected_fds how many file descriptors will have events on them;
+ *    the fd table is made big enough for fds 0 through expected_fds-1.
+ * @param expected_timers how many events will have a timeout pending at
+ *    once
+ * @param events_per_wakeup how many ready events the backend should be
+ *    ready to take from the kernel in a single wait.  With epoll and
+ *    kqueue, this may be more than the usual limit of 4096.
+ * @return 0 on success, -1 on failure.
+ */
+int event_config_set_size_hints(struct event_config *cfg, int expected_fds,
+    int expected_timers, int events_per_wakeup);
+
 /**
   Initialize the event API.
 
@@ -377,6 +562,155 @@ int event_base_got_exit(struct event_base *);
  */
 int event_base_got_break(struct event_base *);
 
+struct event_base_group;
+
+/**
+  Create a group of event_bases that share their work.
+
+  Each base in the group is meant to be driven by its own thread, via
+  event_base_group_dispatch().  When one of those threads has nothing to
+  do, it takes active callbacks that another base of the group has not
+  started running yet, and runs them itself.  Events added with EV_PINNED,
+  signal events, and deferred callbacks are never moved.
+
+  Since callbacks can run on any of the group's threads, locking must be
+  enabled (see evthread_use_pthreads()) before calling this function.
+  Bufferevents created without BEV_OPT_THREADSAFE and evconnlisteners
+  created without LEV_OPT_THREADSAFE keep their callbacks on their own
+  base's thread.  So do the events of evhttp and evrpc, which have no
+  locks: each evhttp or evrpc_pool may be used with one base of a group,
+  but not from the group's other threads.
+
+  @param n_bases the number of event_bases to create
+  @param cfg the configuration to use for each event_base, or NULL
+  @return a new event_base_group, or NULL on error
+  @see event_base_group_free()
+ */
+struct event_base_group *event_base_group_new(int n_bases,
+    const struct event_config *cfg);
+
+/**
+  Deallocate an event_base_group and all of its event_bases.
+
+  None of the group's bases may be running when this function is called.
+ */
+void event_base_group_free(struct event_base_group *group);
+
+/** Return the number of event_bases in 'group'. */
+int event_base_group_get_n_bases(const struct event_base_group *group);
+
+/** Return the idx'th event_base in 'group', or NULL if there is none. */
+struct event_base *event_base_group_get_base(struct event_base_group *group,
+    int idx);
+
+/**
+  Run the idx'th event_base of 'group' in the calling thread.
+
+  Unlike event_base_dispatch(), this function does not return when the base
+  has no events of its own, since it may still find work on the other bases
+  of the group.  It returns after event_base_group_loopbreak() is called, or
+  after event_base_loopbreak() or event_base_loopexit() is called on this
+  base.
+
+  @return 0 if successful, or -1 if an error occurred
+ */
+int event_base_group_dispatch(struct event_base_group *group, int idx);
+
+/**
+  Make every running event_base_group_dispatch() call on 'group' return.
+
+  @return 0 if successful, or -1 if an error occurred
+ */
+int event_base_group_loopbreak(struct event_base_group *group);
+
+struct event_thread_pool;
+
+/**
+  Create a pool of worker threads for running blocking work, such as disk
+  I/O or compression, away from the event loop.
+
+  Libevent does not start the threads itself: each thread that should work
+  for the pool calls event_thread_pool_run_worker().  With pthreads,
+  event_thread_pool_start_pthreads() does this for you.
+
+  Locking must be enabled (see evthread_use_pthreads()) before calling this
+  function.
+
+  @param max_queued the most jobs that may wait for a worker at once; more
+    are refused.  Use 0 for no limit.
+  @return a new event_thread_pool, or NULL on error
+  @see event_base_run_in_pool(), event_thread_pool_free()
+ */
+struct event_thread_pool *event_thread_pool_new(int max_queued);
+
+/**
+  Deallocate an event_thread_pool.
+
+  The workers run every job that is already queued, and then return from
+  event_thread_pool_run_worker(); this function waits for all of them to
+  do so.  Jobs left over because the pool had no workers are dropped
+  without calling their completion callbacks.
+ */
+void event_thread_pool_free(struct event_thread_pool *pool);
+
+/**
+  Work for 'pool' in the calling thread, running its jobs one at a time
+  until event_thread_pool_free() is called.
+
+  @return 0 once the pool is shutting down, or -1 if it already was.
+ */
+int event_thread_pool_run_worker(struct event_thread_pool *pool);
+
+/**
+  Run 'work_fn' on one of the threads of 'pool', then run 'done_fn' on the
+  thread that runs the loop of 'base'.
+
+  Both are passed 'arg'.  The completion callback is run like an active
+  event of 'base', so 'base' must be running a loop, must not be freed
+  before the completion has run, and must have been created with locking
+  enabled.
+
+  @param base the event_base to run the completion callback on
+  @param pool the pool to run the work on
+  @param work_fn the blocking work to run
+  @param done_fn the callback to run when the work is done, or NULL
+  @param arg an argument to pass to work_fn and done_fn
+  @return 0 if the job was queued, or -1 if the pool's queue is full, the
+    pool is shutting down, or an error occurred
+  @see event_thread_pool_get_stats()
+ */
+int event_base_run_in_pool(struct event_base *base,
+    struct event_thread_pool *pool, void (*work_fn)(void *),
+    void (*done_fn)(void *), void *arg);
+
+/** How busy an event_thread_pool is, as reported by
+    event_thread_pool_get_stats(). */
+struct event_thread_pool_stats {
+	/** Threads currently working for the pool. */
+	int n_workers;
+	/** Jobs that a worker is running right now. */
+	int n_running;
+	/** Jobs waiting for a worker. */
+	int n_queued;
+	/** The most jobs that have been waiting for a worker at once. */
+	int max_queued_seen;
+	/** Jobs accepted by event_base_run_in_pool(). */
+	ev_uint64_t n_submitted;
+	/** Jobs whose work has finished. */
+	ev_uint64_t n_completed;
+	/** Jobs refused because the queue was full or the pool was
+	    shutting down. */
+	ev_uint64_t n_rejected;
+};
+
+/**
+   Copy the current statistics of 'pool' into 'stats'.
+
+   @return 0 on success, -1 on failure.
+ */
+int event_thread_pool_get_stats(struct event_thread_pool *pool,
+    struct event_thread_pool_stats *stats);
+
 /* Flags to pass to event_set(), event_new(), event_assign(),
  * event_pending(), and anything else with an argument of the form
  * "short events" */
@@ -388,6 +722,9 @@ int event_base_got_break(struct event_base *);
 #define EV_PERSIST	0x10
 /** Select edge-triggered behavior, if supported by the backend. */
 #define EV_ET       0x20
+/** Always run this event's callback in the thread that runs its own
+ * event_base, even if the base is part of an event_base_group. */
+#define EV_PINNED   0x40
 
 /**
   Define a timer event.
@@ -520,6 +857,35 @@ int event_base_once(struct event_base *, evutil_socket_t, short, event_callback_
   */
 int event_add(struct event *, const struct timeval *);
 
+/**
+  Add an event whose timeout does not need to run at an exact time.
+
+  This works like event_add(), except that the timeout may run at any time
+  between 'timeout' and 'timeout' plus 'slack' from now.  The event loop
+  uses that freedom to run all the timeouts whose windows overlap in a
+  single wakeup, rather than waking up once for each of them.  This suits
+  timeouts like keepalives and retransmissions, and can cut down a great
+  deal on wakeups in a large, mostly idle event_base.
+
+  The slack stays with the event, so a persistent event gets it on every
+  timeout, until the event is next added with event_add() (which means no
+  slack) or event_add_with_slack().  Slack is ignored for common timeouts
+  (see event_base_init_common_timeout()) and on bases that use
+  EVENT_BASE_FLAG_TIMER_WHEEL.
+
+  @param ev an event struct initialized via event_set()
+  @param timeout the minimum amount of time to wait for the event, or NULL
+	 to wait forever
+  @param slack how much later than 'timeout' the event may time out, or
+	 NULL for none; values above about 71 minutes are treated as 71
+	 minutes
+  @return 0 if successful, or -1 if an error occurred (including a
+	 negative slack, or one whose tv_usec is a second or more)
+  @see event_add()
+  */
+int event_add_with_slack(struct event *, const struct timeval *,
+    const struct timeval *);
+
 /**
   Remove an event from the set of monitored events.
 
@@ -533,6 +899,41 @@ int event_add(struct event *, const struct timeval *);
  */
 int event_del(struct event *);
 
+/**
+  Add several events at once, all with the same timeout.
+
+  This works like calling event_add() on each event in turn, but takes the
+  event_base lock only once, and when many of the events have timeouts,
+  reorders the timeout queue once at the end instead of once per event.
+  Use it to register thousands of events at a time, for example when many
+  connections come back at once.
+
+  Every event must be assigned to the same event_base.  An event that
+  cannot be added does not stop the others from being added.
+
+  @param evs an array of events to add
+  @param n_evs the number of events in evs
+  @param tv the maximum amount of time to wait for each event, or NULL to
+    wait forever
+  @return 0 if every event was added, or -1 if an error occurred
+  @see event_add(), event_del_batch()
+ */
+int event_add_batch(struct event **evs, int n_evs, const struct timeval *tv);
+
+/**
+  Delete several events at once.
+
+  This works like calling event_del() on each event in turn, but takes the
+  event_base lock only once.  Every event must be assigned to the same
+  event_base.
+
+  @param evs an array of events to delete
+  @param n_evs the number of events in evs
+  @return 0 if every event was deleted, or -1 if an error occurred
+  @see event_del(), event_add_batch()
+ */
+int event_del_batch(struct event **evs, int n_evs);
+
 
 /**
   Make an event active.
@@ -697,6 +1098,11 @@ int	event_priority_set(struct event *, int);
 
    (This optimization probably will not be worthwhile until you have thousands
    or tens of thousands of events with the same timeout.)
+
+   Libevent also notices on its own when the same duration is passed to
+   event_add() over and over, and then treats it as a common timeout, for
+   up to 32 different durations per event_base.  Calling this function is
+   still the only way to be sure a duration gets the optimization.
  */
 const struct timeval *event_base_init_common_timeout(struct event_base *base,
     const struct timeval *duration);
@@ -727,6 +1133,241 @@ void event_set_mem_functions(void *(*malloc_fn)(size_t sz),
 
 void event_base_dump_events(struct event_base *, FILE *);
 
+/** How many priorities struct event_base_stats counts separately.  Events
+    with higher priority numbers are counted with the last one. */
+#define EVENT_STATS_N_PRIORITIES 16
+/** The number of buckets in event_base_stats.callback_hist. */
+#define EVENT_STATS_HISTOGRAM_SIZE 320
+
+/**
+   Statistics about where the event loop of an event_base spends its time,
+   as returned by event_base_get_stats().  All times are in nanoseconds, and
+   all counts are since the base was created.
+ */
+struct event_base_stats {
+	/** How many times the loop has waited for events in the backend. */
+	ev_uint64_t n_dispatches;
+	/** Total time spent waiting for events in the backend. */
+	ev_uint64_t dispatch_nsec;
+	/** The longest single wait for events in the backend. */
+	ev_uint64_t dispatch_max_nsec;
+	/** Time spent running active events, by priority. */
+	ev_uint64_t active_nsec[EVENT_STATS_N_PRIORITIES];
+	/** How many event callbacks have run, by priority. */
+	ev_uint64_t n_callbacks[EVENT_STATS_N_PRIORITIES];
+	/** Time spent running deferred callbacks. */
+	ev_uint64_t deferred_nsec;
+	/** How many deferred callbacks have run. */
+	ev_uint64_t n_deferred;
+	/** A histogram of how long each event callback took.  Buckets 0
+	    through 7 count callbacks that took that many nanoseconds.  Above
+	    that, each power of two is split into 8 equal buckets: bucket
+	    8*(k+1)+j covers durations from (8+j)<<k up to, but not including,
+	    (9+j)<<k.  The last bucket also counts anything longer.
+	    event_base_stats_percentile() reads it for you. */
+	ev_uint64_t callback_hist[EVENT_STATS_HISTOGRAM_SIZE];
+};
+
+/**
+   Copy the statistics that 'base' has collected into 'stats'.
+
+   @return 0 on success, or -1 if 'base' was not created with
+     EVENT_BASE_FLAG_COLLECT_STATS.
+ */
+int event_base_get_stats(struct event_base *base,
+    struct event_base_stats *stats);
+
+/**
+   Return an upper bound, in nanoseconds, on how long the given fraction
+   (between 0.0 and 1.0) of the callbacks counted in 'stats' took to run.
+   For example, event_base_stats_percentile(stats, 0.99) gives the 99th
+   percentile callback duration.  Returns 0 if no callbacks were counted.
+ */
+ev_uint64_t event_base_stats_percentile(const struct event_base_stats *stats,
+    double fraction);
+
+/**
+   A record of a callback that ran for longer than the slow-callback
+   threshold of its event_base.
+
+   @see event_base_set_slow_callback_threshold()
+ */
+struct event_slow_callback {
+	/** The callback of the event, and its argument. */
+	event_callback_fn callback;
+	void *arg;
+	/** The fd or signal number of the event. */
+	evutil_socket_t fd;
+	/** What made the event active: some of EV_READ, EV_WRITE,
+	    EV_SIGNAL and EV_TIMEOUT. */
+	short events;
+	/** The priority of the event. */
+	int priority;
+	/** How long the callback ran, in nanoseconds. */
+	ev_uint64_t duration_nsec;
+};
+
+/**
+   Make 'base' record every event callback that runs for 'threshold' or
+   longer.  The most recent 'max_records' of them are kept, in a ring
+   buffer, for event_base_get_slow_callbacks() and
+   event_base_dump_slow_callbacks().  Calling this again throws away the
+   records kept so far; calling it with a NULL threshold stops recording.
+
+   @return 0 on success, or -1 on failure.
+ */
+int event_base_set_slow_callback_threshold(struct event_base *base,
+    const struct timeval *threshold, int max_records);
+
+/**
+   Copy up to 'max_records' of the most recent slow callbacks recorded by
+   'base' into 'records', oldest first.
+
+   @return the number of records copied.
+ */
+int event_base_get_slow_callbacks(struct event_base *base,
+    struct event_slow_callback *records, int max_records);
+
+/**
+   Write a description of the slow callbacks recorded by 'base' to
+   'output', in the manner of event_base_dump_events().
+ */
+void event_base_dump_slow_callbacks(struct event_base *base, FILE *output);
+
+/** The kinds of record in an event loop trace.
+
+    @see event_base_trace_start()
+ */
+enum event_trace_type {
+	/** The loop started an iteration.  'value' is the number of
+	    callbacks that were already active. */
+	EVENT_TRACE_LOOP = 1,
+	/** The backend returned.  'value' is when it started waiting, and
+	    'extra' is the number of callbacks active afterwards. */
+	EVENT_TRACE_DISPATCH = 2,
+	/** The backend reported 'fd' ready.  'value' is some of EV_READ,
+	    EV_WRITE and EV_ET. */
+	EVENT_TRACE_FD_ACTIVE = 3,
+	/** A callback started.  'fd' is the fd or signal of its event,
+	    'value' is the address of the callback, and 'extra' is what
+	    made the event active. */
+	EVENT_TRACE_CALLBACK_BEGIN = 4,
+	/** A callback returned.  'value' is when it started, and 'extra'
+	    is its address. */
+	EVENT_TRACE_CALLBACK_END = 5,
+	/** A timeout expired.  'fd' is the fd of its event, if any, and
+	    'value' is the address of its callback. */
+	EVENT_TRACE_TIMER = 6,
+	/** The loop ran deferred callbacks.  'value' is when it started,
+	    and 'extra' is how many it ran. */
+	EVENT_TRACE_DEFERRED = 7
+};
+
+/** One record of an event loop trace.  Every record has the same size,
+    so that a trace is an array of them. */
+struct event_trace_record {
+	/** When it happened, in nanoseconds since some fixed point. */
+	ev_uint64_t nsec;
+	/** What it means depends on 'type'. */
+	ev_uint64_t value;
+	ev_uint64_t extra;
+	/** The fd or signal involved, or -1. */
+	ev_int32_t fd;
+	/** One of enum event_trace_type. */
+	ev_uint32_t type;
+};
+
+/** The magic string that starts a trace. */
+#define EVENT_TRACE_MAGIC "EVTRACE1"
+
+/** The header of a trace, in memory or in a file.  It is followed by
+    'n_records' struct event_trace_record, used as a ring: record number i
+    of the trace goes in slot (i % n_records). */
+struct event_trace_header {
+	/** EVENT_TRACE_MAGIC, without its NUL. */
+	char magic[8];
+	/** sizeof(struct event_trace_header) */
+	ev_uint32_t header_size;
+	/** sizeof(struct event_trace_record) */
+	ev_uint32_t record_size;
+	/** The number of records the ring can hold. */
+	ev_uint64_t n_records;
+	/** The number of records written so far; only the last n_records
+	    of them are still in the ring. */
+	ev_uint64_t n_written;
+};
+
+/**
+   Start recording what the loop of 'base' does into a ring of
+   'n_records' fixed-size records; see enum event_trace_type.  Once the
+   ring is full, new records overwrite the oldest ones.
+
+   If 'path' is NULL, the ring is kept in memory, and can be written out
+   with event_base_trace_flush().  Otherwise, the file at 'path' is
+   created or truncated, and the header and ring are mapped from it, so
+   that another process can watch the trace as it is written.  (Not
+   available on all platforms.)
+
+   Calling this while a trace is running throws that trace away.
+
+   @return 0 on success, or -1 on failure.
+   @see event_base_trace_stop(), test/trace-decode.c
+ */
+int event_base_trace_start(struct event_base *base, unsigned n_records,
+    const char *path);
+
+/**
+   Stop the trace of 'base', if there is one, and release its ring.  A
+   trace file stays where it is.
+ */
+void event_base_trace_stop(struct event_base *base);
+
+/**
+   Write the trace of 'base' to the file descriptor 'fd': a header, and
+   the records in the ring, oldest first.  Then empty the ring.
+
+   @return 0 on success, or -1 on failure or if 'base' is not tracing.
+ */
+int event_base_trace_flush(struct event_base *base, int fd);
+
+/**
+   Report how well busy-polling has worked for 'base'.  '*spin_hits' is set
+   to the number of zero-timeout polls that found something to do, and
+   '*blocking_waits' to the number of times the budget ran out and the loop
+   had to block after all.  Either pointer may be NULL.
+
+   @return 0 on success, or -1 if 'base' was not created with
+     EVENT_BASE_FLAG_BUSY_POLL.
+ */
+int event_base_get_busy_poll_counts(struct event_base *base,
+    ev_uint64_t *spin_hits, ev_uint64_t *blocking_waits);
+
+/**
+   How well the object cache of an event_base is working.
+
+   @see event_config_set_object_cache()
+ */
+struct event_object_cache_stats {
+	/** How many struct events event_new() has handed out, and how
+	    many of those came from the cache. */
+	ev_uint64_t events_allocated;
+	ev_uint64_t events_reused;
+	/** How many freed events are in the cache right now. */
+	int events_cached;
+	/** The same, for the objects behind event_base_once(). */
+	ev_uint64_t once_allocated;
+	ev_uint64_t once_reused;
+	int once_cached;
+};
+
+/**
+   Copy the object cache statistics of 'base' into 'stats'.
+
+   @return 0 on success, or -1 if 'base' does not cache objects.
+ */
+int event_base_get_object_cache_stats(struct event_base *base,
+    struct event_object_cache_stats *stats);
+
 /** Sets 'tv' to the current time (as returned by gettimeofday()),
     looking at the cached value in 'base' if possible, and calling
     gettimeofday() or clock_gettime() as appropriate if there is no
@@ -741,6 +1382,21 @@ void event_base_dump_events(struct event_base *, FILE *);
 int event_base_gettimeofday_cached(struct event_base *base,
     struct timeval *tv);
 
+/** Sets 'tv' to the wall clock time (as returned by gettimeofday()) as of
+    the time cached in 'base', for use in Date headers, log lines, and
+    other places that need the calendar time but not great accuracy.
+
+    While callbacks run, this costs no system call at all: the result is
+    worked out from the cached time, and the offset between that and the
+    wall clock, which the base measures at most once a second.  It can
+    therefore lag behind changes to the system clock by up to a second.
+    When there is no cached time, this calls gettimeofday().
+
+    Returns 0 on success, negative on failure.
+ */
+int event_base_get_wallclock_cached(struct event_base *base,
+    struct timeval *tv);
+
 #ifdef __cplusplus
 }
 #endif
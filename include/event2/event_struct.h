@@ -81,6 +81,12 @@ struct name {					\
 }
 #endif
 
+/* A link on a list that other threads push onto without taking a lock.
+ * For Libevent's internal use only. */
+struct ev_mpsc_node {
+	struct ev_mpsc_node *next;
+};
+
 struct event_base;
 struct event {
 	TAILQ_ENTRY(event) ev_active_next;
@@ -120,6 +126,16 @@ struct event {
 	/* allows us to adopt for different types of events */
 	void (*ev_callback)(evutil_socket_t, short, void *arg);
 	void *ev_arg;
+
+	/* how many usec after ev_timeout the timeout may run */
+	ev_uint32_t ev_slack;
+
+	/* for event_active() from outside the loop thread: our link on the
+	 * base's list, whether we are on it, and the results to activate
+	 * with once the loop takes us off it */
+	struct ev_mpsc_node ev_remote_node;
+	volatile int ev_remote_queued;
+	volatile int ev_remote_res;
 };
 
 TAILQ_HEAD (event_list, event);
@@ -58,6 +58,7 @@ extern "C" {
 #endif
 
 #include <event2/event-config.h>
+#include <event2/util.h>
 
 /** A flag passed to a locking callback when the lock was allocated as a
  * read-write lock, and we want to acquire or release the lock for writing. */
@@ -201,6 +202,32 @@ int evthread_use_windows_threads(void);
 int evthread_use_pthreads(void);
 #define EVTHREAD_USE_PTHREADS_IMPLEMENTED 1
 
+/** Like evthread_use_pthreads(), but a thread that finds a lock held
+	spins for a while, pausing a little longer after each attempt,
+	before it sleeps in the kernel.  Each lock keeps a running average
+	of how long threads have spun on it, and lets them spin for about
+	twice that, so locks with short critical sections rarely make a
+	system call.
+
+	Like evthread_use_pthreads(), call this before allocating anything
+	that uses locks.
+
+	@param max_spins the most pauses a thread may spend waiting before
+	  it blocks, or 0 for a sensible default.  On a machine with one
+	  CPU the locks never spin.
+	@return 0 on success, -1 on failure. */
+int evthread_use_pthreads_adaptive(int max_spins);
+
+struct event_thread_pool;
+/** Start 'n_threads' detached pthreads, each running
+	event_thread_pool_run_worker() on 'pool'.  They exit when the pool is
+	freed.  Requires libraries to link against Libevent_pthreads as well
+	as Libevent.
+
+	@return the number of threads started, or -1 if none could be. */
+int event_thread_pool_start_pthreads(struct event_thread_pool *pool,
+    int n_threads);
+
 #endif
 
 /** Enable debugging wrappers around the current lock callbacks.  If Libevent
@@ -208,6 +235,78 @@ int evthread_use_pthreads(void);
  **/
 void evthread_enable_lock_debuging(void);
 
+/** The kinds of lock that the lock profiler keeps separate statistics for.
+
+    @see evthread_enable_lock_profiling(), evthread_get_lock_stats()
+ */
+enum evthread_lock_class {
+	/** Any lock that is not listed below. */
+	EVTHREAD_LOCK_CLASS_OTHER = 0,
+	/** The lock on an event_base. */
+	EVTHREAD_LOCK_CLASS_BASE = 1,
+	/** The lock on an evbuffer that has a lock of its own. */
+	EVTHREAD_LOCK_CLASS_EVBUFFER = 2,
+	/** The lock on a bufferevent, which its evbuffers share. */
+	EVTHREAD_LOCK_CLASS_BUFFEREVENT = 3,
+	/** The lock on an evdns_base or an evdns_server_port. */
+	EVTHREAD_LOCK_CLASS_EVDNS = 4,
+	/** The lock on a bufferevent rate-limiting group. */
+	EVTHREAD_LOCK_CLASS_RATELIM_GROUP = 5,
+	/** The number of lock classes. */
+	EVTHREAD_LOCK_N_CLASSES = 6
+};
+
+/** What the lock profiler has seen of one class of lock.
+
+    All times are in nanoseconds.  A lock that is freed keeps counting
+    toward its class, except in n_locks.
+ */
+struct evthread_lock_stats {
+	/** How many locks of this class exist now. */
+	ev_uint64_t n_locks;
+	/** How many times a lock of this class was acquired. */
+	ev_uint64_t n_acquired;
+	/** How many of those acquisitions had to wait for another thread. */
+	ev_uint64_t n_contended;
+	/** The total and longest time spent waiting for a contended lock. */
+	ev_uint64_t wait_nsec;
+	ev_uint64_t max_wait_nsec;
+	/** The total and longest time a lock was held, from its outermost
+	    acquisition to its matching release. */
+	ev_uint64_t hold_nsec;
+	ev_uint64_t max_hold_nsec;
+};
+
+/** Enable profiling wrappers around the current lock callbacks, so that
+    Libevent counts how often each class of lock is taken, how often it is
+    contended, and how long it is waited for and held.
+
+    You must call this after evthread_use_pthreads() or one of its
+    siblings, and before allocating any event_base or other object that
+    uses locks.  It can be combined with evthread_enable_lock_debuging(),
+    in either order.
+
+    @return 0 on success, -1 if no lock callbacks are set or if the
+      profiler could not be set up.
+ */
+int evthread_enable_lock_profiling(void);
+
+/** Get what the lock profiler has seen of one class of lock.
+
+    The counters are read without stopping other threads, so a snapshot
+    taken while they run may be slightly inconsistent.
+
+    @param lock_class one of the EVTHREAD_LOCK_CLASS_* values.
+    @param stats a structure to fill in.
+    @return 0 on success, -1 if lock profiling is not enabled or
+      lock_class is out of range.
+ */
+int evthread_get_lock_stats(int lock_class, struct evthread_lock_stats *stats);
+
+/** Set every counter kept by the lock profiler back to zero.  Does nothing
+    if lock profiling is not enabled. */
+void evthread_reset_lock_stats(void);
+
 #endif /* _EVENT_DISABLE_THREAD_SUPPORT */
 
 struct event_base;
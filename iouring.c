@@ -0,0 +1,627 @@
+/*
+ * Copyright 2000-2007 Niels Provos <provos@citi.umich.edu>
+ * Copyright 2007-2010 Niels Provos, Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <sys/queue.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <signal.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "event-internal.h"
+#include "evsignal-internal.h"
+#include "event2/thread.h"
+#include "evthread-internal.h"
+#include "log-internal.h"
+#include "evmap-internal.h"
+#include "changelist-internal.h"
+#include "defer-internal.h"
+#include "uring-internal.h"
+
+/*
+  This backend drives readiness notification through io_uring.  Every fd
+  with events gets a one-shot IORING_OP_POLL_ADD; when it completes we
+  report the event and re-arm it on the next call to dispatch, which gives
+  the same level-triggered behavior as poll() and epoll.  Changes are
+  queued on the changelist and turned into submission queue entries at the
+  start of dispatch, so that the submissions and the wait happen in a
+  single io_uring_enter() call.
+
+  The same ring also carries the reads and writes of completion-based
+  bufferevents (see bufferevent_uring.c).  Their user_data is a pointer to
+  a struct event_uring_op; poll requests are told apart by having the low
+  bit of their user_data set.
+ */
+
+/* Number of submission queue entries.  If we have more than this many
+ * submissions pending in one dispatch, we flush them early. */
+#define URING_ENTRIES 512
+
+/* user_data for a POLL_REMOVE request; its completion is ignored. */
+#define URING_REMOVE_TAG (~(ev_uint64_t)0)
+
+struct uring_fdinfo {
+	/* Incremented every time we cancel a poll on this fd, so that we
+	 * can recognize completions for polls we no longer care about. */
+	ev_uint32_t gen;
+	/* The events we want on this fd: some of EV_READ|EV_WRITE. */
+	ev_uint8_t events;
+	/* The events in the poll request outstanding on this fd, or 0. */
+	ev_uint8_t armed;
+};
+
+struct iouringop {
+	int ring_fd;
+
+	/* Submission queue */
+	void *sq_ring;
+	size_t sq_ring_sz;
+	unsigned *sq_khead;
+	unsigned *sq_ktail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned sq_tail;
+	struct io_uring_sqe *sqes;
+	size_t sqes_sz;
+
+	/* Completion queue */
+	void *cq_ring;
+	size_t cq_ring_sz;
+	unsigned *cq_khead;
+	unsigned *cq_ktail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* Per-fd state, indexed by fd. */
+	struct uring_fdinfo *fds;
+	int nfds;
+
+	/* Fds whose poll completed during the last dispatch, and which need
+	 * to be re-armed. */
+	int *rearm;
+	int n_rearm;
+	int rearm_alloc;
+};
+
+static void *iouring_init(struct event_base *);
+static int iouring_dispatch(struct event_base *, struct timeval *);
+static void iouring_dealloc(struct event_base *);
+
+const struct eventop iouringops = {
+	"io_uring",
+	iouring_init,
+	event_changelist_add,
+	event_changelist_del,
+	iouring_dispatch,
+	iouring_dealloc,
+	1, /* need reinit */
+	EV_FEATURE_O1,
+	EVENT_CHANGELIST_FDINFO_SIZE,
+	NULL /* rearm */
+};
+
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags, void *arg, size_t argsz)
+{
+	return (syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		flags, arg, argsz));
+}
+
+static void
+iouring_unmap(struct iouringop *ring)
+{
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_sz);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_sz);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_sz);
+}
+
+static void *
+iouring_init(struct event_base *base)
+{
+	struct iouringop *ring;
+	struct io_uring_params p;
+	unsigned *sq_array;
+	char *sq, *cq;
+	unsigned i;
+
+	if (!(ring = mm_calloc(1, sizeof(struct iouringop))))
+		return (NULL);
+
+	memset(&p, 0, sizeof(p));
+	if ((ring->ring_fd = sys_io_uring_setup(URING_ENTRIES, &p)) == -1) {
+		if (errno != ENOSYS && errno != EPERM)
+			event_warn("io_uring_setup");
+		mm_free(ring);
+		return (NULL);
+	}
+
+	/* We pass our timeout to io_uring_enter directly; without that,
+	 * we would need an extra timeout request per dispatch. */
+	if (!(p.features & IORING_FEAT_EXT_ARG) ||
+	    !(p.features & IORING_FEAT_NODROP)) {
+		event_debug(("%s: kernel io_uring is too old", __func__));
+		goto err;
+	}
+
+	ring->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_ring_sz = p.cq_off.cqes +
+	    p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_sz > ring->sq_ring_sz)
+			ring->sq_ring_sz = ring->cq_ring_sz;
+		ring->cq_ring_sz = ring->sq_ring_sz;
+	}
+
+	sq = mmap(NULL, ring->sq_ring_sz, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED) {
+		event_warn("mmap");
+		goto err;
+	}
+	ring->sq_ring = sq;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, ring->cq_ring_sz, PROT_READ|PROT_WRITE,
+		    MAP_SHARED|MAP_POPULATE, ring->ring_fd,
+		    IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED) {
+			event_warn("mmap");
+			goto err;
+		}
+	}
+	ring->cq_ring = cq;
+
+	ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		event_warn("mmap");
+		goto err;
+	}
+
+	ring->sq_khead = (unsigned *)(sq + p.sq_off.head);
+	ring->sq_ktail = (unsigned *)(sq + p.sq_off.tail);
+	ring->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	ring->sq_entries = p.sq_entries;
+	ring->sq_tail = *ring->sq_ktail;
+	/* We always fill the sqes in ring order, so the index array can
+	 * be the identity mapping, set up once. */
+	sq_array = (unsigned *)(sq + p.sq_off.array);
+	for (i = 0; i < p.sq_entries; ++i)
+		sq_array[i] = i;
+
+	ring->cq_khead = (unsigned *)(cq + p.cq_off.head);
+	ring->cq_ktail = (unsigned *)(cq + p.cq_off.tail);
+	ring->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	evutil_make_socket_closeonexec(ring->ring_fd);
+
+	evsig_init(base);
+
+	return (ring);
+err:
+	iouring_unmap(ring);
+	close(ring->ring_fd);
+	mm_free(ring);
+	return (NULL);
+}
+
+/* Publish every sqe we have filled in, and return how many the kernel
+ * has not consumed yet.  Caller must hold th_base_lock. */
+static unsigned
+iouring_flush_sq(struct iouringop *ring)
+{
+	__atomic_store_n(ring->sq_ktail, ring->sq_tail, __ATOMIC_RELEASE);
+	return ring->sq_tail -
+	    __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+}
+
+/* Submit 'to_submit' sqes, and optionally wait for completions.  Returns
+ * the result of io_uring_enter. */
+static int
+iouring_enter(struct iouringop *ring, unsigned to_submit,
+    unsigned min_complete, const struct timeval *tv)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned flags = 0;
+
+	if (min_complete) {
+		flags |= IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG;
+		memset(&arg, 0, sizeof(arg));
+		if (tv) {
+			ts.tv_sec = tv->tv_sec;
+			ts.tv_nsec = tv->tv_usec * 1000;
+			arg.ts = (ev_uint64_t)(uintptr_t)&ts;
+		}
+		return sys_io_uring_enter(ring->ring_fd, to_submit,
+		    min_complete, flags, &arg, sizeof(arg));
+	}
+	if (!to_submit)
+		return (0);
+	return sys_io_uring_enter(ring->ring_fd, to_submit, 0, 0, NULL, 0);
+}
+
+/* Return a fresh sqe, flushing the submission queue if it is full. */
+static struct io_uring_sqe *
+iouring_get_sqe(struct iouringop *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head = __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+
+	if (ring->sq_tail - head >= ring->sq_entries) {
+		if (iouring_enter(ring, iouring_flush_sq(ring), 0, NULL) == -1 &&
+		    errno != EBUSY && errno != EINTR)
+			event_warn("io_uring_enter");
+		head = __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+		if (ring->sq_tail - head >= ring->sq_entries)
+			return (NULL);
+	}
+
+	sqe = &ring->sqes[ring->sq_tail & ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_tail++;
+	return (sqe);
+}
+
+static int
+iouring_grow_fds(struct iouringop *ring, int fd)
+{
+	struct uring_fdinfo *fds;
+	int nfds = ring->nfds ? ring->nfds : 32;
+
+	while (nfds <= fd)
+		nfds <<= 1;
+	fds = mm_realloc(ring->fds, nfds * sizeof(struct uring_fdinfo));
+	if (fds == NULL)
+		return (-1);
+	memset(fds + ring->nfds, 0,
+	    (nfds - ring->nfds) * sizeof(struct uring_fdinfo));
+	ring->fds = fds;
+	ring->nfds = nfds;
+	return (0);
+}
+
+static ev_uint64_t
+iouring_poll_tag(int fd, const struct uring_fdinfo *info)
+{
+	return ((ev_uint64_t)info->gen << 32) | ((ev_uint32_t)fd << 1) | 1;
+}
+
+/* Cancel the poll request outstanding on 'fd', if any. */
+static void
+iouring_disarm(struct iouringop *ring, int fd)
+{
+	struct uring_fdinfo *info = &ring->fds[fd];
+	struct io_uring_sqe *sqe;
+
+	if (!info->armed)
+		return;
+	if ((sqe = iouring_get_sqe(ring)) == NULL) {
+		event_warnx("%s: submission queue full", __func__);
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = iouring_poll_tag(fd, info);
+	sqe->user_data = URING_REMOVE_TAG;
+	/* Whether or not the cancellation wins the race with the poll's
+	 * completion, anything reported under the old tag is now stale. */
+	info->gen++;
+	info->armed = 0;
+}
+
+/* Post a poll request for the events we want on 'fd'. */
+static void
+iouring_arm(struct iouringop *ring, int fd)
+{
+	struct uring_fdinfo *info = &ring->fds[fd];
+	struct io_uring_sqe *sqe;
+	ev_uint32_t mask = 0;
+
+	if (info->armed || !info->events)
+		return;
+	if ((sqe = iouring_get_sqe(ring)) == NULL) {
+		event_warnx("%s: submission queue full", __func__);
+		return;
+	}
+	if (info->events & EV_READ)
+		mask |= POLLIN;
+	if (info->events & EV_WRITE)
+		mask |= POLLOUT;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	/* The kernel reads poll32_events as little-endian halfwords. */
+	mask = (mask << 16) | (mask >> 16);
+#endif
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = mask;
+	sqe->user_data = iouring_poll_tag(fd, info);
+	info->armed = info->events;
+}
+
+static int
+iouring_apply_changes(struct event_base *base)
+{
+	struct event_changelist *changelist = &base->changelist;
+	struct iouringop *ring = base->evbase;
+	struct event_change *ch;
+	struct uring_fdinfo *info;
+	int i, events;
+
+	for (i = 0; i < changelist->n_changes; ++i) {
+		ch = &changelist->changes[i];
+		if (ch->fd >= ring->nfds && iouring_grow_fds(ring, ch->fd) < 0)
+			return (-1);
+		info = &ring->fds[ch->fd];
+
+		events = ch->old_events & (EV_READ|EV_WRITE);
+		if (ch->read_change & EV_CHANGE_ADD)
+			events |= EV_READ;
+		else if (ch->read_change & EV_CHANGE_DEL)
+			events &= ~EV_READ;
+		if (ch->write_change & EV_CHANGE_ADD)
+			events |= EV_WRITE;
+		else if (ch->write_change & EV_CHANGE_DEL)
+			events &= ~EV_WRITE;
+
+		/* An add of an event we already had means the event was
+		 * deleted and re-added since the last dispatch, and the fd
+		 * may have been closed and reopened in between: the old poll
+		 * would still be watching the old file, so re-post it. */
+		if (info->armed != events ||
+		    ((ch->read_change|ch->write_change) & EV_CHANGE_ADD))
+			iouring_disarm(ring, ch->fd);
+		info->events = events;
+		iouring_arm(ring, ch->fd);
+	}
+
+	for (i = 0; i < ring->n_rearm; ++i)
+		iouring_arm(ring, ring->rearm[i]);
+	ring->n_rearm = 0;
+
+	return (0);
+}
+
+static void
+iouring_process_cqe(struct event_base *base, struct io_uring_cqe *cqe)
+{
+	struct iouringop *ring = base->evbase;
+	struct uring_fdinfo *info;
+	int fd, res = cqe->res;
+	short ev = 0;
+
+	if (cqe->user_data == URING_REMOVE_TAG)
+		return;
+	if (!(cqe->user_data & 1)) {
+		struct event_uring_op *op =
+		    (struct event_uring_op *)(uintptr_t)cqe->user_data;
+		op->res = res;
+		event_deferred_cb_schedule(&base->defer_queue, &op->deferred);
+		return;
+	}
+	fd = (int)((cqe->user_data & 0xffffffff) >> 1);
+	if (fd >= ring->nfds)
+		return;
+	info = &ring->fds[fd];
+	if ((ev_uint32_t)(cqe->user_data >> 32) != info->gen)
+		return; /* stale: this poll was cancelled. */
+
+	info->armed = 0;
+	if (res < 0) {
+		/* Most likely the fd was closed under us.  Like epoll, we
+		 * just drop it until someone changes its events. */
+		event_debug(("%s: poll on fd %d failed: %s", __func__, fd,
+			strerror(-res)));
+		return;
+	}
+
+	if (ring->n_rearm == ring->rearm_alloc) {
+		int n = ring->rearm_alloc ? ring->rearm_alloc * 2 : 32;
+		int *rearm = mm_realloc(ring->rearm, n * sizeof(int));
+		if (rearm == NULL) {
+			event_warn("%s: realloc", __func__);
+			return;
+		}
+		ring->rearm = rearm;
+		ring->rearm_alloc = n;
+	}
+	ring->rearm[ring->n_rearm++] = fd;
+
+	if (res & (POLLHUP|POLLERR|POLLNVAL)) {
+		ev = EV_READ | EV_WRITE;
+	} else {
+		if (res & POLLIN)
+			ev |= EV_READ;
+		if (res & POLLOUT)
+			ev |= EV_WRITE;
+	}
+	if (ev)
+		evmap_io_active(base, fd, ev);
+}
+
+static int
+iouring_dispatch(struct event_base *base, struct timeval *tv)
+{
+	struct iouringop *ring = base->evbase;
+	unsigned head, tail, to_submit;
+	int res, n = 0;
+
+	iouring_apply_changes(base);
+	event_changelist_remove_all(&base->changelist, base);
+	to_submit = iouring_flush_sq(ring);
+
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	res = iouring_enter(ring, to_submit, 1, tv);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+
+	if (res == -1 && errno != EINTR && errno != ETIME &&
+	    errno != EBUSY && errno != EAGAIN) {
+		event_warn("io_uring_enter");
+		return (-1);
+	}
+
+	head = *ring->cq_khead;
+	tail = __atomic_load_n(ring->cq_ktail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head, ++n)
+		iouring_process_cqe(base, &ring->cqes[head & ring->cq_mask]);
+	__atomic_store_n(ring->cq_khead, head, __ATOMIC_RELEASE);
+
+	event_debug(("%s: io_uring reaped %d completions", __func__, n));
+
+	return (0);
+}
+
+static void
+iouring_dealloc(struct event_base *base)
+{
+	struct iouringop *ring = base->evbase;
+
+	evsig_dealloc(base);
+	iouring_unmap(ring);
+	if (ring->ring_fd >= 0)
+		close(ring->ring_fd);
+	if (ring->fds)
+		mm_free(ring->fds);
+	if (ring->rearm)
+		mm_free(ring->rearm);
+
+	memset(ring, 0, sizeof(struct iouringop));
+	mm_free(ring);
+}
+
+static void
+iouring_op_deferred_cb(struct deferred_cb *cb, void *arg)
+{
+	struct event_uring_op *op = arg;
+	op->cb(op, op->res);
+}
+
+void
+event_uring_op_init(struct event_uring_op *op, uring_callback cb)
+{
+	memset(op, 0, sizeof(*op));
+	op->cb = cb;
+	event_deferred_cb_init(&op->deferred, iouring_op_deferred_cb, op);
+}
+
+int
+event_base_uses_uring(struct event_base *base)
+{
+	return base->evsel == &iouringops;
+}
+
+int
+event_base_wants_uring_bufferevents(struct event_base *base)
+{
+	return event_base_uses_uring(base) &&
+	    (base->flags & EVENT_BASE_FLAG_URING_BUFFEREVENTS);
+}
+
+static int
+iouring_launch(struct event_base *base, int opcode, evutil_socket_t fd,
+    ev_uint64_t addr, unsigned len, ev_uint64_t user_data)
+{
+	struct iouringop *ring;
+	struct io_uring_sqe *sqe;
+	int r = -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (!event_base_uses_uring(base))
+		goto done;
+	ring = base->evbase;
+	if ((sqe = iouring_get_sqe(ring)) == NULL)
+		goto done;
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = addr;
+	sqe->len = len;
+	sqe->off = (ev_uint64_t)-1;
+	sqe->user_data = user_data;
+	/* From the loop thread, the sqe goes out with the next dispatch.
+	 * Anywhere else, the loop may be asleep in io_uring_enter, so
+	 * submit it now. */
+	if (!EVBASE_IN_THREAD(base) &&
+	    iouring_enter(ring, iouring_flush_sq(ring), 0, NULL) == -1 &&
+	    errno != EBUSY && errno != EINTR)
+		event_warn("io_uring_enter");
+	r = 0;
+done:
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return (r);
+}
+
+int
+event_uring_readv(struct event_base *base, evutil_socket_t fd,
+    const struct iovec *iov, int n_iov, struct event_uring_op *op)
+{
+	return iouring_launch(base, IORING_OP_READV, fd,
+	    (ev_uint64_t)(uintptr_t)iov, n_iov, (ev_uint64_t)(uintptr_t)op);
+}
+
+int
+event_uring_writev(struct event_base *base, evutil_socket_t fd,
+    const struct iovec *iov, int n_iov, struct event_uring_op *op)
+{
+	return iouring_launch(base, IORING_OP_WRITEV, fd,
+	    (ev_uint64_t)(uintptr_t)iov, n_iov, (ev_uint64_t)(uintptr_t)op);
+}
+
+int
+event_uring_cancel(struct event_base *base, struct event_uring_op *op)
+{
+	return iouring_launch(base, IORING_OP_ASYNC_CANCEL, -1,
+	    (ev_uint64_t)(uintptr_t)op, 0, URING_REMOVE_TAG);
+}
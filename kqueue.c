@@ -91,7 +91,8 @@ const struct eventop kqops = {
 	kq_dealloc,
 	1 /* need reinit */,
     EV_FEATURE_ET|EV_FEATURE_O1|EV_FEATURE_FDS,
-	EVENT_CHANGELIST_FDINFO_SIZE
+	EVENT_CHANGELIST_FDINFO_SIZE,
+	NULL /* rearm */
 };
 
 static const struct eventop kqsigops = {
@@ -103,7 +104,8 @@ static const struct eventop kqsigops = {
 	NULL,
 	1 /* need reinit */,
 	0,
-	0
+	0,
+	NULL /* rearm */
 };
 
 static void *
@@ -130,10 +132,14 @@ kq_init(struct event_base *base)
 	kqueueop->changes = mm_calloc(NEVENT, sizeof(struct kevent));
 	if (kqueueop->changes == NULL)
 		goto err;
-	kqueueop->events = mm_calloc(NEVENT, sizeof(struct kevent));
+	kqueueop->events_size = NEVENT;
+	if (base->events_per_wakeup_hint > kqueueop->events_size)
+		kqueueop->events_size = base->events_per_wakeup_hint;
+	kqueueop->events = mm_calloc(kqueueop->events_size,
+	    sizeof(struct kevent));
 	if (kqueueop->events == NULL)
 		goto err;
-	kqueueop->events_size = kqueueop->changes_size = NEVENT;
+	kqueueop->changes_size = NEVENT;
 
 	/* Check for Mac OS X kqueue bug. */
 	memset(&kqueueop->changes[0], 0, sizeof kqueueop->changes[0]);
@@ -183,7 +183,10 @@ evconnlistener_new(struct event_base *base,
 		EVTHREAD_ALLOC_LOCK(lev->base.lock, EVTHREAD_LOCKTYPE_RECURSIVE);
 	}
 
-	event_assign(&lev->listener, base, fd, EV_READ|EV_PERSIST,
+	/* Without a lock, the listener's callback must stay on its base's
+	 * thread even if the base belongs to an event_base_group. */
+	event_assign(&lev->listener, base, fd,
+	    EV_READ|EV_PERSIST|(lev->base.lock ? 0 : EV_PINNED),
 	    listener_read_cb, lev);
 
 	evconnlistener_enable(&lev->base);
@@ -35,9 +35,25 @@
 #include "util-internal.h"
 #include "mm-internal.h"
 
+/* Number of children per node.  A wider heap is shallower, so a sift
+ * touches fewer cache lines; the children of a node are adjacent in the
+ * array, so scanning them is cheap. */
+#ifndef MIN_HEAP_ARITY
+#define MIN_HEAP_ARITY 4
+#endif
+
+/* The deadline is the latest time the event may run, ev_timeout plus
+ * ev_slack, in microseconds, kept next to the pointer so that comparisons
+ * never leave the heap array. */
+struct min_heap_entry
+{
+	ev_uint64_t deadline;
+	struct event* ev;
+};
+
 typedef struct min_heap
 {
-	struct event** p;
+	struct min_heap_entry* p;
 	unsigned n, a;
 } min_heap_t;
 
@@ -45,7 +61,7 @@ static inline void	     min_heap_ctor(min_heap_t* s);
 static inline void	     min_heap_dtor(min_heap_t* s);
 static inline void	     min_heap_elem_init(struct event* e);
 static inline int	     min_heap_elt_is_top(const struct event *e);
-static inline int	     min_heap_elem_greater(struct event *a, struct event *b);
+static inline ev_uint64_t    min_heap_key_(const struct timeval *tv);
 static inline int	     min_heap_empty(min_heap_t* s);
 static inline unsigned	     min_heap_size(min_heap_t* s);
 static inline struct event*  min_heap_top(min_heap_t* s);
@@ -53,12 +69,18 @@ static inline int	     min_heap_reserve(min_heap_t* s, unsigned n);
 static inline int	     min_heap_push(min_heap_t* s, struct event* e);
 static inline struct event*  min_heap_pop(min_heap_t* s);
 static inline int	     min_heap_erase(min_heap_t* s, struct event* e);
-static inline void	     min_heap_shift_up_(min_heap_t* s, unsigned hole_index, struct event* e);
-static inline void	     min_heap_shift_down_(min_heap_t* s, unsigned hole_index, struct event* e);
+static inline void	     min_heap_adjust_all(min_heap_t* s, const struct timeval *off);
+static inline int	     min_heap_push_unordered(min_heap_t* s, struct event* e);
+static inline int	     min_heap_erase_unordered(min_heap_t* s, struct event* e);
+static inline void	     min_heap_heapify(min_heap_t* s);
+static inline void	     min_heap_shift_up_(min_heap_t* s, unsigned hole_index, struct min_heap_entry e);
+static inline void	     min_heap_shift_down_(min_heap_t* s, unsigned hole_index, struct min_heap_entry e);
+
+#define MIN_HEAP_PARENT_(i) (((i) - 1) / MIN_HEAP_ARITY)
 
-int min_heap_elem_greater(struct event *a, struct event *b)
+ev_uint64_t min_heap_key_(const struct timeval *tv)
 {
-	return evutil_timercmp(&a->ev_timeout, &b->ev_timeout, >);
+	return (ev_uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
 }
 
 void min_heap_ctor(min_heap_t* s) { s->p = 0; s->n = 0; s->a = 0; }
@@ -66,13 +88,16 @@ void min_heap_dtor(min_heap_t* s) { if (s->p) mm_free(s->p); }
 void min_heap_elem_init(struct event* e) { e->ev_timeout_pos.min_heap_idx = -1; }
 int min_heap_empty(min_heap_t* s) { return 0u == s->n; }
 unsigned min_heap_size(min_heap_t* s) { return s->n; }
-struct event* min_heap_top(min_heap_t* s) { return s->n ? *s->p : 0; }
+struct event* min_heap_top(min_heap_t* s) { return s->n ? s->p->ev : 0; }
 
 int min_heap_push(min_heap_t* s, struct event* e)
 {
+	struct min_heap_entry ent;
 	if (min_heap_reserve(s, s->n + 1))
 		return -1;
-	min_heap_shift_up_(s, s->n++, e);
+	ent.deadline = min_heap_key_(&e->ev_timeout) + e->ev_slack;
+	ent.ev = e;
+	min_heap_shift_up_(s, s->n++, ent);
 	return 0;
 }
 
@@ -80,7 +105,7 @@ struct event* min_heap_pop(min_heap_t* s)
 {
 	if (s->n)
 	{
-		struct event* e = *s->p;
+		struct event* e = s->p->ev;
 		min_heap_shift_down_(s, 0u, s->p[--s->n]);
 		e->ev_timeout_pos.min_heap_idx = -1;
 		return e;
@@ -97,14 +122,14 @@ int min_heap_erase(min_heap_t* s, struct event* e)
 {
 	if (-1 != e->ev_timeout_pos.min_heap_idx)
 	{
-		struct event *last = s->p[--s->n];
-		unsigned parent = (e->ev_timeout_pos.min_heap_idx - 1) / 2;
+		struct min_heap_entry last = s->p[--s->n];
+		unsigned parent = MIN_HEAP_PARENT_(e->ev_timeout_pos.min_heap_idx);
 		/* we replace e with the last element in the heap.  We might need to
 		   shift it upward if it is less than its parent, or downward if it is
-		   greater than one or both its children. Since the children are known
-		   to be less than the parent, it can't need to shift both up and
-		   down. */
-		if (e->ev_timeout_pos.min_heap_idx > 0 && min_heap_elem_greater(s->p[parent], last))
+		   greater than one or more of its children. Since the children are
+		   known to be less than the parent, it can't need to shift both up
+		   and down. */
+		if (e->ev_timeout_pos.min_heap_idx > 0 && s->p[parent].deadline > last.deadline)
 			min_heap_shift_up_(s, e->ev_timeout_pos.min_heap_idx, last);
 		else
 			min_heap_shift_down_(s, e->ev_timeout_pos.min_heap_idx, last);
@@ -118,11 +143,11 @@ int min_heap_reserve(min_heap_t* s, unsigned n)
 {
 	if (s->a < n)
 	{
-		struct event** p;
+		struct min_heap_entry* p;
 		unsigned a = s->a ? s->a * 2 : 8;
 		if (a < n)
 			a = n;
-		if (!(p = (struct event**)mm_realloc(s->p, a * sizeof *p)))
+		if (!(p = (struct min_heap_entry*)mm_realloc(s->p, a * sizeof *p)))
 			return -1;
 		s->p = p;
 		s->a = a;
@@ -130,31 +155,93 @@ int min_heap_reserve(min_heap_t* s, unsigned n)
 	return 0;
 }
 
-void min_heap_shift_up_(min_heap_t* s, unsigned hole_index, struct event* e)
+/* Subtract 'off' from the timeout of every element.  Every key moves by the
+ * same amount, so the heap property is preserved. */
+void min_heap_adjust_all(min_heap_t* s, const struct timeval *off)
+{
+	ev_uint64_t delta = min_heap_key_(off);
+	unsigned i;
+	for (i = 0; i < s->n; ++i)
+	{
+		struct timeval *tv = &s->p[i].ev->ev_timeout;
+		evutil_timersub(tv, off, tv);
+		s->p[i].deadline -= delta;
+	}
+}
+
+/* Add 'e' at the end of the heap without restoring the heap property.
+ * Call min_heap_heapify() before relying on the order again. */
+int min_heap_push_unordered(min_heap_t* s, struct event* e)
+{
+	if (min_heap_reserve(s, s->n + 1))
+		return -1;
+	s->p[s->n].deadline = min_heap_key_(&e->ev_timeout) + e->ev_slack;
+	s->p[s->n].ev = e;
+	e->ev_timeout_pos.min_heap_idx = s->n++;
+	return 0;
+}
+
+/* Remove 'e' by moving the last element into its place, without restoring
+ * the heap property. */
+int min_heap_erase_unordered(min_heap_t* s, struct event* e)
+{
+	if (-1 != e->ev_timeout_pos.min_heap_idx)
+	{
+		unsigned idx = e->ev_timeout_pos.min_heap_idx;
+		s->p[idx] = s->p[--s->n];
+		s->p[idx].ev->ev_timeout_pos.min_heap_idx = idx;
+		e->ev_timeout_pos.min_heap_idx = -1;
+		return 0;
+	}
+	return -1;
+}
+
+/* Restore the heap property over the whole array, bottom-up.  This is
+ * O(n), so it beats pushing one element at a time once a good share of
+ * the heap was added without ordering. */
+void min_heap_heapify(min_heap_t* s)
+{
+	unsigned i;
+	if (s->n < 2)
+		return;
+	for (i = MIN_HEAP_PARENT_(s->n - 1) + 1; i-- > 0; )
+		min_heap_shift_down_(s, i, s->p[i]);
+}
+
+void min_heap_shift_up_(min_heap_t* s, unsigned hole_index, struct min_heap_entry e)
 {
-    unsigned parent = (hole_index - 1) / 2;
-    while (hole_index && min_heap_elem_greater(s->p[parent], e))
+    unsigned parent = MIN_HEAP_PARENT_(hole_index);
+    while (hole_index && s->p[parent].deadline > e.deadline)
     {
-	(s->p[hole_index] = s->p[parent])->ev_timeout_pos.min_heap_idx = hole_index;
+	s->p[hole_index] = s->p[parent];
+	s->p[hole_index].ev->ev_timeout_pos.min_heap_idx = hole_index;
 	hole_index = parent;
-	parent = (hole_index - 1) / 2;
+	parent = MIN_HEAP_PARENT_(hole_index);
     }
-    (s->p[hole_index] = e)->ev_timeout_pos.min_heap_idx = hole_index;
+    s->p[hole_index] = e;
+    e.ev->ev_timeout_pos.min_heap_idx = hole_index;
 }
 
-void min_heap_shift_down_(min_heap_t* s, unsigned hole_index, struct event* e)
+void min_heap_shift_down_(min_heap_t* s, unsigned hole_index, struct min_heap_entry e)
 {
-    unsigned min_child = 2 * (hole_index + 1);
-    while (min_child <= s->n)
+    unsigned child = MIN_HEAP_ARITY * hole_index + 1;
+    while (child < s->n)
 	{
-	min_child -= min_child == s->n || min_heap_elem_greater(s->p[min_child], s->p[min_child - 1]);
-	if (!(min_heap_elem_greater(e, s->p[min_child])))
+	unsigned end = child + MIN_HEAP_ARITY, min_child = child;
+	if (end > s->n)
+	    end = s->n;
+	while (++child < end)
+	    if (s->p[min_child].deadline > s->p[child].deadline)
+		min_child = child;
+	if (!(e.deadline > s->p[min_child].deadline))
 	    break;
-	(s->p[hole_index] = s->p[min_child])->ev_timeout_pos.min_heap_idx = hole_index;
+	s->p[hole_index] = s->p[min_child];
+	s->p[hole_index].ev->ev_timeout_pos.min_heap_idx = hole_index;
 	hole_index = min_child;
-	min_child = 2 * (hole_index + 1);
+	child = MIN_HEAP_ARITY * hole_index + 1;
 	}
-    (s->p[hole_index] = e)->ev_timeout_pos.min_heap_idx = hole_index;
+    s->p[hole_index] = e;
+    e.ev->ev_timeout_pos.min_heap_idx = hole_index;
 }
 
 #endif /* _MIN_HEAP_H_ */
@@ -46,14 +46,39 @@ void event_mm_free_(void *p);
 #define mm_strdup(s) event_mm_strdup_(s)
 #define mm_realloc(p, sz) event_mm_realloc_((p), (sz))
 #define mm_free(p) event_mm_free_(p)
+
+/* Internal use only: Like the above, but allocate with 'mm', as given to
+ * event_config_set_mem_functions(), or with the global functions if 'mm'
+ * is NULL. */
+struct event_mem_functions;
+void *event_mm_malloc_with_(const struct event_mem_functions *mm, size_t sz);
+void *event_mm_calloc_with_(const struct event_mem_functions *mm,
+    size_t count, size_t size);
+void *event_mm_realloc_with_(const struct event_mem_functions *mm, void *p,
+    size_t sz);
+void event_mm_free_with_(const struct event_mem_functions *mm, void *p);
+#define mm_malloc_with(mm, sz) event_mm_malloc_with_((mm), (sz))
+#define mm_calloc_with(mm, count, size) \
+	event_mm_calloc_with_((mm), (count), (size))
+#define mm_realloc_with(mm, p, sz) event_mm_realloc_with_((mm), (p), (sz))
+#define mm_free_with(mm, p) event_mm_free_with_((mm), (p))
 #else
 #define mm_malloc(sz) malloc(sz)
 #define mm_calloc(n, sz) calloc((n), (sz))
 #define mm_strdup(s) strdup(s)
 #define mm_realloc(p, sz) realloc((p), (sz))
 #define mm_free(p) free(p)
+#define mm_malloc_with(mm, sz) malloc(sz)
+#define mm_calloc_with(mm, n, sz) calloc((n), (sz))
+#define mm_realloc_with(mm, p, sz) realloc((p), (sz))
+#define mm_free_with(mm, p) free(p)
 #endif
 
+struct event_base;
+/* Internal use only: Return the memory functions that objects belonging to
+ * 'base' should be allocated with, or NULL for the global ones. */
+const struct event_mem_functions *_event_base_get_mm(struct event_base *base);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _EVENT_MPSC_INTERNAL_H
+#define _EVENT_MPSC_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "event2/event-config.h"
+/* For struct ev_mpsc_node, which struct event embeds. */
+#include "event2/event_struct.h"
+
+/* Atomic operations, where the compiler gives them to us.  Each of these
+ * is a full memory barrier. */
+#if defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+#define EVUTIL_HAVE_ATOMICS
+#define EVUTIL_ATOMIC_CAS_PTR(p, oldval, newval)		\
+	((void *)__sync_val_compare_and_swap((p), (oldval), (newval)))
+#define EVUTIL_ATOMIC_CAS_INT(p, oldval, newval)		\
+	__sync_val_compare_and_swap((p), (oldval), (newval))
+#elif defined(_MSC_VER)
+#include <windows.h>
+#define EVUTIL_HAVE_ATOMICS
+#define EVUTIL_ATOMIC_CAS_PTR(p, oldval, newval)			\
+	InterlockedCompareExchangePointer((PVOID volatile *)(p),	\
+	    (newval), (oldval))
+#define EVUTIL_ATOMIC_CAS_INT(p, oldval, newval)			\
+	InterlockedCompareExchange((LONG volatile *)(p), (newval), (oldval))
+#endif
+
+/* A multi-producer, single-consumer list.  Any thread may push onto it
+ * without taking a lock; a single consumer at a time (in practice, whoever
+ * holds the lock of the structure that contains the list) takes everything
+ * on it at once.  Since nodes are never removed one at a time, the usual
+ * ABA problem of lock-free stacks does not arise.  Nodes are struct
+ * ev_mpsc_node, from event2/event_struct.h. */
+struct ev_mpsc_queue {
+	struct ev_mpsc_node *volatile head;
+};
+
+#define ev_mpsc_init(q) ((q)->head = NULL)
+#define ev_mpsc_empty(q) ((q)->head == NULL)
+
+#ifdef EVUTIL_HAVE_ATOMICS
+/* Push 'node' onto 'q'.  Returns true iff the queue was empty, in which
+ * case the caller is responsible for waking up the consumer. */
+static inline int
+ev_mpsc_push(struct ev_mpsc_queue *q, struct ev_mpsc_node *node)
+{
+	struct ev_mpsc_node *head = q->head, *seen;
+
+	for (;;) {
+		node->next = head;
+		seen = (struct ev_mpsc_node *)
+		    EVUTIL_ATOMIC_CAS_PTR(&q->head, head, node);
+		if (seen == head)
+			return head == NULL;
+		head = seen;
+	}
+}
+
+/* Remove every node from 'q', and return them in the order they were
+ * pushed. */
+static inline struct ev_mpsc_node *
+ev_mpsc_take_all(struct ev_mpsc_queue *q)
+{
+	struct ev_mpsc_node *node, *seen, *next, *prev = NULL;
+
+	node = q->head;
+	while (node) {
+		seen = (struct ev_mpsc_node *)
+		    EVUTIL_ATOMIC_CAS_PTR(&q->head, node, NULL);
+		if (seen == node)
+			break;
+		node = seen;
+	}
+	/* We got the nodes newest first; reverse them. */
+	while (node) {
+		next = node->next;
+		node->next = prev;
+		prev = node;
+		node = next;
+	}
+	return prev;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EVENT_MPSC_INTERNAL_H */
@@ -78,6 +78,7 @@ const struct eventop pollops = {
 	0, /* doesn't need_reinit */
 	EV_FEATURE_FDS,
 	sizeof(struct pollidx),
+	NULL, /* rearm */
 };
 
 static void *
@@ -87,6 +87,7 @@ const struct eventop selectops = {
 	0, /* doesn't need reinit. */
 	EV_FEATURE_FDS,
 	0,
+	NULL, /* rearm */
 };
 
 static int select_resize(struct selectop *sop, int fdsz);
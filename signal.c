@@ -77,8 +77,8 @@
   signal, but event_base A won't.
 
   It would be neat to change this behavior in some future version of Libevent.
-  kqueue already does something far more sensible.  We can make all backends
-  on Linux do a reasonable thing using signalfd.
+  kqueue already does something far more sensible.  On Linux, a base created
+  with EVENT_BASE_FLAG_SIGNALFD uses signalfd.c instead of this code.
 */
 
 #ifndef WIN32
@@ -97,7 +97,8 @@ static const struct eventop evsigops = {
 	evsig_del,
 	NULL,
 	NULL,
-	0, 0, 0
+	0, 0, 0,
+	NULL
 };
 
 #ifndef _EVENT_DISABLE_THREAD_SUPPORT
@@ -118,6 +119,10 @@ static void __cdecl evsig_handler(int sig);
 void
 evsig_set_base(struct event_base *base)
 {
+#ifdef EVSIG_USE_SIGNALFD
+	if (base->sig.ev_signalfd != -1)
+		return;
+#endif
 	EVSIGBASE_LOCK();
 	evsig_base = base;
 	evsig_base_n_signals_added = base->sig.ev_n_signals_added;
@@ -173,6 +178,13 @@ evsig_init(struct event_base *base)
 		EVTHREAD_ALLOC_LOCK(evsig_base_lock, 0);
 #endif
 
+#ifdef EVSIG_USE_SIGNALFD
+	base->sig.ev_signalfd = -1;
+	if ((base->flags & EVENT_BASE_FLAG_SIGNALFD) &&
+	    evsigfd_init(base) == 0)
+		return 0;
+#endif
+
 	/*
 	 * Our signal handler is going to write to one end of the socket
 	 * pair to wake up our event loop.  The event loop then scans for
@@ -402,6 +414,12 @@ void
 evsig_dealloc(struct event_base *base)
 {
 	int i = 0;
+#ifdef EVSIG_USE_SIGNALFD
+	if (base->sig.ev_signalfd != -1) {
+		evsigfd_dealloc(base);
+		return;
+	}
+#endif
 	if (base->sig.ev_signal_added) {
 		event_del(&base->sig.ev_signal);
 		event_debug_unassign(&base->sig.ev_signal);
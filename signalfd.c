@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2009-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <sys/queue.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "event2/event.h"
+#include "event2/event_struct.h"
+#include "event-internal.h"
+#include "event2/util.h"
+#include "evsignal-internal.h"
+#include "log-internal.h"
+#include "evmap-internal.h"
+#include "evthread-internal.h"
+
+/*
+  signalfd.c
+
+  This is the signal-handling implementation we use on Linux when the base
+  was created with EVENT_BASE_FLAG_SIGNALFD.  Instead of installing a signal
+  handler that writes to a socketpair, we block the signals we care about
+  and read them from a signalfd, which sits in the backend's own set like
+  any other fd.  One read() drains every pending signal, there is no
+  handler to reenter, and each base has its own signalfd, so several bases
+  can watch signals at once.  (If two bases watch the same signal, each
+  instance of it goes to whichever reads it first.)
+
+  The catch is that a blocked signal is only blocked in the thread that
+  blocked it.  If the program has other threads that do not block the
+  signal too, the kernel may deliver it to one of them with its ordinary
+  disposition.
+*/
+
+static int evsigfd_add(struct event_base *, int, short, short, void *);
+static int evsigfd_del(struct event_base *, int, short, short, void *);
+
+static const struct eventop evsigfdops = {
+	"signalfd",
+	NULL,
+	evsigfd_add,
+	evsigfd_del,
+	NULL,
+	NULL,
+	0, 0, 0,
+	NULL
+};
+
+/* How many signals we try to read from the signalfd at once. */
+#define SIGNALFD_BATCH 32
+
+/* The signal mask is not per base, so neither is the bookkeeping for it:
+ * for each signal, how many bases are watching it with a signalfd, and
+ * whether we blocked it ourselves (rather than finding it blocked) and so
+ * must unblock it once the last of them stops. */
+static int evsigfd_n_watchers[NSIG];
+static char evsigfd_we_blocked[NSIG];
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+static void *evsigfd_lock = NULL;
+#endif
+
+/* Callback for when our signalfd has signals for us to read. */
+static void
+evsigfd_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct signalfd_siginfo info[SIGNALFD_BATCH];
+	ev_ssize_t n;
+	int i;
+	int ncaught[NSIG];
+	struct event_base *base;
+
+	base = arg;
+
+	memset(&ncaught, 0, sizeof(ncaught));
+
+	while (1) {
+		n = read(fd, info, sizeof(info));
+		if (n == -1) {
+			if (errno != EAGAIN && errno != EINTR)
+				event_warn("%s: read", __func__);
+			break;
+		}
+		for (i = 0; i < (int)(n / sizeof(info[0])); ++i) {
+			ev_uint32_t sig = info[i].ssi_signo;
+			if (sig < NSIG)
+				ncaught[sig]++;
+		}
+		if (n < (ev_ssize_t)sizeof(info))
+			break;
+	}
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	for (i = 0; i < NSIG; ++i) {
+		if (ncaught[i])
+			evmap_signal_active(base, i, ncaught[i]);
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+}
+
+int
+evsigfd_init(struct event_base *base)
+{
+	struct evsig_info *sig = &base->sig;
+	int fd;
+
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+	if (! evsigfd_lock)
+		EVTHREAD_ALLOC_LOCK(evsigfd_lock, 0);
+#endif
+
+	sigemptyset(&sig->ev_signalfd_mask);
+
+	fd = signalfd(-1, &sig->ev_signalfd_mask, SFD_NONBLOCK|SFD_CLOEXEC);
+	if (fd == -1) {
+		/* EINVAL and ENOSYS mean a kernel too old for signalfd or
+		 * for its flags; the caller falls back to a handler. */
+		if (errno != EINVAL && errno != ENOSYS)
+			event_warn("signalfd");
+		return -1;
+	}
+
+	sig->ev_signalfd = fd;
+	sig->sh_old = NULL;
+	sig->sh_old_max = 0;
+
+	event_assign(&sig->ev_signal, base, fd, EV_READ | EV_PERSIST,
+	    evsigfd_cb, base);
+
+	sig->ev_signal.ev_flags |= EVLIST_INTERNAL;
+	event_priority_set(&sig->ev_signal, 0);
+
+	base->evsigsel = &evsigfdops;
+
+	return 0;
+}
+
+/* Note that one more base watches 'evsignal', and make sure it is
+ * blocked.  Returns 0 on success, -1 on failure. */
+static int
+evsigfd_watch(int evsignal)
+{
+	sigset_t one, oldmask;
+	int r = 0;
+
+	sigemptyset(&one);
+	sigaddset(&one, evsignal);
+
+	EVLOCK_LOCK(evsigfd_lock, 0);
+	if (sigprocmask(SIG_BLOCK, &one, &oldmask) == -1) {
+		event_warn("sigprocmask");
+		r = -1;
+	} else {
+		if (!sigismember(&oldmask, evsignal))
+			evsigfd_we_blocked[evsignal] = 1;
+		++evsigfd_n_watchers[evsignal];
+	}
+	EVLOCK_UNLOCK(evsigfd_lock, 0);
+	return r;
+}
+
+/* Note that one fewer base watches 'evsignal'.  If it was the last one,
+ * discard any instances of the signal that are pending, so that they do
+ * not get delivered with the default disposition, and unblock it if we
+ * were the ones who blocked it. */
+static void
+evsigfd_release(int evsignal)
+{
+	sigset_t one;
+	struct timespec zero = { 0, 0 };
+
+	sigemptyset(&one);
+	sigaddset(&one, evsignal);
+
+	EVLOCK_LOCK(evsigfd_lock, 0);
+	EVUTIL_ASSERT(evsigfd_n_watchers[evsignal] > 0);
+	if (--evsigfd_n_watchers[evsignal] == 0 &&
+	    evsigfd_we_blocked[evsignal]) {
+		while (sigtimedwait(&one, NULL, &zero) > 0)
+			;
+		sigprocmask(SIG_UNBLOCK, &one, NULL);
+		evsigfd_we_blocked[evsignal] = 0;
+	}
+	EVLOCK_UNLOCK(evsigfd_lock, 0);
+}
+
+static int
+evsigfd_add(struct event_base *base, int evsignal, short old, short events, void *p)
+{
+	struct evsig_info *sig = &base->sig;
+	(void)p;
+
+	EVUTIL_ASSERT(evsignal >= 0 && evsignal < NSIG);
+
+	if (evsigfd_watch(evsignal) == -1)
+		return (-1);
+
+	sigaddset(&sig->ev_signalfd_mask, evsignal);
+	if (signalfd(sig->ev_signalfd, &sig->ev_signalfd_mask, 0) == -1) {
+		event_warn("signalfd");
+		goto err;
+	}
+
+	if (!sig->ev_signal_added) {
+		if (event_add(&sig->ev_signal, NULL))
+			goto err;
+		sig->ev_signal_added = 1;
+	}
+
+	++sig->ev_n_signals_added;
+	return (0);
+
+err:
+	sigdelset(&sig->ev_signalfd_mask, evsignal);
+	signalfd(sig->ev_signalfd, &sig->ev_signalfd_mask, 0);
+	evsigfd_release(evsignal);
+	return (-1);
+}
+
+static int
+evsigfd_del(struct event_base *base, int evsignal, short old, short events, void *p)
+{
+	struct evsig_info *sig = &base->sig;
+	int r = 0;
+	(void)p;
+
+	EVUTIL_ASSERT(evsignal >= 0 && evsignal < NSIG);
+
+	event_debug(("%s: %d: no longer watching signal", __func__, evsignal));
+
+	sigdelset(&sig->ev_signalfd_mask, evsignal);
+	if (signalfd(sig->ev_signalfd, &sig->ev_signalfd_mask, 0) == -1) {
+		event_warn("signalfd");
+		r = -1;
+	}
+	evsigfd_release(evsignal);
+	--sig->ev_n_signals_added;
+
+	return (r);
+}
+
+void
+evsigfd_dealloc(struct event_base *base)
+{
+	struct evsig_info *sig = &base->sig;
+	int i;
+
+	if (sig->ev_signal_added) {
+		event_del(&sig->ev_signal);
+		event_debug_unassign(&sig->ev_signal);
+		sig->ev_signal_added = 0;
+	}
+
+	for (i = 1; i < NSIG; ++i) {
+		if (sigismember(&sig->ev_signalfd_mask, i) == 1)
+			evsigfd_release(i);
+	}
+	sigemptyset(&sig->ev_signalfd_mask);
+	sig->ev_n_signals_added = 0;
+
+	close(sig->ev_signalfd);
+	sig->ev_signalfd = -1;
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures how accurately a short, repeating timeout
+ * fires.  It runs the same pacing timer once with the default timeout
+ * handling and once with EVENT_BASE_FLAG_PRECISE_TIMER, and reports the
+ * distribution of the difference between when each callback ran and when
+ * it was due, in microseconds.  Negative numbers mean the callback ran
+ * early.
+ */
+
+static struct event timer;
+static struct timeval interval;
+static struct timeval due;
+static long *lateness;
+static int n_samples;
+static int n_wanted;
+
+static void
+timer_cb(evutil_socket_t fd, short which, void *arg)
+{
+	struct timeval now, diff;
+
+	evutil_gettimeofday(&now, NULL);
+	evutil_timersub(&now, &due, &diff);
+	lateness[n_samples++] = diff.tv_sec * 1000000L + diff.tv_usec;
+
+	if (n_samples < n_wanted) {
+		evutil_timeradd(&now, &interval, &due);
+		event_add(&timer, &interval);
+	}
+}
+
+static int
+compare_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+	return x < y ? -1 : x > y;
+}
+
+static long
+percentile(int pct)
+{
+	int idx = (n_samples - 1) * pct / 100;
+	return lateness[idx];
+}
+
+static void
+run_once(int flags, const char *label)
+{
+	struct event_config *cfg;
+	struct event_base *base;
+	int i, early = 0;
+
+	cfg = event_config_new();
+	if (cfg == NULL)
+		exit(1);
+	event_config_set_flag(cfg, flags);
+	base = event_base_new_with_config(cfg);
+	if (base == NULL) {
+		fprintf(stderr, "Couldn't create event_base\n");
+		exit(1);
+	}
+
+	n_samples = 0;
+	evtimer_assign(&timer, base, timer_cb, NULL);
+	evutil_gettimeofday(&due, NULL);
+	evutil_timeradd(&due, &interval, &due);
+	event_add(&timer, &interval);
+	event_base_dispatch(base);
+
+	qsort(lateness, n_samples, sizeof(long), compare_long);
+	for (i = 0; i < n_samples; ++i) {
+		if (lateness[i] < 0)
+			++early;
+	}
+
+	fprintf(stdout, "%-8s %-8s min %6ld  p50 %6ld  p90 %6ld  p99 %6ld  "
+	    "max %6ld  early %d/%d\n", event_base_get_method(base), label,
+	    lateness[0], percentile(50), percentile(90), percentile(99),
+	    lateness[n_samples - 1], early, n_samples);
+
+	event_base_free(base);
+	event_config_free(cfg);
+}
+
+int
+main(int argc, char **argv)
+{
+	int c;
+	long usec = 200;
+
+	n_wanted = 5000;
+
+	while ((c = getopt(argc, argv, "i:n:")) != -1) {
+		switch (c) {
+		case 'i':
+			usec = atol(optarg);
+			break;
+		case 'n':
+			n_wanted = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (n_wanted <= 0 || usec <= 0) {
+		fprintf(stderr, "Need a positive interval and sample count\n");
+		exit(1);
+	}
+
+	interval.tv_sec = usec / 1000000;
+	interval.tv_usec = usec % 1000000;
+	lateness = calloc(n_wanted, sizeof(long));
+	if (lateness == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	fprintf(stdout, "%d timeouts of %ld usec; lateness in usec\n",
+	    n_wanted, usec);
+	run_once(0, "default");
+	run_once(EVENT_BASE_FLAG_PRECISE_TIMER, "precise");
+
+	free(lateness);
+	exit(0);
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <sys/wait.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark compares the plain pthread locks with the adaptive ones
+ * from evthread_use_pthreads_adaptive().  Several threads hammer on one
+ * lock with short critical sections: first on a shared evbuffer, adding,
+ * measuring and draining a byte at a time, and then on a shared
+ * event_base, activating events from outside its loop.  It reports the
+ * wall-clock time per operation for each kind of lock.
+ *
+ * Each kind of lock is measured in its own process, since Libevent's
+ * global locks cannot change kind once they are allocated.
+ */
+
+#define MAX_THREADS 64
+
+static int num_threads = 4;
+static int num_iterations = 200000;
+static int max_spins = 0;
+
+static struct evbuffer *shared_buf;
+static struct event_base *shared_base;
+
+static void
+nop_cb(evutil_socket_t fd, short what, void *arg)
+{
+}
+
+static void *
+evbuffer_worker(void *arg)
+{
+	int i;
+
+	for (i = 0; i < num_iterations; ++i) {
+		evbuffer_add(shared_buf, "x", 1);
+		if (evbuffer_get_length(shared_buf) > 0)
+			evbuffer_drain(shared_buf, 1);
+	}
+	return NULL;
+}
+
+static void *
+activate_worker(void *arg)
+{
+	struct event *ev = arg;
+	int i;
+
+	for (i = 0; i < num_iterations; ++i)
+		event_active(ev, EV_READ, 1);
+	return NULL;
+}
+
+static double
+elapsed_nsec(const struct timeval *start)
+{
+	struct timeval now, diff;
+
+	evutil_gettimeofday(&now, NULL);
+	evutil_timersub(&now, start, &diff);
+	return diff.tv_sec * 1e9 + diff.tv_usec * 1e3;
+}
+
+/* Run 'fn' on 'num_threads' threads, passing args[i] to thread i, and
+ * report how long each of 'ops_per_iteration' operations took. */
+static void
+run_workload(const char *name, void *(*fn)(void *), void **args,
+    int ops_per_iteration)
+{
+	pthread_t threads[MAX_THREADS];
+	struct timeval start;
+	double nsec;
+	int i;
+
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_threads; ++i) {
+		if (pthread_create(&threads[i], NULL, fn, args[i])) {
+			fprintf(stderr, "Couldn't start thread\n");
+			exit(1);
+		}
+	}
+	for (i = 0; i < num_threads; ++i)
+		pthread_join(threads[i], NULL);
+	nsec = elapsed_nsec(&start);
+
+	printf("  %-10s %10.1f ms %10.1f ns/op\n", name, nsec / 1e6,
+	    nsec / ((double)num_threads * num_iterations * ops_per_iteration));
+}
+
+static void
+run_all(int adaptive)
+{
+	struct event *events[MAX_THREADS];
+	void *args[MAX_THREADS];
+	int i;
+
+	if (adaptive ? evthread_use_pthreads_adaptive(max_spins) :
+	    evthread_use_pthreads()) {
+		fprintf(stderr, "Couldn't set up locking\n");
+		exit(1);
+	}
+	printf("%s locks:\n", adaptive ? "adaptive" : "pthread");
+
+	shared_buf = evbuffer_new();
+	if (!shared_buf || evbuffer_enable_locking(shared_buf, NULL) < 0) {
+		fprintf(stderr, "Couldn't create evbuffer\n");
+		exit(1);
+	}
+	for (i = 0; i < num_threads; ++i)
+		args[i] = NULL;
+	run_workload("evbuffer", evbuffer_worker, args, 3);
+	evbuffer_free(shared_buf);
+
+	shared_base = event_base_new();
+	if (!shared_base) {
+		fprintf(stderr, "Couldn't create event_base\n");
+		exit(1);
+	}
+	for (i = 0; i < num_threads; ++i) {
+		events[i] = event_new(shared_base, -1, 0, nop_cb, NULL);
+		args[i] = events[i];
+	}
+	run_workload("activate", activate_worker, args, 1);
+	for (i = 0; i < num_threads; ++i)
+		event_free(events[i]);
+	event_base_free(shared_base);
+}
+
+int
+main(int argc, char **argv)
+{
+	int c, i, status;
+	pid_t pid;
+
+	while ((c = getopt(argc, argv, "n:s:t:")) != -1) {
+		switch (c) {
+		case 'n':
+			num_iterations = atoi(optarg);
+			break;
+		case 's':
+			max_spins = atoi(optarg);
+			break;
+		case 't':
+			num_threads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_threads <= 0 || num_threads > MAX_THREADS ||
+	    num_iterations <= 0 || max_spins < 0) {
+		fprintf(stderr, "Need 1 to %d threads, at least one "
+		    "iteration, and a non-negative spin count\n", MAX_THREADS);
+		exit(1);
+	}
+
+	printf("%d threads, %d iterations each\n", num_threads,
+	    num_iterations);
+	for (i = 0; i < 2; ++i) {
+		fflush(stdout);
+		if ((pid = fork()) < 0) {
+			perror("fork");
+			exit(1);
+		} else if (pid == 0) {
+			run_all(i);
+			exit(0);
+		}
+		if (waitpid(pid, &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			exit(1);
+	}
+	exit(0);
+}
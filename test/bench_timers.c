@@ -0,0 +1,197 @@
+/*
+ * Copyright 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures how quickly we can add, delete, and fire a large
+ * number of timeouts with randomly distributed deadlines.  It reports the
+ * average cost of each operation in nanoseconds.
+ */
+
+static int fired;
+
+static void
+timer_cb(evutil_socket_t fd, short which, void *arg)
+{
+	fired++;
+}
+
+static double
+nsec_per_op(const struct timeval *start, const struct timeval *end, int n)
+{
+	struct timeval diff;
+	evutil_timersub(end, start, &diff);
+	return (diff.tv_sec * 1e9 + diff.tv_usec * 1e3) / n;
+}
+
+static void
+shuffle(int *order, int n)
+{
+	int i;
+	for (i = n - 1; i > 0; --i) {
+		int j = rand() % (i + 1);
+		int tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+}
+
+static void
+run_once(struct event_base *base, int num_timers)
+{
+	struct event *events;
+	int *order;
+	int i;
+	struct timeval start, end, tv;
+	double add_ns, del_ns, fire_ns;
+
+	events = calloc(num_timers, sizeof(struct event));
+	order = calloc(num_timers, sizeof(int));
+	if (events == NULL || order == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < num_timers; ++i) {
+		evtimer_assign(&events[i], base, timer_cb, NULL);
+		order[i] = i;
+	}
+
+	/* Add: deadlines spread over ten seconds, at usec granularity. */
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_timers; ++i) {
+		tv.tv_sec = 10 + rand() % 10;
+		tv.tv_usec = rand() % 1000000;
+		event_add(&events[i], &tv);
+	}
+	evutil_gettimeofday(&end, NULL);
+	add_ns = nsec_per_op(&start, &end, num_timers);
+
+	/* Delete, in an order unrelated to the order we added them. */
+	shuffle(order, num_timers);
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_timers; ++i)
+		event_del(&events[order[i]]);
+	evutil_gettimeofday(&end, NULL);
+	del_ns = nsec_per_op(&start, &end, num_timers);
+
+	/* Fire: schedule everything within the next few msec, wait until
+	 * it has all expired, and time how long the loop takes to run it. */
+	for (i = 0; i < num_timers; ++i) {
+		tv.tv_sec = 0;
+		tv.tv_usec = rand() % 5000;
+		event_add(&events[i], &tv);
+	}
+#ifdef WIN32
+	Sleep(20);
+#else
+	usleep(20000);
+#endif
+	fired = 0;
+	evutil_gettimeofday(&start, NULL);
+	event_base_dispatch(base);
+	evutil_gettimeofday(&end, NULL);
+	fire_ns = nsec_per_op(&start, &end, num_timers);
+	if (fired != num_timers) {
+		fprintf(stderr, "Only %d of %d timers fired\n",
+		    fired, num_timers);
+		exit(1);
+	}
+
+	fprintf(stdout, "%8d timers: add %7.1f ns  del %7.1f ns  "
+	    "fire %7.1f ns\n", num_timers, add_ns, del_ns, fire_ns);
+
+	free(order);
+	free(events);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct event_config *cfg;
+	struct event_base *base;
+	int i, c;
+	int num_timers = 100000;
+	int rounds = 3;
+
+	cfg = event_config_new();
+	if (cfg == NULL)
+		exit(1);
+
+	while ((c = getopt(argc, argv, "n:r:w")) != -1) {
+		switch (c) {
+		case 'n':
+			num_timers = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'w':
+			event_config_set_flag(cfg,
+			    EVENT_BASE_FLAG_TIMER_WHEEL);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_timers <= 0) {
+		fprintf(stderr, "Need at least one timer\n");
+		exit(1);
+	}
+
+	base = event_base_new_with_config(cfg);
+	if (base == NULL) {
+		fprintf(stderr, "Couldn't create event_base\n");
+		exit(1);
+	}
+
+	for (i = 0; i < rounds; ++i)
+		run_once(base, num_timers);
+
+	event_base_free(base);
+	event_config_free(cfg);
+	exit(0);
+}
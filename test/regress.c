@@ -780,6 +780,1204 @@ end:
 	data->base = NULL;
 }
 
+struct timer_wheel_info {
+	struct event ev;
+	struct timeval added_at;
+	struct timeval called_at;
+	int msec;
+	int count;
+};
+
+static void
+timer_wheel_cb(evutil_socket_t fd, short event, void *arg)
+{
+	struct timer_wheel_info *ti = arg;
+	++ti->count;
+	evutil_gettimeofday(&ti->called_at, NULL);
+}
+
+static void
+test_timer_wheel(void *ptr)
+{
+	struct event_base *base = NULL;
+	struct event_config *cfg = NULL;
+	struct timer_wheel_info info[200];
+	struct timer_wheel_info periodic, far;
+	struct timeval tv, tv_exit;
+	struct timeval tmp_50_ms = { 0, 50*1000 };
+	const struct timeval *ms_50;
+	int i;
+
+	memset(info, 0, sizeof(info));
+	memset(&periodic, 0, sizeof(periodic));
+	memset(&far, 0, sizeof(far));
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_TIMER_WHEEL);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+
+	ms_50 = event_base_init_common_timeout(base, &tmp_50_ms);
+	tt_assert(ms_50);
+
+	/* Spread deadlines over a few hundred msec, so that some of them
+	 * start out on the second level of the wheel and get cascaded. */
+	for (i = 0; i < 200; ++i) {
+		evtimer_assign(&info[i].ev, base, timer_wheel_cb, &info[i]);
+		evutil_gettimeofday(&info[i].added_at, NULL);
+		if (i % 10 == 0) {
+			info[i].msec = 50;
+			event_add(&info[i].ev, ms_50);
+		} else {
+			info[i].msec = (i * 37) % 400;
+			tv.tv_sec = 0;
+			tv.tv_usec = info[i].msec * 1000;
+			event_add(&info[i].ev, &tv);
+		}
+	}
+	/* Cancel some of them, and reschedule some others. */
+	for (i = 1; i < 200; i += 7) {
+		event_del(&info[i].ev);
+		info[i].msec = -1;
+	}
+	for (i = 3; i < 200; i += 11) {
+		if (info[i].msec < 0)
+			continue;
+		info[i].msec = 150;
+		tv.tv_sec = 0;
+		tv.tv_usec = 150 * 1000;
+		evutil_gettimeofday(&info[i].added_at, NULL);
+		event_add(&info[i].ev, &tv);
+	}
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 100 * 1000;
+	event_assign(&periodic.ev, base, -1, EV_PERSIST, timer_wheel_cb,
+	    &periodic);
+	event_add(&periodic.ev, &tv);
+
+	/* Further away than the wheel can represent directly. */
+	tv.tv_sec = 3*365*24*3600;
+	tv.tv_usec = 0;
+	evtimer_assign(&far.ev, base, timer_wheel_cb, &far);
+	event_add(&far.ev, &tv);
+
+	tv_exit.tv_sec = 0;
+	tv_exit.tv_usec = 550 * 1000;
+	event_base_loopexit(base, &tv_exit);
+	event_base_dispatch(base);
+
+	for (i = 0; i < 200; ++i) {
+		if (info[i].msec < 0) {
+			tt_int_op(info[i].count, ==, 0);
+			continue;
+		}
+		tt_int_op(info[i].count, ==, 1);
+		/* Never early; not very late. */
+		tt_int_op(timeval_msec_diff(&info[i].added_at,
+			&info[i].called_at), >=, info[i].msec - 1);
+		tt_int_op(timeval_msec_diff(&info[i].added_at,
+			&info[i].called_at), <=, info[i].msec + 100);
+	}
+	tt_int_op(periodic.count, >=, 4);
+	tt_int_op(periodic.count, <=, 5);
+	tt_int_op(far.count, ==, 0);
+	tt_assert(evtimer_pending(&far.ev, NULL));
+
+	/* Make sure we can free the base with some events in the wheel. */
+	for (i = 0; i < 200; i += 2) {
+		tv.tv_sec = 10;
+		tv.tv_usec = 0;
+		event_add(&info[i].ev, i % 4 ? &tv : ms_50);
+	}
+
+end:
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+struct slack_info {
+	struct event ev;
+	struct timeval added_at;
+	struct timeval called_at;
+	int msec;
+	int batch;
+	int count;
+};
+static int slack_batch;
+
+static void
+slack_cb(evutil_socket_t fd, short event, void *arg)
+{
+	struct slack_info *si = arg;
+	evutil_gettimeofday(&si->called_at, NULL);
+	si->batch = slack_batch;
+	++si->count;
+}
+
+static void
+test_timeout_slack(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct slack_info info[10], strict;
+	struct timeval tv, slack = { 0, 200*1000 };
+	int i;
+
+	memset(info, 0, sizeof(info));
+	memset(&strict, 0, sizeof(strict));
+
+	/* Deadlines from 10 to 100 msec, each with 200 msec of slack.  All
+	 * the windows include 210 msec, so one wakeup runs them all. */
+	for (i = 0; i < 10; ++i) {
+		evtimer_assign(&info[i].ev, base, slack_cb, &info[i]);
+		info[i].msec = (i + 1) * 10;
+		tv.tv_sec = 0;
+		tv.tv_usec = info[i].msec * 1000;
+		evutil_gettimeofday(&info[i].added_at, NULL);
+		tt_int_op(event_add_with_slack(&info[i].ev, &tv, &slack), ==, 0);
+	}
+	slack_batch = 1;
+	event_base_loop(base, EVLOOP_ONCE);
+
+	for (i = 0; i < 10; ++i) {
+		tt_int_op(info[i].count, ==, 1);
+		tt_int_op(info[i].batch, ==, 1);
+		/* Never early; not later than the slack allows. */
+		tt_int_op(timeval_msec_diff(&info[i].added_at,
+			&info[i].called_at), >=, info[i].msec - 1);
+		tt_int_op(timeval_msec_diff(&info[i].added_at,
+			&info[i].called_at), <=, info[i].msec + 200 + 100);
+	}
+
+	/* A timeout without slack still wakes us up on time, and takes the
+	 * slacked timeouts that are due along with it. */
+	for (i = 0; i < 10; ++i) {
+		info[i].msec = 20 + i;
+		tv.tv_sec = 0;
+		tv.tv_usec = info[i].msec * 1000;
+		evutil_gettimeofday(&info[i].added_at, NULL);
+		event_add_with_slack(&info[i].ev, &tv, &slack);
+	}
+	evtimer_assign(&strict.ev, base, slack_cb, &strict);
+	strict.msec = 50;
+	tv.tv_sec = 0;
+	tv.tv_usec = strict.msec * 1000;
+	evutil_gettimeofday(&strict.added_at, NULL);
+	event_add(&strict.ev, &tv);
+
+	slack_batch = 2;
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(strict.count, ==, 1);
+	tt_int_op(strict.batch, ==, 2);
+	tt_int_op(timeval_msec_diff(&strict.added_at, &strict.called_at),
+	    <=, strict.msec + 100);
+	for (i = 0; i < 10; ++i) {
+		tt_int_op(info[i].count, ==, 2);
+		tt_int_op(info[i].batch, ==, 2);
+	}
+
+end:
+	;
+}
+
+static void
+test_timeout_slack_args(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event ev;
+	struct timeval tv = { 10, 0 }, slack;
+
+	evtimer_assign(&ev, data->base, slack_cb, NULL);
+
+	/* No slack at all. */
+	tt_int_op(event_add_with_slack(&ev, &tv, NULL), ==, 0);
+	tt_int_op(ev.ev_slack, ==, 0);
+	event_del(&ev);
+
+	slack.tv_sec = 1;
+	slack.tv_usec = 500000;
+	tt_int_op(event_add_with_slack(&ev, &tv, &slack), ==, 0);
+	tt_int_op(ev.ev_slack, ==, 1500000);
+	event_del(&ev);
+
+	/* Negative seconds. */
+	slack.tv_sec = -1;
+	slack.tv_usec = 0;
+	tt_int_op(event_add_with_slack(&ev, &tv, &slack), ==, -1);
+	tt_assert(!event_pending(&ev, EV_TIMEOUT, NULL));
+
+	/* Negative microseconds. */
+	slack.tv_sec = 0;
+	slack.tv_usec = -1;
+	tt_int_op(event_add_with_slack(&ev, &tv, &slack), ==, -1);
+	tt_assert(!event_pending(&ev, EV_TIMEOUT, NULL));
+
+	/* A whole second or more of microseconds. */
+	slack.tv_sec = 0;
+	slack.tv_usec = 1000000;
+	tt_int_op(event_add_with_slack(&ev, &tv, &slack), ==, -1);
+	tt_assert(!event_pending(&ev, EV_TIMEOUT, NULL));
+
+end:
+	event_del(&ev);
+}
+
+static void
+test_auto_common_timeout(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct slack_info info[100], periodic;
+	struct event *evs[40];
+	struct timeval tv;
+	int i, j;
+
+	memset(info, 0, sizeof(info));
+	memset(&periodic, 0, sizeof(periodic));
+	memset(evs, 0, sizeof(evs));
+	tt_int_op(base->n_common_timeouts, ==, 0);
+
+	/* Add the same duration over and over: after a while, it should
+	 * turn into a common timeout without anybody asking. */
+	for (i = 0; i < 100; ++i) {
+		evtimer_assign(&info[i].ev, base, slack_cb, &info[i]);
+		info[i].msec = 50;
+		tv.tv_sec = 0;
+		tv.tv_usec = 50 * 1000;
+		evutil_gettimeofday(&info[i].added_at, NULL);
+		event_add(&info[i].ev, &tv);
+	}
+	tt_int_op(base->n_common_timeouts, ==, 1);
+	tt_int_op(base->n_auto_common_timeouts, ==, 1);
+
+	/* A persistent event with that duration keeps using it. */
+	tv.tv_sec = 0;
+	tv.tv_usec = 50 * 1000;
+	event_assign(&periodic.ev, base, -1, EV_PERSIST, slack_cb, &periodic);
+	event_add(&periodic.ev, &tv);
+	tt_assert(evtimer_pending(&periodic.ev, &tv));
+	tt_int_op(tv.tv_usec & 0xfff00000, ==, 0);
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 220 * 1000;
+	event_base_loopexit(base, &tv);
+	event_base_dispatch(base);
+
+	for (i = 0; i < 100; ++i) {
+		tt_int_op(info[i].count, ==, 1);
+		tt_int_op(timeval_msec_diff(&info[i].added_at,
+			&info[i].called_at), >=, info[i].msec - 1);
+		tt_int_op(timeval_msec_diff(&info[i].added_at,
+			&info[i].called_at), <=, info[i].msec + 100);
+	}
+	tt_int_op(periodic.count, >=, 3);
+	tt_int_op(periodic.count, <=, 4);
+	event_del(&periodic.ev);
+
+	/* There is a limit on how many durations we promote. */
+	for (i = 0; i < 40; ++i) {
+		evs[i] = evtimer_new(base, slack_cb, &info[0]);
+		tt_assert(evs[i]);
+		for (j = 0; j < 40; ++j) {
+			tv.tv_sec = 10 + i;
+			tv.tv_usec = 0;
+			event_add(evs[i], &tv);
+		}
+	}
+	tt_int_op(base->n_auto_common_timeouts, <=, 32);
+	tt_int_op(base->n_common_timeouts, ==, base->n_auto_common_timeouts);
+
+end:
+	for (i = 0; i < 40; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+	}
+}
+
+static void
+stats_sleep_cb(evutil_socket_t fd, short what, void *arg)
+{
+	int *count = arg;
+#ifdef WIN32
+	Sleep(2);
+#else
+	usleep(2000);
+#endif
+	++*count;
+}
+
+static void
+test_base_stats(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = NULL;
+	struct event_config *cfg = NULL;
+	struct event_base_stats stats;
+	struct event *evs[3], *timer = NULL;
+	struct timeval tv = { 0, 20*1000 };
+	ev_uint64_t n_callbacks = 0, hist_total = 0;
+	int i, count = 0;
+
+	memset(evs, 0, sizeof(evs));
+
+	/* Bases only keep statistics when asked to. */
+	tt_int_op(event_base_get_stats(data->base, &stats), ==, -1);
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_COLLECT_STATS);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+	event_base_priority_init(base, 2);
+
+	tt_int_op(event_base_get_stats(base, &stats), ==, 0);
+	tt_int_op(stats.n_dispatches, ==, 0);
+	tt_int_op(event_base_stats_percentile(&stats, 0.5), ==, 0);
+
+	for (i = 0; i < 3; ++i) {
+		evs[i] = event_new(base, -1, 0, stats_sleep_cb, &count);
+		tt_assert(evs[i]);
+		event_priority_set(evs[i], 1);
+		event_active(evs[i], EV_READ, 1);
+	}
+	timer = evtimer_new(base, stats_sleep_cb, &count);
+	tt_assert(timer);
+	event_priority_set(timer, 0);
+	event_add(timer, &tv);
+
+	event_base_dispatch(base);
+	tt_int_op(count, ==, 4);
+
+	tt_int_op(event_base_get_stats(base, &stats), ==, 0);
+	tt_int_op(stats.n_dispatches, >=, 2);
+	/* We spent most of the 20 msec timeout waiting. */
+	tt_int_op(stats.dispatch_nsec, >=, 10*1000*1000);
+	tt_int_op(stats.dispatch_max_nsec, <=, stats.dispatch_nsec);
+	tt_int_op(stats.n_callbacks[0], >=, 1);
+	tt_int_op(stats.n_callbacks[1], ==, 3);
+	tt_int_op(stats.active_nsec[1], >=, 3*2000*1000);
+	for (i = 0; i < EVENT_STATS_N_PRIORITIES; ++i)
+		n_callbacks += stats.n_callbacks[i];
+	for (i = 0; i < EVENT_STATS_HISTOGRAM_SIZE; ++i)
+		hist_total += stats.callback_hist[i];
+	tt_int_op(hist_total, ==, n_callbacks);
+	/* Every callback slept for 2 msec. */
+	tt_int_op(event_base_stats_percentile(&stats, 1.0), >=, 2000*1000);
+	tt_int_op(event_base_stats_percentile(&stats, 0.0), <=,
+	    event_base_stats_percentile(&stats, 1.0));
+
+end:
+	for (i = 0; i < 3; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+	}
+	if (timer)
+		event_free(timer);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+slow_cb(evutil_socket_t fd, short what, void *arg)
+{
+	int *count = arg;
+	if (fd >= 0) {
+#ifdef WIN32
+		Sleep(10);
+#else
+		usleep(10000);
+#endif
+	}
+	++*count;
+}
+
+static void
+test_slow_callbacks(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct event_slow_callback recs[8];
+	struct event *evs[10];
+	struct timeval threshold = { 0, 5*1000 };
+	FILE *f = NULL;
+	char buf[256];
+	int i, n, count = 0;
+
+	memset(evs, 0, sizeof(evs));
+	tt_int_op(event_base_get_slow_callbacks(base, recs, 8), ==, 0);
+	tt_int_op(event_base_set_slow_callback_threshold(base, &threshold, 0),
+	    ==, -1);
+	tt_int_op(event_base_set_slow_callback_threshold(base, &threshold, 4),
+	    ==, 0);
+
+	/* Events 0 through 5 are slow (their "fd" makes slow_cb sleep);
+	 * 6 through 9 are not. */
+	for (i = 0; i < 10; ++i) {
+		evs[i] = event_new(base, i < 6 ? i : -1, 0, slow_cb, &count);
+		tt_assert(evs[i]);
+		event_active(evs[i], i % 2 ? EV_READ : EV_TIMEOUT, 1);
+	}
+	event_base_dispatch(base);
+	tt_int_op(count, ==, 10);
+
+	/* Only the last four slow ones fit in the ring. */
+	n = event_base_get_slow_callbacks(base, recs, 8);
+	tt_int_op(n, ==, 4);
+	for (i = 0; i < 4; ++i) {
+		tt_int_op(recs[i].fd, ==, i + 2);
+		tt_assert(recs[i].callback == slow_cb);
+		tt_ptr_op(recs[i].arg, ==, &count);
+		tt_int_op(recs[i].events, ==, (i % 2) ? EV_READ : EV_TIMEOUT);
+		tt_int_op(recs[i].duration_nsec, >=, 5*1000*1000);
+	}
+	tt_int_op(event_base_get_slow_callbacks(base, recs, 2), ==, 2);
+	tt_int_op(recs[0].fd, ==, 4);
+	tt_int_op(recs[1].fd, ==, 5);
+
+	f = tmpfile();
+	tt_assert(f);
+	event_base_dump_slow_callbacks(base, f);
+	rewind(f);
+	tt_assert(fgets(buf, sizeof(buf), f));
+	tt_assert(strstr(buf, "6 recorded, last 4"));
+
+	/* Turn it off again. */
+	tt_int_op(event_base_set_slow_callback_threshold(base, NULL, 0), ==, 0);
+	tt_int_op(event_base_get_slow_callbacks(base, recs, 8), ==, 0);
+
+end:
+	if (f)
+		fclose(f);
+	for (i = 0; i < 10; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+	}
+}
+
+static void
+busy_poll_write_cb(evutil_socket_t fd, short what, void *arg)
+{
+	evutil_socket_t *socks = arg;
+	send(socks[0], "x", 1, 0);
+}
+
+static void
+busy_poll_read_cb(evutil_socket_t fd, short what, void *arg)
+{
+	char c;
+	int *count = arg;
+
+	if (recv(fd, &c, 1, 0) == 1)
+		++*count;
+}
+
+/* Run one timer that writes to a socketpair, and one read event that
+ * notices, on a base that spins for 'budget_usec'. */
+static int
+busy_poll_run(long budget_usec, ev_uint64_t *hits, ev_uint64_t *blocks)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *timer = NULL, *reader = NULL;
+	struct timeval budget = { 0, budget_usec };
+	struct timeval tv = { 0, 10*1000 };
+	evutil_socket_t socks[2] = { -1, -1 };
+	int count = 0, r = -1;
+
+	if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, socks) < 0)
+		goto end;
+	cfg = event_config_new();
+	if (!cfg)
+		goto end;
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_BUSY_POLL);
+	if (event_config_set_busy_poll_budget(cfg, &budget) < 0)
+		goto end;
+	base = event_base_new_with_config(cfg);
+	if (!base)
+		goto end;
+
+	timer = evtimer_new(base, busy_poll_write_cb, socks);
+	reader = event_new(base, socks[1], EV_READ, busy_poll_read_cb, &count);
+	if (!timer || !reader)
+		goto end;
+	event_add(timer, &tv);
+	event_add(reader, NULL);
+	event_base_dispatch(base);
+	if (count != 1)
+		goto end;
+	r = event_base_get_busy_poll_counts(base, hits, blocks);
+end:
+	if (timer)
+		event_free(timer);
+	if (reader)
+		event_free(reader);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+	if (socks[0] >= 0) {
+		EVUTIL_CLOSESOCKET(socks[0]);
+		EVUTIL_CLOSESOCKET(socks[1]);
+	}
+	return r;
+}
+
+static void
+test_busy_poll(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_config *cfg = NULL;
+	struct timeval bad = { 0, -1 };
+	ev_uint64_t hits = 0, blocks = 0;
+
+	/* Ordinary bases don't busy-poll. */
+	tt_int_op(event_base_get_busy_poll_counts(data->base, &hits, &blocks),
+	    ==, -1);
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_busy_poll_budget(cfg, &bad), ==, -1);
+	tt_int_op(event_config_set_busy_poll_budget(cfg, NULL), ==, -1);
+
+	/* With a generous budget, we spin across the timer and the write,
+	 * and never block. */
+	tt_int_op(busy_poll_run(500*1000, &hits, &blocks), ==, 0);
+	tt_int_op(hits, >=, 2);
+	tt_int_op(blocks, ==, 0);
+
+	/* With a tiny budget, we give up and wait for the timer. */
+	hits = blocks = 0;
+	tt_int_op(busy_poll_run(1, &hits, &blocks), ==, 0);
+	tt_int_op(blocks, >=, 1);
+
+end:
+	if (cfg)
+		event_config_free(cfg);
+}
+
+struct flood_info {
+	struct event *flood;
+	int n_flood;
+	int got_read;
+	int got_timer;
+};
+
+static void
+flood_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct flood_info *info = arg;
+
+	++info->n_flood;
+	if (!info->got_read || !info->got_timer)
+		event_active(info->flood, EV_TIMEOUT, 1);
+}
+
+static void
+flood_read_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct flood_info *info = arg;
+	char c;
+
+	if (recv(fd, &c, 1, 0) == 1)
+		info->got_read = 1;
+}
+
+static void
+flood_timer_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct flood_info *info = arg;
+	info->got_timer = 1;
+}
+
+/* Keep one event permanently active, and make sure that we still notice
+ * a readable socket and an expired timer. */
+static int
+max_dispatch_run(const struct timeval *max_interval, int max_callbacks)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *reader = NULL, *timer = NULL;
+	struct timeval tv = { 0, 5*1000 };
+	evutil_socket_t socks[2] = { -1, -1 };
+	struct flood_info info;
+	int r = -1;
+
+	memset(&info, 0, sizeof(info));
+	if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, socks) < 0)
+		goto end;
+	cfg = event_config_new();
+	if (!cfg)
+		goto end;
+	if (event_config_set_max_dispatch_interval(cfg, max_interval,
+		max_callbacks, 0) < 0)
+		goto end;
+	base = event_base_new_with_config(cfg);
+	if (!base)
+		goto end;
+
+	info.flood = event_new(base, -1, 0, flood_cb, &info);
+	reader = event_new(base, socks[1], EV_READ, flood_read_cb, &info);
+	timer = evtimer_new(base, flood_timer_cb, &info);
+	if (!info.flood || !reader || !timer)
+		goto end;
+	event_add(reader, NULL);
+	event_add(timer, &tv);
+	event_active(info.flood, EV_TIMEOUT, 1);
+	send(socks[0], "x", 1, 0);
+	event_base_dispatch(base);
+	if (info.got_read && info.got_timer && info.n_flood > 1)
+		r = 0;
+end:
+	if (info.flood)
+		event_free(info.flood);
+	if (reader)
+		event_free(reader);
+	if (timer)
+		event_free(timer);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+	if (socks[0] >= 0) {
+		EVUTIL_CLOSESOCKET(socks[0]);
+		EVUTIL_CLOSESOCKET(socks[1]);
+	}
+	return r;
+}
+
+static void
+test_max_dispatch(void *ptr)
+{
+	struct event_config *cfg = NULL;
+	struct timeval bad = { -1, 0 };
+	struct timeval interval = { 0, 1000 };
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_max_dispatch_interval(cfg, &bad, 0, 0),
+	    ==, -1);
+	tt_int_op(event_config_set_max_dispatch_interval(cfg, NULL, 1, -1),
+	    ==, -1);
+
+	/* Without a limit, these would never return. */
+	tt_int_op(max_dispatch_run(NULL, 4), ==, 0);
+	tt_int_op(max_dispatch_run(&interval, 0), ==, 0);
+
+end:
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+cache_once_cb(evutil_socket_t fd, short what, void *arg)
+{
+	int *count = arg;
+	++*count;
+}
+
+static void
+test_object_cache(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event_object_cache_stats stats;
+	struct event *evs[10], *first;
+	int i, count = 0;
+
+	memset(evs, 0, sizeof(evs));
+
+	/* Bases don't cache unless asked to. */
+	tt_int_op(event_base_get_object_cache_stats(data->base, &stats),
+	    ==, -1);
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_object_cache(cfg, -1), ==, -1);
+	tt_int_op(event_config_set_object_cache(cfg, 4), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+
+	for (i = 0; i < 10; ++i) {
+		evs[i] = event_new(base, -1, 0, cache_once_cb, &count);
+		tt_assert(evs[i]);
+	}
+	first = evs[9];
+	for (i = 9; i >= 0; --i) {
+		event_free(evs[i]);
+		evs[i] = NULL;
+	}
+	tt_int_op(event_base_get_object_cache_stats(base, &stats), ==, 0);
+	tt_int_op(stats.events_allocated, ==, 10);
+	tt_int_op(stats.events_reused, ==, 0);
+	tt_int_op(stats.events_cached, ==, 4);
+
+	/* Cached events come back, most recently cached first, and work as
+	 * new. */
+	for (i = 0; i < 6; ++i) {
+		evs[i] = event_new(base, -1, 0, cache_once_cb, &count);
+		tt_assert(evs[i]);
+	}
+	tt_assert(evs[3] == first);
+	event_active(evs[5], EV_READ, 1);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(count, ==, 1);
+	tt_int_op(event_base_get_object_cache_stats(base, &stats), ==, 0);
+	tt_int_op(stats.events_allocated, ==, 16);
+	tt_int_op(stats.events_reused, ==, 4);
+	tt_int_op(stats.events_cached, ==, 0);
+
+	/* event_base_once reuses its bookkeeping too. */
+	for (i = 0; i < 3; ++i) {
+		tt_int_op(event_base_once(base, -1, EV_TIMEOUT, cache_once_cb,
+			&count, NULL), ==, 0);
+		event_base_dispatch(base);
+	}
+	tt_int_op(count, ==, 4);
+	tt_int_op(event_base_get_object_cache_stats(base, &stats), ==, 0);
+	tt_int_op(stats.once_allocated, ==, 3);
+	tt_int_op(stats.once_reused, ==, 2);
+	tt_int_op(stats.once_cached, ==, 1);
+
+end:
+	for (i = 0; i < 10; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+	}
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+evmap_growth_cb(evutil_socket_t fd, short what, void *arg)
+{
+	int *count = arg;
+	char c;
+
+	if (recv(fd, &c, 1, 0) == 1)
+		++*count;
+}
+
+static void
+evmap_growth_count_cb(evutil_socket_t fd, short what, void *arg)
+{
+	int *count = arg;
+	++*count;
+}
+
+#define N_GROWTH_PAIRS 80
+static void
+test_evmap_growth(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	evutil_socket_t socks[N_GROWTH_PAIRS][2];
+	struct event *evs[N_GROWTH_PAIRS], *extra[2] = { NULL, NULL };
+	int i, count = 0, extra_count = 0;
+
+	memset(evs, 0, sizeof(evs));
+	for (i = 0; i < N_GROWTH_PAIRS; ++i)
+		socks[i][0] = socks[i][1] = -1;
+
+	/* Add events as we go, so that the fd map grows (and moves) while
+	 * it holds events, including an fd with more than one event. */
+	for (i = 0; i < N_GROWTH_PAIRS; ++i) {
+		tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0,
+			socks[i]), ==, 0);
+		evs[i] = event_new(base, socks[i][1], EV_READ|EV_PERSIST,
+		    evmap_growth_cb, &count);
+		tt_assert(evs[i]);
+		tt_int_op(event_add(evs[i], NULL), ==, 0);
+		if (i == 0) {
+			extra[0] = event_new(base, socks[0][1], EV_READ,
+			    evmap_growth_count_cb, &extra_count);
+			extra[1] = event_new(base, socks[0][1], EV_WRITE,
+			    evmap_growth_count_cb, &extra_count);
+			tt_assert(extra[0] && extra[1]);
+			event_add(extra[0], NULL);
+			event_add(extra[1], NULL);
+		}
+	}
+
+	/* Take one of the extra events on the first fd away again. */
+	event_del(extra[0]);
+	for (i = 0; i < N_GROWTH_PAIRS; ++i)
+		send(socks[i][0], "x", 1, 0);
+	/* A backend may report only some of the fds per dispatch. */
+	for (i = 0; i < 10 && count < N_GROWTH_PAIRS; ++i)
+		event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(count, ==, N_GROWTH_PAIRS);
+	tt_int_op(extra_count, ==, 1);
+
+	/* Deleting and re-adding still works after the map has grown. */
+	for (i = 0; i < N_GROWTH_PAIRS; i += 2)
+		event_del(evs[i]);
+	for (i = 0; i < N_GROWTH_PAIRS; ++i)
+		send(socks[i][0], "x", 1, 0);
+	for (i = 0; i < 10 && count < N_GROWTH_PAIRS * 3 / 2; ++i)
+		event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(count, ==, N_GROWTH_PAIRS + N_GROWTH_PAIRS / 2);
+
+end:
+	for (i = 0; i < N_GROWTH_PAIRS; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+		if (socks[i][0] >= 0) {
+			EVUTIL_CLOSESOCKET(socks[i][0]);
+			EVUTIL_CLOSESOCKET(socks[i][1]);
+		}
+	}
+	if (extra[0])
+		event_free(extra[0]);
+	if (extra[1])
+		event_free(extra[1]);
+}
+
+static void
+test_size_hints(void *ptr)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *evs[64];
+	struct timeval tv = { 0, 1000 };
+	int i, count = 0;
+
+	memset(evs, 0, sizeof(evs));
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_size_hints(cfg, -1, 0, 0), ==, -1);
+	tt_int_op(event_config_set_size_hints(cfg, 1000, 500, 8192), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+
+#ifndef EVMAP_USE_HT
+	tt_int_op(base->io.nentries, >=, 1000);
+#endif
+	tt_int_op(base->timeheap.a, >=, 500);
+	tt_int_op(base->events_per_wakeup_hint, ==, 8192);
+
+	/* The base works as usual. */
+	for (i = 0; i < 64; ++i) {
+		evs[i] = evtimer_new(base, evmap_growth_count_cb, &count);
+		tt_assert(evs[i]);
+		evtimer_add(evs[i], &tv);
+	}
+	event_base_dispatch(base);
+	tt_int_op(count, ==, 64);
+
+end:
+	for (i = 0; i < 64; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+	}
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+struct coarse_time_info {
+	struct event_base *base;
+	struct timeval called_at;
+	struct timeval wall_cached;
+	struct timeval wall_real;
+};
+
+static void
+coarse_time_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct coarse_time_info *info = arg;
+
+	evutil_gettimeofday(&info->called_at, NULL);
+	event_base_get_wallclock_cached(info->base, &info->wall_cached);
+	evutil_gettimeofday(&info->wall_real, NULL);
+}
+
+static void
+test_coarse_time(void *ptr)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *ev = NULL;
+	struct coarse_time_info info;
+	struct timeval tv = { 0, 50*1000 }, started, now, real;
+
+	memset(&info, 0, sizeof(info));
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_COARSE_TIME);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_COARSE)
+	TT_BLATHER(("coarse clock %s", base->coarse_clock ? "on" : "off"));
+#endif
+
+	/* Outside the loop there is no cached time; we ask the kernel. */
+	tt_int_op(event_base_get_wallclock_cached(base, &now), ==, 0);
+	evutil_gettimeofday(&real, NULL);
+	tt_int_op(labs(timeval_msec_diff(&now, &real)), <=, 1000);
+
+	/* Timeouts still fire on time, give or take a clock tick. */
+	info.base = base;
+	ev = evtimer_new(base, coarse_time_cb, &info);
+	tt_assert(ev);
+	evutil_gettimeofday(&started, NULL);
+	evtimer_add(ev, &tv);
+	event_base_dispatch(base);
+
+	tt_int_op(timeval_msec_diff(&started, &info.called_at), >=, 30);
+	tt_int_op(timeval_msec_diff(&started, &info.called_at), <=, 500);
+	/* Inside the loop, the cached wall clock is no more than the clock
+	 * tick and the time since the loop woke up behind the real one. */
+	tt_int_op(labs(timeval_msec_diff(&info.wall_cached,
+			&info.wall_real)), <=, 1000);
+
+end:
+	if (ev)
+		event_free(ev);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+trace_read_cb(evutil_socket_t fd, short what, void *arg)
+{
+	char c;
+	if (recv(fd, &c, 1, 0) == 1)
+		++*(int *)arg;
+}
+
+static void
+trace_timer_cb(evutil_socket_t fd, short what, void *arg)
+{
+	++*(int *)arg;
+}
+
+/* Read a trace from 'fd' into 'hdr' and 'records'.  Returns the number of
+ * records in the file, or -1. */
+static int
+trace_read_back(int fd, struct event_trace_header *hdr,
+    struct event_trace_record *records, int max_records)
+{
+	int n;
+
+	if (lseek(fd, 0, SEEK_SET) < 0 ||
+	    read(fd, hdr, sizeof(*hdr)) != sizeof(*hdr))
+		return -1;
+	n = (int)hdr->n_records;
+	if (n > max_records)
+		n = max_records;
+	if (read(fd, records, n * sizeof(*records)) !=
+	    (int)(n * sizeof(*records)))
+		return -1;
+	return n;
+}
+
+static void
+test_trace(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct event_trace_header hdr;
+	struct event_trace_record records[64];
+	struct event *rev = NULL, *tev = NULL;
+	struct timeval tv = { 0, 1000 };
+	int seen[EVENT_TRACE_DEFERRED + 1];
+	int fd = -1, i, n, n_called = 0;
+#ifndef WIN32
+	char path[32];
+	int mapfd = -1;
+#endif
+
+	memset(seen, 0, sizeof(seen));
+	tt_int_op(event_base_trace_start(base, 0, NULL), ==, -1);
+	fd = regress_make_tmpfile("", 0);
+	tt_int_op(fd, >=, 0);
+	tt_int_op(event_base_trace_flush(base, fd), ==, -1);
+
+	tt_int_op(event_base_trace_start(base, 64, NULL), ==, 0);
+	rev = event_new(base, data->pair[1], EV_READ, trace_read_cb,
+	    &n_called);
+	tev = evtimer_new(base, trace_timer_cb, &n_called);
+	tt_assert(rev && tev);
+	event_add(rev, NULL);
+	evtimer_add(tev, &tv);
+	tt_int_op(send(data->pair[0], "x", 1, 0), ==, 1);
+	event_base_dispatch(base);
+	tt_int_op(n_called, ==, 2);
+
+	tt_int_op(event_base_trace_flush(base, fd), ==, 0);
+	n = trace_read_back(fd, &hdr, records, 64);
+	tt_int_op(n, >, 0);
+	tt_assert(!memcmp(hdr.magic, EVENT_TRACE_MAGIC, 8));
+	tt_int_op(hdr.record_size, ==, sizeof(struct event_trace_record));
+	tt_int_op(hdr.n_written, ==, hdr.n_records);
+	for (i = 0; i < n; ++i) {
+		tt_int_op(records[i].type, >=, EVENT_TRACE_LOOP);
+		tt_int_op(records[i].type, <=, EVENT_TRACE_DEFERRED);
+		++seen[records[i].type];
+		if (i)
+			tt_assert(records[i].nsec >= records[i-1].nsec);
+		if (records[i].type == EVENT_TRACE_FD_ACTIVE)
+			tt_int_op(records[i].fd, ==, data->pair[1]);
+		if (records[i].type == EVENT_TRACE_CALLBACK_END)
+			tt_assert(records[i].value <= records[i].nsec);
+	}
+	tt_int_op(seen[EVENT_TRACE_LOOP], >=, 1);
+	tt_int_op(seen[EVENT_TRACE_DISPATCH], >=, 1);
+	tt_int_op(seen[EVENT_TRACE_FD_ACTIVE], ==, 1);
+	tt_int_op(seen[EVENT_TRACE_TIMER], ==, 1);
+	tt_int_op(seen[EVENT_TRACE_CALLBACK_BEGIN], ==, 2);
+	tt_int_op(seen[EVENT_TRACE_CALLBACK_END], ==, 2);
+
+	/* Flushing empties the ring. */
+	tt_int_op(ftruncate(fd, 0), ==, 0);
+	tt_int_op(lseek(fd, 0, SEEK_SET), ==, 0);
+	tt_int_op(event_base_trace_flush(base, fd), ==, 0);
+	tt_int_op(trace_read_back(fd, &hdr, records, 64), ==, 0);
+	tt_assert(!memcmp(hdr.magic, EVENT_TRACE_MAGIC, 8));
+	tt_int_op(hdr.n_written, ==, 0);
+
+	/* A small ring keeps only the newest records, oldest first. */
+	tt_int_op(event_base_trace_start(base, 4, NULL), ==, 0);
+	for (i = 0; i < 3; ++i) {
+		evtimer_add(tev, &tv);
+		event_base_dispatch(base);
+	}
+	tt_int_op(ftruncate(fd, 0), ==, 0);
+	tt_int_op(lseek(fd, 0, SEEK_SET), ==, 0);
+	tt_int_op(event_base_trace_flush(base, fd), ==, 0);
+	tt_int_op(trace_read_back(fd, &hdr, records, 64), ==, 4);
+	tt_int_op(hdr.n_written, ==, 4);
+	/* The last iteration finds that there is nothing left to do. */
+	tt_int_op(records[2].type, ==, EVENT_TRACE_CALLBACK_END);
+	tt_int_op(records[3].type, ==, EVENT_TRACE_LOOP);
+	event_base_trace_stop(base);
+	tt_int_op(event_base_trace_flush(base, fd), ==, -1);
+
+#ifndef WIN32
+	/* A trace mapped from a file can be read while it is running. */
+	strcpy(path, "/tmp/evtrace.XXXXXX");
+	mapfd = mkstemp(path);
+	tt_int_op(mapfd, >=, 0);
+	tt_int_op(event_base_trace_start(base, 64, path), ==, 0);
+	evtimer_add(tev, &tv);
+	event_base_dispatch(base);
+	n = trace_read_back(mapfd, &hdr, records, 64);
+	tt_int_op(n, ==, 64);
+	tt_int_op(hdr.n_records, ==, 64);
+	tt_int_op(hdr.n_written, >, 0);
+	tt_int_op(records[0].type, ==, EVENT_TRACE_LOOP);
+	event_base_trace_stop(base);
+#endif
+
+end:
+	event_base_trace_stop(base);
+	if (rev)
+		event_free(rev);
+	if (tev)
+		event_free(tev);
+	if (fd >= 0)
+		close(fd);
+#ifndef WIN32
+	if (mapfd >= 0) {
+		close(mapfd);
+		unlink(path);
+	}
+#endif
+}
+
+static void
+batch_timeout_cb(evutil_socket_t fd, short what, void *arg)
+{
+	int *count = arg;
+	++*count;
+}
+
+static void
+batch_early_cb(evutil_socket_t fd, short what, void *arg)
+{
+	int *count = arg;
+	/* Nothing from the batch has fired yet. */
+	*count = -1000;
+}
+
+#define N_BATCH 200
+static void
+test_event_batch(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct event_base *other = NULL;
+	struct event *evs[N_BATCH], *odd[N_BATCH / 2];
+	struct event *early = NULL, *stranger = NULL, *pair[2];
+	struct timeval tv_early = { 0, 1000 }, tv = { 0, 50000 };
+	int i, count = 0, early_count = 0;
+
+	memset(evs, 0, sizeof(evs));
+	for (i = 0; i < N_BATCH; ++i) {
+		evs[i] = evtimer_new(base, batch_timeout_cb, &count);
+		tt_assert(evs[i]);
+	}
+	early = evtimer_new(base, batch_early_cb, &early_count);
+	tt_assert(early);
+
+	/* Batches that are large next to the heap reorder the whole heap;
+	 * the earliest timeout has to stay on top. */
+	tt_int_op(event_add(early, &tv_early), ==, 0);
+	tt_int_op(event_add_batch(evs, N_BATCH, &tv), ==, 0);
+	for (i = 0; i < N_BATCH; ++i)
+		tt_assert(event_pending(evs[i], EV_TIMEOUT, NULL));
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(early_count, ==, -1000);
+	tt_int_op(count, ==, 0);
+
+	/* Delete every other event, and re-add a few so the heap is mixed
+	 * with events that already had timeouts. */
+	for (i = 0; i < N_BATCH / 2; ++i)
+		odd[i] = evs[2 * i + 1];
+	tt_int_op(event_del_batch(odd, N_BATCH / 2), ==, 0);
+	for (i = 0; i < N_BATCH / 2; ++i)
+		tt_assert(!event_pending(odd[i], EV_TIMEOUT, NULL));
+	tt_int_op(event_add_batch(odd, 10, &tv), ==, 0);
+	event_base_dispatch(base);
+	tt_int_op(count, ==, N_BATCH / 2 + 10);
+
+	/* Events on different bases can't share a batch. */
+	other = event_base_new();
+	tt_assert(other);
+	stranger = evtimer_new(other, batch_timeout_cb, &count);
+	tt_assert(stranger);
+	pair[0] = early;
+	pair[1] = stranger;
+	tt_int_op(event_add_batch(pair, 2, &tv), ==, -1);
+	tt_assert(!event_pending(early, EV_TIMEOUT, NULL));
+	tt_int_op(event_add_batch(pair, 0, &tv), ==, 0);
+
+end:
+	for (i = 0; i < N_BATCH; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+	}
+	if (early)
+		event_free(early);
+	if (stranger)
+		event_free(stranger);
+	if (other)
+		event_base_free(other);
+}
+
 #ifndef WIN32
 static void signal_cb(evutil_socket_t fd, short event, void *arg);
 
@@ -1166,6 +2364,215 @@ test_signal_while_processing(void)
 	cleanup_test();
 	return;
 }
+
+static struct event_base *
+signalfd_base_new(void)
+{
+	struct event_config *cfg;
+	struct event_base *base;
+
+	cfg = event_config_new();
+	if (!cfg)
+		return NULL;
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_SIGNALFD);
+	base = event_base_new_with_config(cfg);
+	event_config_free(cfg);
+	return base;
+}
+
+static void
+signalfd_count_cb(evutil_socket_t sig, short what, void *arg)
+{
+	int *count = arg;
+	++*count;
+}
+
+static void
+test_signalfd_basic(void *ptr)
+{
+	struct event_base *base;
+	struct event *ev = NULL;
+	int count = 0;
+	sigset_t mask;
+
+	base = signalfd_base_new();
+	tt_assert(base);
+	ev = evsignal_new(base, SIGUSR1, signalfd_count_cb, &count);
+	tt_assert(ev);
+	tt_int_op(evsignal_add(ev, NULL), ==, 0);
+
+	raise(SIGUSR1);
+	raise(SIGUSR1);
+	event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+#ifdef EVSIG_USE_SIGNALFD
+	if (base->sig.ev_signalfd != -1) {
+		/* The signal was blocked, so the two raises coalesced. */
+		tt_int_op(count, ==, 1);
+		sigprocmask(SIG_BLOCK, NULL, &mask);
+		tt_int_op(sigismember(&mask, SIGUSR1), ==, 1);
+	}
+#endif
+	tt_int_op(count, >=, 1);
+
+	/* Once nobody is watching it, the signal must be unblocked again. */
+	event_free(ev);
+	ev = NULL;
+	sigprocmask(SIG_BLOCK, NULL, &mask);
+	tt_int_op(sigismember(&mask, SIGUSR1), ==, 0);
+
+end:
+	if (ev)
+		event_free(ev);
+	if (base)
+		event_base_free(base);
+}
+
+struct sigchld_storm {
+	struct event_base *base;
+	int n_children;
+	int n_reaped;
+	int n_callbacks;
+};
+
+static void
+sigchld_storm_cb(evutil_socket_t sig, short what, void *arg)
+{
+	struct sigchld_storm *st = arg;
+	int status;
+
+	++st->n_callbacks;
+	while (waitpid(-1, &status, WNOHANG) > 0)
+		++st->n_reaped;
+	if (st->n_reaped == st->n_children)
+		event_base_loopexit(st->base, NULL);
+}
+
+static void
+test_signalfd_sigchld_storm(void *ptr)
+{
+	struct sigchld_storm st;
+	struct event *ev = NULL;
+	struct timeval tv = { 10, 0 };
+	int i;
+
+	memset(&st, 0, sizeof(st));
+	st.n_children = 64;
+	st.base = signalfd_base_new();
+	tt_assert(st.base);
+	ev = evsignal_new(st.base, SIGCHLD, sigchld_storm_cb, &st);
+	tt_assert(ev);
+	tt_int_op(evsignal_add(ev, NULL), ==, 0);
+
+	for (i = 0; i < st.n_children; ++i) {
+		pid_t pid = fork();
+		if (pid == 0)
+			_exit(0);
+		tt_int_op(pid, >, 0);
+	}
+
+	event_base_loopexit(st.base, &tv);
+	event_base_dispatch(st.base);
+
+	tt_int_op(st.n_reaped, ==, st.n_children);
+	TT_BLATHER(("%d children reaped in %d callbacks",
+		st.n_reaped, st.n_callbacks));
+end:
+	if (ev)
+		event_free(ev);
+	if (st.base)
+		event_base_free(st.base);
+}
+
+#ifdef EVSIG_USE_SIGNALFD
+static void
+test_signalfd_two_bases(void *ptr)
+{
+	struct event_base *base1, *base2 = NULL;
+	struct event *ev1 = NULL, *ev2 = NULL;
+	int count1 = 0, count2 = 0;
+
+	/* With signalfd, each base gets its own signals; unlike with the
+	 * signal handler, adding a signal to base2 does not steal signals
+	 * from base1. */
+	base1 = signalfd_base_new();
+	base2 = signalfd_base_new();
+	tt_assert(base1);
+	tt_assert(base2);
+	if (base1->sig.ev_signalfd == -1 || base2->sig.ev_signalfd == -1)
+		tt_skip();
+
+	ev1 = evsignal_new(base1, SIGUSR1, signalfd_count_cb, &count1);
+	ev2 = evsignal_new(base2, SIGUSR2, signalfd_count_cb, &count2);
+	tt_int_op(evsignal_add(ev1, NULL), ==, 0);
+	tt_int_op(evsignal_add(ev2, NULL), ==, 0);
+
+	raise(SIGUSR2);
+	raise(SIGUSR1);
+	event_base_loop(base1, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	event_base_loop(base2, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	tt_int_op(count1, ==, 1);
+	tt_int_op(count2, ==, 1);
+
+end:
+	if (ev1)
+		event_free(ev1);
+	if (ev2)
+		event_free(ev2);
+	if (base1)
+		event_base_free(base1);
+	if (base2)
+		event_base_free(base2);
+}
+
+static void
+test_signalfd_shared_signal(void *ptr)
+{
+	struct event_base *base1, *base2 = NULL;
+	struct event *ev1 = NULL, *ev2 = NULL;
+	int count1 = 0, count2 = 0;
+	sigset_t mask;
+
+	/* Two bases watch the same signal.  When the first stops, the
+	 * signal must stay blocked for the second, or the next one would
+	 * kill us. */
+	base1 = signalfd_base_new();
+	base2 = signalfd_base_new();
+	tt_assert(base1);
+	tt_assert(base2);
+	if (base1->sig.ev_signalfd == -1 || base2->sig.ev_signalfd == -1)
+		tt_skip();
+
+	ev1 = evsignal_new(base1, SIGUSR1, signalfd_count_cb, &count1);
+	ev2 = evsignal_new(base2, SIGUSR1, signalfd_count_cb, &count2);
+	tt_int_op(evsignal_add(ev1, NULL), ==, 0);
+	tt_int_op(evsignal_add(ev2, NULL), ==, 0);
+
+	event_free(ev1);
+	ev1 = NULL;
+	sigprocmask(SIG_BLOCK, NULL, &mask);
+	tt_int_op(sigismember(&mask, SIGUSR1), ==, 1);
+
+	raise(SIGUSR1);
+	event_base_loop(base2, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	tt_int_op(count2, ==, 1);
+	tt_int_op(count1, ==, 0);
+
+	event_free(ev2);
+	ev2 = NULL;
+	sigprocmask(SIG_BLOCK, NULL, &mask);
+	tt_int_op(sigismember(&mask, SIGUSR1), ==, 0);
+
+end:
+	if (ev1)
+		event_free(ev1);
+	if (ev2)
+		event_free(ev2);
+	if (base1)
+		event_base_free(base1);
+	if (base2)
+		event_base_free(base2);
+}
+#endif
 #endif
 
 static void
@@ -2279,6 +3686,20 @@ struct testcase_t main_testcases[] = {
 	LEGACY(priorities, TT_FORK|TT_NEED_BASE),
 	{ "common_timeout", test_common_timeout, TT_FORK|TT_NEED_BASE,
 	  &basic_setup, NULL },
+	{ "timer_wheel", test_timer_wheel, TT_FORK, &basic_setup, NULL },
+	BASIC(timeout_slack, TT_FORK|TT_NEED_BASE),
+	BASIC(timeout_slack_args, TT_FORK|TT_NEED_BASE|TT_NO_LOGS),
+	BASIC(auto_common_timeout, TT_FORK|TT_NEED_BASE),
+	BASIC(base_stats, TT_FORK|TT_NEED_BASE),
+	BASIC(slow_callbacks, TT_FORK|TT_NEED_BASE),
+	BASIC(busy_poll, TT_FORK|TT_NEED_BASE),
+	BASIC(max_dispatch, TT_FORK|TT_NEED_BASE),
+	BASIC(object_cache, TT_FORK|TT_NEED_BASE),
+	BASIC(evmap_growth, TT_FORK|TT_NEED_BASE),
+	BASIC(size_hints, TT_FORK),
+	BASIC(coarse_time, TT_FORK),
+	BASIC(trace, TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR),
+	BASIC(event_batch, TT_FORK|TT_NEED_BASE),
 
 	/* These legacy tests may not all need all of these flags. */
 	LEGACY(simpleread, TT_ISOLATED),
@@ -2333,6 +3754,14 @@ struct testcase_t signal_testcases[] = {
 	LEGACY(signal_restore, TT_ISOLATED),
 	LEGACY(signal_assert, TT_ISOLATED),
 	LEGACY(signal_while_processing, TT_ISOLATED),
+	{ "signalfd_basic", test_signalfd_basic, TT_FORK, NULL, NULL },
+	{ "signalfd_sigchld_storm", test_signalfd_sigchld_storm, TT_FORK,
+	  NULL, NULL },
+#ifdef EVSIG_USE_SIGNALFD
+	{ "signalfd_two_bases", test_signalfd_two_bases, TT_FORK, NULL, NULL },
+	{ "signalfd_shared_signal", test_signalfd_shared_signal, TT_FORK,
+	  NULL, NULL },
+#endif
 #endif
 	END_OF_TESTCASES
 };
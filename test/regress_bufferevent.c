@@ -771,6 +771,238 @@ end:
 		bufferevent_free(bev2);
 }
 
+/* Push a good-sized block of data through a socketpair in both directions
+ * at once, then close the writers and make sure that the readers see EOF
+ * only after they have received every byte, in order. */
+#define BULK_LEN (1024*1024)
+#ifdef WIN32
+#define SHUT_WR SD_SEND
+#endif
+
+struct bulk_state {
+	struct event_base *base;
+	size_t n_read;
+	int got_eof;
+	int mismatch;
+	int *n_eof;
+};
+
+static void
+bulk_readcb(struct bufferevent *bev, void *arg)
+{
+	struct bulk_state *st = arg;
+	unsigned char buf[4096];
+	size_t i, n;
+
+	while ((n = bufferevent_read(bev, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; ++i) {
+			if (buf[i] != (unsigned char)((st->n_read + i) % 251))
+				st->mismatch = 1;
+		}
+		st->n_read += n;
+	}
+}
+
+static void
+bulk_writecb(struct bufferevent *bev, void *arg)
+{
+	/* Everything is flushed; stop sending, so the other side sees
+	 * EOF once it has read it all. */
+	if (evbuffer_get_length(bufferevent_get_output(bev)) == 0)
+		shutdown(bufferevent_getfd(bev), SHUT_WR);
+}
+
+static void
+bulk_eventcb(struct bufferevent *bev, short what, void *arg)
+{
+	struct bulk_state *st = arg;
+
+	if (what & BEV_EVENT_EOF) {
+		++st->got_eof;
+		if (++*st->n_eof == 2)
+			event_base_loopexit(st->base, NULL);
+	} else {
+		TT_FAIL(("Unexpected event %d", (int)what));
+		event_base_loopexit(st->base, NULL);
+	}
+}
+
+static void
+test_bufferevent_bulk(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct bufferevent *bev1 = NULL, *bev2 = NULL;
+	struct bulk_state st1, st2;
+	int n_eof = 0;
+	unsigned char *block = NULL;
+	const char *flags = data->setup_data;
+	int use_uring = strstr(flags, "uring") != NULL;
+	int opts = strstr(flags, "lock") ? BEV_OPT_THREADSAFE : 0;
+	size_t i;
+
+	memset(&st1, 0, sizeof(st1));
+	memset(&st2, 0, sizeof(st2));
+	st1.base = st2.base = data->base;
+	st1.n_eof = st2.n_eof = &n_eof;
+
+	block = malloc(BULK_LEN);
+	tt_assert(block);
+	for (i = 0; i < BULK_LEN; ++i)
+		block[i] = (unsigned char)(i % 251);
+
+	bev1 = bufferevent_socket_new(data->base, data->pair[0], opts);
+	bev2 = bufferevent_socket_new(data->base, data->pair[1], opts);
+	tt_assert(bev1);
+	tt_assert(bev2);
+	if (use_uring) {
+		tt_assert(BEV_IS_URING(bev1));
+		tt_assert(BEV_IS_URING(bev2));
+	}
+
+	bufferevent_setcb(bev1, bulk_readcb, bulk_writecb, bulk_eventcb, &st1);
+	bufferevent_setcb(bev2, bulk_readcb, bulk_writecb, bulk_eventcb, &st2);
+	/* Make one side stop and start reading as it goes. */
+	bufferevent_setwatermark(bev2, EV_READ, 0, 65536);
+	bufferevent_enable(bev1, EV_READ|EV_WRITE);
+	bufferevent_enable(bev2, EV_READ|EV_WRITE);
+
+	tt_int_op(bufferevent_write(bev1, block, BULK_LEN), ==, 0);
+	tt_int_op(bufferevent_write(bev2, block, BULK_LEN), ==, 0);
+
+	event_base_dispatch(data->base);
+
+	tt_int_op(st1.n_read, ==, BULK_LEN);
+	tt_int_op(st2.n_read, ==, BULK_LEN);
+	tt_assert(!st1.mismatch);
+	tt_assert(!st2.mismatch);
+	tt_int_op(st1.got_eof, ==, 1);
+	tt_int_op(st2.got_eof, ==, 1);
+
+end:
+	if (bev1)
+		bufferevent_free(bev1);
+	if (bev2)
+		bufferevent_free(bev2);
+	if (block)
+		free(block);
+}
+
+#ifndef _EVENT_DISABLE_MM_REPLACEMENT
+struct counting_mm {
+	int n_malloc;
+	int n_outstanding;
+};
+
+static void *
+counting_malloc(size_t sz, void *arg)
+{
+	struct counting_mm *c = arg;
+	++c->n_malloc;
+	++c->n_outstanding;
+	return malloc(sz);
+}
+
+static void *
+counting_realloc(void *p, size_t sz, void *arg)
+{
+	struct counting_mm *c = arg;
+	if (!p) {
+		++c->n_malloc;
+		++c->n_outstanding;
+	}
+	return realloc(p, sz);
+}
+
+static void
+counting_free(void *p, void *arg)
+{
+	struct counting_mm *c = arg;
+	--c->n_outstanding;
+	free(p);
+}
+
+static void
+base_mm_nop_cb(evutil_socket_t fd, short what, void *arg)
+{
+}
+
+static void
+base_mm_readcb(struct bufferevent *bev, void *arg)
+{
+	size_t *n_read = arg;
+	char buf[1024];
+	size_t n;
+
+	while ((n = bufferevent_read(bev, buf, sizeof(buf))) > 0)
+		*n_read += n;
+}
+
+static void
+test_bufferevent_base_mm(void *arg)
+{
+	struct counting_mm counts = { 0, 0 };
+	struct event_mem_functions mm = {
+		counting_malloc, counting_realloc, counting_free, NULL
+	};
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct bufferevent *pair[2] = { NULL, NULL };
+	struct event *ev = NULL;
+	char block[4096];
+	size_t n_read = 0;
+	int i, n_base;
+
+	mm.arg = &counts;
+	memset(block, 'x', sizeof(block));
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_mem_functions(cfg, &mm), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+	tt_int_op(counts.n_malloc, >=, 1); /* the base itself */
+
+	n_base = counts.n_malloc;
+	ev = event_new(base, -1, 0, base_mm_nop_cb, NULL);
+	tt_assert(ev);
+	tt_int_op(counts.n_malloc, ==, n_base + 1);
+	event_free(ev);
+	ev = NULL;
+	tt_int_op(counts.n_outstanding, ==, n_base);
+
+	/* The bufferevents, and the data passing through them, come out
+	 * of the base's allocator. */
+	tt_int_op(bufferevent_pair_new(base, 0, pair), ==, 0);
+	tt_int_op(counts.n_outstanding, ==, n_base + 2);
+	bufferevent_setcb(pair[1], base_mm_readcb, NULL, NULL, &n_read);
+	bufferevent_enable(pair[1], EV_READ);
+	for (i = 0; i < 16; ++i)
+		bufferevent_write(pair[0], block, sizeof(block));
+	tt_int_op(counts.n_outstanding, >, n_base + 2);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(n_read, ==, 16 * sizeof(block));
+
+	bufferevent_free(pair[0]);
+	bufferevent_free(pair[1]);
+	pair[0] = pair[1] = NULL;
+	event_base_free(base);
+	base = NULL;
+	tt_int_op(counts.n_outstanding, ==, 0);
+
+end:
+	if (ev)
+		event_free(ev);
+	if (pair[0])
+		bufferevent_free(pair[0]);
+	if (pair[1])
+		bufferevent_free(pair[1]);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+#endif
+
 struct testcase_t bufferevent_testcases[] = {
 
 	LEGACY(bufferevent, TT_ISOLATED),
@@ -795,12 +1027,18 @@ struct testcase_t bufferevent_testcases[] = {
 	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
 	{ "bufferevent_timeout", test_bufferevent_timeouts,
 	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR, &basic_setup, (void*)"" },
+	{ "bufferevent_bulk", test_bufferevent_bulk,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR, &basic_setup, (void*)"" },
 	{ "bufferevent_timeout_pair", test_bufferevent_timeouts,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, (void*)"pair" },
 	{ "bufferevent_timeout_filter", test_bufferevent_timeouts,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, (void*)"filter" },
 	{ "bufferevent_timeout_filter_pair", test_bufferevent_timeouts,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, (void*)"filter pair" },
+#ifndef _EVENT_DISABLE_MM_REPLACEMENT
+	{ "bufferevent_base_mm", test_bufferevent_base_mm, TT_FORK,
+	  NULL, NULL },
+#endif
 #ifdef _EVENT_HAVE_LIBZ
 	LEGACY(bufferevent_zlib, TT_ISOLATED),
 #else
@@ -833,3 +1071,30 @@ struct testcase_t bufferevent_iocp_testcases[] = {
 
 	END_OF_TESTCASES,
 };
+
+struct testcase_t bufferevent_uring_testcases[] = {
+
+	{ "bufferevent_connect", test_bufferevent_connect,
+	  TT_FORK|TT_NEED_BASE|TT_ENABLE_URING, &basic_setup, (void*)"" },
+	{ "bufferevent_connect_defer", test_bufferevent_connect,
+	  TT_FORK|TT_NEED_BASE|TT_ENABLE_URING, &basic_setup, (void*)"defer" },
+	{ "bufferevent_connect_lock", test_bufferevent_connect,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_THREADS|TT_ENABLE_URING, &basic_setup,
+	  (void*)"lock" },
+	{ "bufferevent_connect_lock_defer", test_bufferevent_connect,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_THREADS|TT_ENABLE_URING, &basic_setup,
+	  (void*)"defer lock" },
+	{ "bufferevent_connect_fail", test_bufferevent_connect_fail,
+	  TT_FORK|TT_NEED_BASE|TT_ENABLE_URING, &basic_setup, NULL },
+	{ "bufferevent_timeout", test_bufferevent_timeouts,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR|TT_ENABLE_URING,
+	  &basic_setup, (void*)"" },
+	{ "bufferevent_bulk", test_bufferevent_bulk,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR|TT_ENABLE_URING,
+	  &basic_setup, (void*)"uring" },
+	{ "bufferevent_bulk_lock", test_bufferevent_bulk,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR|TT_NEED_THREADS|
+	  TT_ENABLE_URING, &basic_setup, (void*)"uring lock" },
+
+	END_OF_TESTCASES,
+};
@@ -169,6 +169,10 @@ basic_test_setup(const struct testcase_t *testcase)
 	if (testcase->flags & TT_ENABLE_IOCP_FLAG)
 		return (void*)TT_SKIP;
 #endif
+#ifndef _EVENT_HAVE_IO_URING
+	if (testcase->flags & TT_ENABLE_URING)
+		return (void*)TT_SKIP;
+#endif
 
 	if (testcase->flags & TT_NEED_THREADS) {
 		if (!(testcase->flags & TT_FORK))
@@ -201,13 +205,32 @@ basic_test_setup(const struct testcase_t *testcase)
 		}
 	}
 	if (testcase->flags & TT_NEED_BASE) {
-		if (testcase->flags & TT_LEGACY)
+		if (testcase->flags & TT_LEGACY) {
 			base = event_init();
-		else
+		} else if (testcase->flags & TT_ENABLE_URING) {
+			struct event_config *cfg = event_config_new();
+			if (!cfg)
+				exit(1);
+			event_config_avoid_method(cfg, "epoll");
+			event_config_set_flag(cfg,
+			    EVENT_BASE_FLAG_URING_BUFFEREVENTS);
+			base = event_base_new_with_config(cfg);
+			event_config_free(cfg);
+			if (!base)
+				return (void*)TT_SKIP;
+		} else {
 			base = event_base_new();
+		}
 		if (!base)
 			exit(1);
 	}
+	if (testcase->flags & TT_ENABLE_URING) {
+		/* The environment may have turned io_uring off. */
+		if (strcmp(event_base_get_method(base), "io_uring")) {
+			event_base_free(base);
+			return (void*)TT_SKIP;
+		}
+	}
 	if (testcase->flags & TT_ENABLE_IOCP_FLAG) {
 		if (event_base_start_iocp(base, 0)<0) {
 			event_base_free(base);
@@ -351,6 +374,9 @@ struct testgroup_t testgroups[] = {
 	{ "iocp/bufferevent/", bufferevent_iocp_testcases },
 	{ "iocp/listener/", listener_iocp_testcases },
 #endif
+#ifdef _EVENT_HAVE_IO_URING
+	{ "uring/bufferevent/", bufferevent_uring_testcases },
+#endif
 #ifdef _EVENT_HAVE_OPENSSL
 	{ "ssl/", ssl_testcases },
 #endif
@@ -44,9 +44,11 @@ check_heap(struct min_heap *heap)
 {
 	unsigned i;
 	for (i = 1; i < heap->n; ++i) {
-		unsigned parent_idx = (i-1)/2;
-		tt_want(evutil_timercmp(&heap->p[i]->ev_timeout,
-			&heap->p[parent_idx]->ev_timeout, >=));
+		unsigned parent_idx = (i-1)/MIN_HEAP_ARITY;
+		tt_want(heap->p[i].deadline >= heap->p[parent_idx].deadline);
+		tt_want(heap->p[i].deadline ==
+		    min_heap_key_(&heap->p[i].ev->ev_timeout));
+		tt_want(heap->p[i].ev->ev_timeout_pos.min_heap_idx == (int)i);
 	}
 }
 
@@ -61,7 +63,7 @@ test_heap_randomized(void *ptr)
 	min_heap_ctor(&heap);
 
 	for (i = 0; i < 1024; ++i) {
-		inserted[i] = malloc(sizeof(struct event));
+		inserted[i] = calloc(1, sizeof(struct event));
 		set_random_timeout(inserted[i]);
 		min_heap_push(&heap, inserted[i]);
 	}
@@ -92,7 +94,51 @@ end:
 	min_heap_dtor(&heap);
 }
 
+static void
+test_heap_heapify(void *ptr)
+{
+	struct min_heap heap;
+	struct event *inserted[1024];
+	struct event *e, *last_e;
+	int i;
+
+	min_heap_ctor(&heap);
+
+	/* Half in order, half appended, then half of those taken out
+	 * again without reordering. */
+	for (i = 0; i < 1024; ++i) {
+		inserted[i] = calloc(1, sizeof(struct event));
+		set_random_timeout(inserted[i]);
+		if (i < 512)
+			min_heap_push(&heap, inserted[i]);
+		else
+			min_heap_push_unordered(&heap, inserted[i]);
+	}
+	for (i = 256; i < 768; i += 2)
+		min_heap_erase_unordered(&heap, inserted[i]);
+	tt_assert(min_heap_size(&heap) == 768);
+	min_heap_heapify(&heap);
+	check_heap(&heap);
+
+	last_e = min_heap_pop(&heap);
+	while (1) {
+		e = min_heap_pop(&heap);
+		if (!e)
+			break;
+		tt_want(evutil_timercmp(&last_e->ev_timeout,
+			&e->ev_timeout, <=));
+		last_e = e;
+	}
+	tt_assert(min_heap_size(&heap) == 0);
+end:
+	for (i = 0; i < 1024; ++i)
+		free(inserted[i]);
+
+	min_heap_dtor(&heap);
+}
+
 struct testcase_t minheap_testcases[] = {
 	{ "randomized", test_heap_randomized, 0, NULL, NULL },
+	{ "heapify", test_heap_heapify, 0, NULL, NULL },
 	END_OF_TESTCASES
 };
@@ -57,6 +57,7 @@
 #include "event2/event.h"
 #include "event2/event_struct.h"
 #include "event2/thread.h"
+#include "event2/buffer.h"
 #include "evthread-internal.h"
 #include "event-internal.h"
 #include "defer-internal.h"
@@ -483,6 +484,1083 @@ end:
 		THREAD_JOIN(load_threads[i]);
 }
 
+#define REMOTE_N_THREADS 8
+#define REMOTE_N_ITERATIONS 200
+
+struct remote_test_thread {
+	struct event_base *base;
+	void *lock;
+	void *cond;
+	struct event *ev;
+	struct deferred_cb deferred;
+	int n_event_runs;
+	int n_deferred_runs;
+};
+
+static void *remote_done_lock;
+static int remote_n_done;
+
+static void
+remote_event_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct remote_test_thread *t = arg;
+	EVLOCK_LOCK(t->lock, 0);
+	++t->n_event_runs;
+	EVTHREAD_COND_SIGNAL(t->cond);
+	EVLOCK_UNLOCK(t->lock, 0);
+}
+
+static void
+remote_deferred_cb(struct deferred_cb *cb, void *arg)
+{
+	struct remote_test_thread *t = arg;
+	EVLOCK_LOCK(t->lock, 0);
+	++t->n_deferred_runs;
+	EVTHREAD_COND_SIGNAL(t->cond);
+	EVLOCK_UNLOCK(t->lock, 0);
+}
+
+/* Activate an event and schedule a deferred callback from outside the loop
+ * thread, over and over, waiting each time for the loop to run it. */
+static THREAD_FN
+remote_activate_thread(void *arg)
+{
+	struct remote_test_thread *t = arg;
+	struct deferred_cb_queue *queue =
+	    event_base_get_deferred_cb_queue(t->base);
+	int i;
+
+	for (i = 0; i < REMOTE_N_ITERATIONS; ++i) {
+		EVLOCK_LOCK(t->lock, 0);
+		event_active(t->ev, EV_READ, 1);
+		while (t->n_event_runs <= i)
+			EVTHREAD_COND_WAIT(t->cond, t->lock);
+		event_deferred_cb_schedule(queue, &t->deferred);
+		while (t->n_deferred_runs <= i)
+			EVTHREAD_COND_WAIT(t->cond, t->lock);
+		EVLOCK_UNLOCK(t->lock, 0);
+	}
+
+	EVLOCK_LOCK(remote_done_lock, 0);
+	if (++remote_n_done == REMOTE_N_THREADS)
+		event_base_loopbreak(t->base);
+	EVLOCK_UNLOCK(remote_done_lock, 0);
+
+	THREAD_RETURN();
+}
+
+static void
+thread_remote_activate(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct remote_test_thread targs[REMOTE_N_THREADS];
+	THREAD_T threads[REMOTE_N_THREADS];
+	int i;
+
+	memset(targs, 0, sizeof(targs));
+	EVTHREAD_ALLOC_LOCK(remote_done_lock, 0);
+	tt_assert(remote_done_lock);
+
+	for (i = 0; i < REMOTE_N_THREADS; ++i) {
+		struct remote_test_thread *t = &targs[i];
+		t->base = data->base;
+		EVTHREAD_ALLOC_LOCK(t->lock, 0);
+		EVTHREAD_ALLOC_COND(t->cond);
+		tt_assert(t->lock);
+		tt_assert(t->cond);
+		t->ev = event_new(data->base, -1, 0, remote_event_cb, t);
+		tt_assert(t->ev);
+		event_deferred_cb_init(&t->deferred, remote_deferred_cb, t);
+	}
+
+	/* Keep the loop alive until the threads are done with it. */
+	event_base_add_virtual(data->base);
+	for (i = 0; i < REMOTE_N_THREADS; ++i)
+		THREAD_START(threads[i], remote_activate_thread, &targs[i]);
+	event_base_dispatch(data->base);
+	for (i = 0; i < REMOTE_N_THREADS; ++i)
+		THREAD_JOIN(threads[i]);
+	event_base_del_virtual(data->base);
+
+	for (i = 0; i < REMOTE_N_THREADS; ++i) {
+		tt_int_op(targs[i].n_event_runs, ==, REMOTE_N_ITERATIONS);
+		tt_int_op(targs[i].n_deferred_runs, ==, REMOTE_N_ITERATIONS);
+	}
+
+end:
+	for (i = 0; i < REMOTE_N_THREADS; ++i) {
+		struct remote_test_thread *t = &targs[i];
+		if (t->ev)
+			event_free(t->ev);
+		if (t->lock)
+			EVTHREAD_FREE_LOCK(t->lock, 0);
+		if (t->cond)
+			EVTHREAD_FREE_COND(t->cond);
+	}
+	if (remote_done_lock)
+		EVTHREAD_FREE_LOCK(remote_done_lock, 0);
+}
+
+struct remote_free_data {
+	struct event_base *base;
+	struct event ev;
+};
+
+static THREAD_FN
+remote_free_activate_thread(void *arg)
+{
+	struct remote_free_data *data = arg;
+	event_active(&data->ev, EV_READ, 1);
+	THREAD_RETURN();
+}
+
+static void
+remote_free_nop_cb(evutil_socket_t fd, short what, void *arg)
+{
+}
+
+static void
+remote_free_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct remote_free_data *data = arg;
+	THREAD_T thread;
+
+	/* The loop is running, so this activation is queued for it without
+	 * the lock; breaking the loop leaves it queued. */
+	THREAD_START(thread, remote_free_activate_thread, data);
+	THREAD_JOIN(thread);
+	event_base_loopbreak(data->base);
+}
+
+static void
+thread_remote_free_base(void *arg)
+{
+	struct remote_free_data data;
+	struct timeval tv = { 0, 0 };
+
+	memset(&data, 0, sizeof(data));
+	data.base = event_base_new();
+	tt_assert(data.base);
+	event_assign(&data.ev, data.base, -1, 0, remote_free_nop_cb, NULL);
+	tt_int_op(event_base_once(data.base, -1, EV_TIMEOUT, remote_free_cb,
+		&data, &tv), ==, 0);
+	event_base_dispatch(data.base);
+
+	/* Freeing the base must cope with the queued activation. */
+	event_base_free(data.base);
+	data.base = NULL;
+end:
+	if (data.base)
+		event_base_free(data.base);
+}
+
+#define COALESCE_N_ACTIVATIONS 1000
+
+struct remote_coalesce_data {
+	struct event_base *base;
+	struct event *target;
+	int n_runs;
+	short what;
+};
+
+static THREAD_FN
+remote_coalesce_thread(void *arg)
+{
+	struct remote_coalesce_data *data = arg;
+	int i;
+
+	for (i = 0; i < COALESCE_N_ACTIVATIONS; ++i)
+		event_active(data->target, EV_READ, 1);
+	event_active(data->target, EV_WRITE, 1);
+	THREAD_RETURN();
+}
+
+static void
+remote_coalesce_target_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct remote_coalesce_data *data = arg;
+
+	++data->n_runs;
+	data->what |= what;
+	event_base_loopbreak(data->base);
+}
+
+static void
+remote_coalesce_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct remote_coalesce_data *data = arg;
+	THREAD_T thread;
+
+	/* The loop is busy running us, so every activation waits for it,
+	 * on the same event. */
+	THREAD_START(thread, remote_coalesce_thread, data);
+	THREAD_JOIN(thread);
+}
+
+static void
+thread_remote_coalesce(void *arg)
+{
+	struct basic_test_data *basic = arg;
+	struct remote_coalesce_data data;
+	struct timeval tv = { 0, 0 };
+
+	memset(&data, 0, sizeof(data));
+	data.base = basic->base;
+	data.target = event_new(data.base, -1, 0, remote_coalesce_target_cb,
+	    &data);
+	tt_assert(data.target);
+	tt_int_op(event_base_once(data.base, -1, EV_TIMEOUT,
+		remote_coalesce_cb, &data, &tv), ==, 0);
+	event_base_dispatch(data.base);
+
+	/* All of them ran as one callback, with every result. */
+	tt_int_op(data.n_runs, ==, 1);
+	tt_int_op(data.what, ==, EV_READ|EV_WRITE);
+
+end:
+	if (data.target)
+		event_free(data.target);
+}
+
+struct batch_wait_data {
+	struct event_base *base;
+	struct event *busy;
+	struct event *soon;
+	THREAD_T thread;
+	int started;
+	struct timeval soon_at;
+	int n_soon;
+	int n_late;
+};
+
+static THREAD_FN
+batch_wait_del_thread(void *arg)
+{
+	struct batch_wait_data *data = arg;
+
+	/* The loop is running 'busy', so this waits for its callback. */
+	event_del_batch(&data->busy, 1);
+	THREAD_RETURN();
+}
+
+static void
+batch_wait_busy_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct batch_wait_data *data = arg;
+	struct timeval tv = { 0, 50*1000 };
+
+	THREAD_START(data->thread, batch_wait_del_thread, data);
+	data->started = 1;
+	SLEEP_MS(100);
+	/* The batch is waiting for us, so the heap must be in order for
+	 * this timeout to end up first in it. */
+	event_add(data->soon, &tv);
+}
+
+static void
+batch_wait_soon_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct batch_wait_data *data = arg;
+
+	evutil_gettimeofday(&data->soon_at, NULL);
+	++data->n_soon;
+	event_base_loopbreak(data->base);
+}
+
+static void
+batch_wait_late_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct batch_wait_data *data = arg;
+
+	++data->n_late;
+	event_base_loopbreak(data->base);
+}
+
+static void
+thread_batch_wait(void *arg)
+{
+	struct basic_test_data *basic = arg;
+	struct batch_wait_data data;
+	struct event *late = NULL;
+	struct timeval tv = { 5, 0 }, launched_at;
+
+	memset(&data, 0, sizeof(data));
+	data.base = basic->base;
+	data.busy = event_new(data.base, -1, 0, batch_wait_busy_cb, &data);
+	data.soon = evtimer_new(data.base, batch_wait_soon_cb, &data);
+	late = evtimer_new(data.base, batch_wait_late_cb, &data);
+	tt_assert(data.busy && data.soon && late);
+
+	/* With only 'late' in the heap, deleting one event is done in
+	 * bulk, leaving the heap unordered until the batch is over. */
+	event_add(late, &tv);
+	event_active(data.busy, EV_READ, 1);
+	evutil_gettimeofday(&launched_at, NULL);
+	event_base_dispatch(data.base);
+
+	/* 'soon' must not have waited for 'late'. */
+	tt_int_op(data.n_soon, ==, 1);
+	tt_int_op(data.n_late, ==, 0);
+	tt_int_op(timeval_msec_diff(&launched_at, &data.soon_at), <, 2000);
+
+end:
+	if (data.started)
+		THREAD_JOIN(data.thread);
+	if (data.busy)
+		event_free(data.busy);
+	if (data.soon)
+		event_free(data.soon);
+	if (late)
+		event_free(late);
+}
+
+#define GROUP_N_BASES 4
+#define GROUP_N_EVENTS 64
+
+struct group_test_data {
+	void *lock;
+	struct event_base_group *group;
+	struct event_base *home;
+	int n_run;
+	int n_stolen;
+	int n_pinned_moved;
+};
+
+struct group_test_event {
+	struct group_test_data *data;
+	struct event *ev;
+	int pinned;
+};
+
+struct group_test_thread {
+	struct event_base_group *group;
+	int idx;
+};
+
+static THREAD_FN
+group_dispatch_thread(void *arg)
+{
+	struct group_test_thread *t = arg;
+	event_base_group_dispatch(t->group, t->idx);
+	THREAD_RETURN();
+}
+
+static void
+group_work_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct group_test_event *e = arg;
+	struct group_test_data *data = e->data;
+	int done;
+
+	EVLOCK_LOCK(data->lock, 0);
+	if (!EVBASE_IN_THREAD(data->home)) {
+		++data->n_stolen;
+		if (e->pinned)
+			++data->n_pinned_moved;
+	}
+	done = (++data->n_run == GROUP_N_EVENTS);
+	EVLOCK_UNLOCK(data->lock, 0);
+
+	SLEEP_MS(2);
+
+	if (done)
+		event_base_group_loopbreak(data->group);
+}
+
+static void
+group_start_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct group_test_event *events = arg;
+	int i;
+
+	/* By now, the other threads are all asleep; they need to notice that
+	 * the home base has a backlog. */
+	for (i = 0; i < GROUP_N_EVENTS; ++i)
+		event_active(events[i].ev, EV_TIMEOUT, 1);
+}
+
+static void
+thread_group_steal(void *arg)
+{
+	struct group_test_data data;
+	struct group_test_event events[GROUP_N_EVENTS];
+	struct group_test_thread targs[GROUP_N_BASES];
+	THREAD_T threads[GROUP_N_BASES];
+	struct event *start_ev = NULL;
+	struct timeval tv = { 0, 100*1000 };
+	int i, n_threads = 0;
+
+	memset(&data, 0, sizeof(data));
+	memset(events, 0, sizeof(events));
+	EVTHREAD_ALLOC_LOCK(data.lock, 0);
+	tt_assert(data.lock);
+
+	data.group = event_base_group_new(GROUP_N_BASES, NULL);
+	tt_assert(data.group);
+	tt_int_op(event_base_group_get_n_bases(data.group), ==, GROUP_N_BASES);
+	tt_assert(!event_base_group_get_base(data.group, GROUP_N_BASES));
+	data.home = event_base_group_get_base(data.group, 0);
+
+	/* Put all the work on one base; pin every fourth callback to it. */
+	for (i = 0; i < GROUP_N_EVENTS; ++i) {
+		events[i].data = &data;
+		events[i].pinned = (i % 4) == 0;
+		events[i].ev = event_new(data.home, -1,
+		    events[i].pinned ? EV_PINNED : 0, group_work_cb,
+		    &events[i]);
+		tt_assert(events[i].ev);
+	}
+	start_ev = event_new(data.home, -1, EV_PINNED, group_start_cb, events);
+	tt_assert(start_ev);
+	event_add(start_ev, &tv);
+
+	for (i = 0; i < GROUP_N_BASES; ++i) {
+		targs[i].group = data.group;
+		targs[i].idx = i;
+		THREAD_START(threads[i], group_dispatch_thread, &targs[i]);
+		++n_threads;
+	}
+	for (i = 0; i < n_threads; ++i)
+		THREAD_JOIN(threads[i]);
+	n_threads = 0;
+
+	TT_BLATHER(("%d of %d callbacks stolen", data.n_stolen, data.n_run));
+	tt_int_op(data.n_run, ==, GROUP_N_EVENTS);
+	tt_int_op(data.n_stolen, >, 0);
+	tt_int_op(data.n_pinned_moved, ==, 0);
+
+end:
+	for (i = 0; i < n_threads; ++i)
+		THREAD_JOIN(threads[i]);
+	for (i = 0; i < GROUP_N_EVENTS; ++i) {
+		if (events[i].ev)
+			event_free(events[i].ev);
+	}
+	if (start_ev)
+		event_free(start_ev);
+	if (data.group)
+		event_base_group_free(data.group);
+	if (data.lock)
+		EVTHREAD_FREE_LOCK(data.lock, 0);
+}
+
+#define PERSIST_N_EVENTS 4
+#define PERSIST_N_RUNS 60
+
+struct group_persist_data {
+	void *lock;
+	struct event_base_group *group;
+	struct event_base *home;
+	int n_run;
+	int n_stolen;
+	int n_overlaps;
+	int in_cb[PERSIST_N_EVENTS];
+};
+
+struct group_persist_event {
+	struct group_persist_data *data;
+	int idx;
+};
+
+static void
+group_persist_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct group_persist_event *e = arg;
+	struct group_persist_data *data = e->data;
+	int done, stolen = !EVBASE_IN_THREAD(data->home);
+
+	EVLOCK_LOCK(data->lock, 0);
+	if (data->in_cb[e->idx]++)
+		++data->n_overlaps;
+	if (stolen)
+		++data->n_stolen;
+	EVLOCK_UNLOCK(data->lock, 0);
+
+	/* We never read the fd, so the home base's backend keeps finding it
+	 * readable while we sleep.  Take longer when stolen, so that the
+	 * home base gets to poll it again before we are done. */
+	SLEEP_MS(stolen ? 20 : 2);
+
+	EVLOCK_LOCK(data->lock, 0);
+	--data->in_cb[e->idx];
+	done = (++data->n_run == PERSIST_N_RUNS);
+	EVLOCK_UNLOCK(data->lock, 0);
+
+	if (done)
+		event_base_group_loopbreak(data->group);
+}
+
+static void
+thread_group_steal_persist(void *arg)
+{
+	struct group_persist_data data;
+	struct group_persist_event events[PERSIST_N_EVENTS];
+	struct event *evs[PERSIST_N_EVENTS];
+	evutil_socket_t pairs[PERSIST_N_EVENTS][2];
+	struct group_test_thread targs[2];
+	struct event_config *cfg = NULL;
+	struct event_base_stats stats;
+	THREAD_T threads[2];
+	ev_uint64_t n_callbacks = 0;
+	int i, n_threads = 0;
+
+	memset(&data, 0, sizeof(data));
+	memset(evs, 0, sizeof(evs));
+	for (i = 0; i < PERSIST_N_EVENTS; ++i)
+		pairs[i][0] = pairs[i][1] = -1;
+	EVTHREAD_ALLOC_LOCK(data.lock, 0);
+	tt_assert(data.lock);
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_COLLECT_STATS);
+	data.group = event_base_group_new(2, cfg);
+	tt_assert(data.group);
+	data.home = event_base_group_get_base(data.group, 0);
+
+	for (i = 0; i < PERSIST_N_EVENTS; ++i) {
+		tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0,
+			    pairs[i]), ==, 0);
+		tt_int_op(send(pairs[i][0], "x", 1, 0), ==, 1);
+		events[i].data = &data;
+		events[i].idx = i;
+		evs[i] = event_new(data.home, pairs[i][1], EV_READ|EV_PERSIST,
+		    group_persist_cb, &events[i]);
+		tt_assert(evs[i]);
+		event_add(evs[i], NULL);
+	}
+
+	for (i = 0; i < 2; ++i) {
+		targs[i].group = data.group;
+		targs[i].idx = i;
+		THREAD_START(threads[i], group_dispatch_thread, &targs[i]);
+		++n_threads;
+	}
+	for (i = 0; i < n_threads; ++i)
+		THREAD_JOIN(threads[i]);
+	n_threads = 0;
+
+	TT_BLATHER(("%d of %d callbacks stolen", data.n_stolen, data.n_run));
+	tt_int_op(data.n_run, >=, PERSIST_N_RUNS);
+	tt_int_op(data.n_stolen, >, 0);
+	tt_int_op(data.n_overlaps, ==, 0);
+
+	/* The home base counts its callbacks, whichever thread ran them. */
+	tt_int_op(event_base_get_stats(data.home, &stats), ==, 0);
+	for (i = 0; i < EVENT_STATS_N_PRIORITIES; ++i)
+		n_callbacks += stats.n_callbacks[i];
+	tt_assert(n_callbacks >= (ev_uint64_t)data.n_run);
+
+end:
+	for (i = 0; i < n_threads; ++i)
+		THREAD_JOIN(threads[i]);
+	for (i = 0; i < PERSIST_N_EVENTS; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+		if (pairs[i][0] >= 0)
+			evutil_closesocket(pairs[i][0]);
+		if (pairs[i][1] >= 0)
+			evutil_closesocket(pairs[i][1]);
+	}
+	if (data.group)
+		event_base_group_free(data.group);
+	if (cfg)
+		event_config_free(cfg);
+	if (data.lock)
+		EVTHREAD_FREE_LOCK(data.lock, 0);
+}
+
+#define POOL_N_THREADS 4
+#define POOL_N_JOBS 100
+
+struct pool_test_data {
+	void *lock;
+	struct event_base *base;
+	struct event_thread_pool *pool;
+	unsigned long loop_thread;
+	int n_worked;
+	int n_worked_on_loop;
+	int n_done;
+	int n_done_off_loop;
+	int n_done_uncounted;
+};
+
+static THREAD_FN
+pool_worker_thread(void *arg)
+{
+	event_thread_pool_run_worker(arg);
+	THREAD_RETURN();
+}
+
+static void
+pool_work_fn(void *arg)
+{
+	struct pool_test_data *data = arg;
+
+	EVLOCK_LOCK(data->lock, 0);
+	++data->n_worked;
+	if (EVTHREAD_GET_ID() == data->loop_thread)
+		++data->n_worked_on_loop;
+	EVLOCK_UNLOCK(data->lock, 0);
+}
+
+static void
+pool_done_fn(void *arg)
+{
+	struct pool_test_data *data = arg;
+	struct event_thread_pool_stats stats;
+
+	if (!EVBASE_IN_THREAD(data->base))
+		++data->n_done_off_loop;
+	++data->n_done;
+	/* The pool must already count every job whose done_fn we saw. */
+	if (data->pool && (event_thread_pool_get_stats(data->pool, &stats) ||
+		stats.n_completed < (ev_uint64_t)data->n_done))
+		++data->n_done_uncounted;
+	if (data->n_done == POOL_N_JOBS)
+		event_base_loopbreak(data->base);
+}
+
+static void
+thread_pool_offload(void *arg)
+{
+	struct basic_test_data *basic = arg;
+	struct pool_test_data data;
+	struct event_thread_pool *pool = NULL, *small = NULL;
+	struct event_thread_pool_stats stats;
+	THREAD_T threads[POOL_N_THREADS];
+	int i, n_threads = 0;
+
+	memset(&data, 0, sizeof(data));
+	data.base = basic->base;
+	data.loop_thread = EVTHREAD_GET_ID();
+	EVTHREAD_ALLOC_LOCK(data.lock, 0);
+	tt_assert(data.lock);
+
+	tt_assert(!event_thread_pool_new(-1));
+	pool = event_thread_pool_new(0);
+	tt_assert(pool);
+	data.pool = pool;
+	for (i = 0; i < POOL_N_THREADS; ++i) {
+		THREAD_START(threads[i], pool_worker_thread, pool);
+		++n_threads;
+	}
+
+	/* Queue the jobs from the loop thread, then wait for every
+	 * completion to come back to it. */
+	event_base_add_virtual(data.base);
+	for (i = 0; i < POOL_N_JOBS; ++i)
+		tt_int_op(event_base_run_in_pool(data.base, pool,
+			pool_work_fn, pool_done_fn, &data), ==, 0);
+	event_base_dispatch(data.base);
+	event_base_del_virtual(data.base);
+
+	tt_int_op(data.n_worked, ==, POOL_N_JOBS);
+	tt_int_op(data.n_worked_on_loop, ==, 0);
+	tt_int_op(data.n_done, ==, POOL_N_JOBS);
+	tt_int_op(data.n_done_off_loop, ==, 0);
+	tt_int_op(data.n_done_uncounted, ==, 0);
+
+	tt_int_op(event_thread_pool_get_stats(pool, &stats), ==, 0);
+	tt_int_op(stats.n_submitted, ==, POOL_N_JOBS);
+	tt_int_op(stats.n_completed, ==, POOL_N_JOBS);
+	tt_int_op(stats.n_rejected, ==, 0);
+	tt_int_op(stats.n_queued, ==, 0);
+	tt_int_op(stats.n_running, ==, 0);
+	tt_int_op(stats.max_queued_seen, >=, 1);
+
+	event_thread_pool_free(pool);
+	pool = data.pool = NULL;
+	for (i = 0; i < n_threads; ++i)
+		THREAD_JOIN(threads[i]);
+	n_threads = 0;
+
+	/* A bounded pool refuses work once its queue is full, and drops
+	 * what no worker ever picked up. */
+	small = event_thread_pool_new(2);
+	tt_assert(small);
+	tt_int_op(event_base_run_in_pool(data.base, small, pool_work_fn,
+		    pool_done_fn, &data), ==, 0);
+	tt_int_op(event_base_run_in_pool(data.base, small, pool_work_fn,
+		    pool_done_fn, &data), ==, 0);
+	tt_int_op(event_base_run_in_pool(data.base, small, pool_work_fn,
+		    pool_done_fn, &data), ==, -1);
+	tt_int_op(event_thread_pool_get_stats(small, &stats), ==, 0);
+	tt_int_op(stats.n_queued, ==, 2);
+	tt_int_op(stats.n_rejected, ==, 1);
+	tt_int_op(stats.n_workers, ==, 0);
+
+#ifdef _EVENT_HAVE_PTHREADS
+	/* Workers started for us run what was queued before they began. */
+	data.n_done = POOL_N_JOBS - 2;
+	tt_int_op(event_thread_pool_start_pthreads(small, 2), ==, 2);
+	event_base_add_virtual(data.base);
+	event_base_dispatch(data.base);
+	event_base_del_virtual(data.base);
+	tt_int_op(data.n_done, ==, POOL_N_JOBS);
+	tt_int_op(data.n_worked, ==, POOL_N_JOBS + 2);
+#endif
+
+end:
+	if (pool)
+		event_thread_pool_free(pool);
+	for (i = 0; i < n_threads; ++i)
+		THREAD_JOIN(threads[i]);
+	if (small)
+		event_thread_pool_free(small);
+	if (data.lock)
+		EVTHREAD_FREE_LOCK(data.lock, 0);
+}
+
+#define LF_N_THREADS 4
+#define LF_N_FDS 8
+#define LF_N_BYTES 20
+
+struct lf_test_data {
+	void *lock;
+	struct event_base *base;
+	unsigned long threads[LF_N_THREADS];
+	int n_threads_seen;
+	int n_read;
+	int n_overlaps;
+	int in_cb[LF_N_FDS];
+};
+
+struct lf_test_fd {
+	struct lf_test_data *data;
+	int idx;
+};
+
+static THREAD_FN
+lf_dispatch_thread(void *arg)
+{
+	event_base_dispatch(arg);
+	THREAD_RETURN();
+}
+
+static void
+lf_read_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct lf_test_fd *f = arg;
+	struct lf_test_data *data = f->data;
+	unsigned long me = EVTHREAD_GET_ID();
+	char c;
+	int i, done = 0;
+
+	EVLOCK_LOCK(data->lock, 0);
+	if (data->in_cb[f->idx]++)
+		++data->n_overlaps;
+	for (i = 0; i < data->n_threads_seen; ++i) {
+		if (data->threads[i] == me)
+			break;
+	}
+	if (i == data->n_threads_seen && i < LF_N_THREADS)
+		data->threads[data->n_threads_seen++] = me;
+	EVLOCK_UNLOCK(data->lock, 0);
+
+	/* Read one byte at a time, so that the fd has to be rearmed for
+	 * the rest. */
+	if (recv(fd, &c, 1, 0) == 1) {
+		SLEEP_MS(1);
+		EVLOCK_LOCK(data->lock, 0);
+		done = (++data->n_read == LF_N_FDS * LF_N_BYTES);
+		EVLOCK_UNLOCK(data->lock, 0);
+	}
+
+	EVLOCK_LOCK(data->lock, 0);
+	--data->in_cb[f->idx];
+	EVLOCK_UNLOCK(data->lock, 0);
+
+	if (done)
+		event_base_loopbreak(data->base);
+}
+
+static void
+thread_leader_follower(void *arg)
+{
+	struct lf_test_data data;
+	struct lf_test_fd fds[LF_N_FDS];
+	struct event *evs[LF_N_FDS];
+	evutil_socket_t pairs[LF_N_FDS][2];
+	char buf[LF_N_BYTES];
+	struct event_config *cfg = NULL;
+	struct event_base_stats stats;
+	struct event_slow_callback rec;
+	struct timeval threshold = { 0, 500 };
+	THREAD_T threads[LF_N_THREADS];
+	ev_uint64_t n_callbacks = 0;
+	int i, n_threads = 0;
+
+	memset(&data, 0, sizeof(data));
+	memset(evs, 0, sizeof(evs));
+	memset(buf, 'x', sizeof(buf));
+	for (i = 0; i < LF_N_FDS; ++i)
+		pairs[i][0] = pairs[i][1] = -1;
+	EVTHREAD_ALLOC_LOCK(data.lock, 0);
+	tt_assert(data.lock);
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_LEADER_FOLLOWER);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_COLLECT_STATS);
+	data.base = event_base_new_with_config(cfg);
+	if (!data.base)
+		tt_skip();
+	tt_int_op(event_base_set_slow_callback_threshold(data.base,
+		&threshold, 1), ==, 0);
+
+	for (i = 0; i < LF_N_FDS; ++i) {
+		tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0,
+			    pairs[i]), ==, 0);
+		evutil_make_socket_nonblocking(pairs[i][1]);
+		fds[i].data = &data;
+		fds[i].idx = i;
+		evs[i] = event_new(data.base, pairs[i][1], EV_READ|EV_PERSIST,
+		    lf_read_cb, &fds[i]);
+		tt_assert(evs[i]);
+		event_add(evs[i], NULL);
+		tt_int_op(send(pairs[i][0], buf, sizeof(buf), 0), ==,
+		    sizeof(buf));
+	}
+
+	for (i = 0; i < LF_N_THREADS; ++i) {
+		THREAD_START(threads[i], lf_dispatch_thread, data.base);
+		++n_threads;
+	}
+	for (i = 0; i < n_threads; ++i)
+		THREAD_JOIN(threads[i]);
+	n_threads = 0;
+
+	TT_BLATHER(("%d threads ran callbacks", data.n_threads_seen));
+	tt_int_op(data.n_read, ==, LF_N_FDS * LF_N_BYTES);
+	tt_int_op(data.n_overlaps, ==, 0);
+	tt_int_op(data.n_threads_seen, >, 1);
+
+	/* Every callback and every wait of the leader was accounted for,
+	 * whichever thread it happened on.  The callbacks sleep, so they
+	 * all count as slow. */
+	tt_int_op(event_base_get_stats(data.base, &stats), ==, 0);
+	for (i = 0; i < EVENT_STATS_N_PRIORITIES; ++i)
+		n_callbacks += stats.n_callbacks[i];
+	tt_assert(n_callbacks >= LF_N_FDS * LF_N_BYTES);
+	tt_assert(stats.n_dispatches > 0);
+	tt_int_op(event_base_get_slow_callbacks(data.base, &rec, 1), ==, 1);
+	tt_assert(rec.callback == lf_read_cb);
+	tt_assert(rec.duration_nsec >= 500*1000);
+
+end:
+	for (i = 0; i < n_threads; ++i)
+		THREAD_JOIN(threads[i]);
+	for (i = 0; i < LF_N_FDS; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+		if (pairs[i][0] >= 0)
+			evutil_closesocket(pairs[i][0]);
+		if (pairs[i][1] >= 0)
+			evutil_closesocket(pairs[i][1]);
+	}
+	if (data.base)
+		event_base_free(data.base);
+	if (cfg)
+		event_config_free(cfg);
+	if (data.lock)
+		EVTHREAD_FREE_LOCK(data.lock, 0);
+}
+
+#define PROF_N_THREADS 4
+#define PROF_N_ITERATIONS 2000
+
+static THREAD_FN
+lock_profiling_thread(void *arg)
+{
+	struct evbuffer *buf = arg;
+	int i;
+
+	for (i = 0; i < PROF_N_ITERATIONS; ++i) {
+		evbuffer_add(buf, "x", 1);
+		evbuffer_drain(buf, 1);
+	}
+	THREAD_RETURN();
+}
+
+static void
+thread_lock_profiling(void *arg)
+{
+	struct evthread_lock_stats stats;
+	struct event_base *base = NULL;
+	struct evbuffer *buf = NULL;
+	struct timeval tv = { 0, 20000 };
+	void *lock = NULL, *cond = NULL;
+	THREAD_T threads[PROF_N_THREADS];
+	int i;
+
+	tt_int_op(evthread_get_lock_stats(EVTHREAD_LOCK_CLASS_BASE, &stats),
+	    ==, -1);
+	/* Nothing that uses a lock may exist before this. */
+	tt_int_op(evthread_enable_lock_profiling(), ==, 0);
+	tt_int_op(evthread_get_lock_stats(EVTHREAD_LOCK_N_CLASSES, &stats),
+	    ==, -1);
+
+	base = event_base_new();
+	tt_assert(base);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(evthread_get_lock_stats(EVTHREAD_LOCK_CLASS_BASE, &stats),
+	    ==, 0);
+	tt_int_op(stats.n_locks, ==, 1);
+	tt_assert(stats.n_acquired > 0);
+
+	buf = evbuffer_new();
+	tt_assert(buf);
+	tt_int_op(evbuffer_enable_locking(buf, NULL), ==, 0);
+	for (i = 0; i < PROF_N_THREADS; ++i)
+		THREAD_START(threads[i], lock_profiling_thread, buf);
+	for (i = 0; i < PROF_N_THREADS; ++i)
+		THREAD_JOIN(threads[i]);
+
+	tt_int_op(evthread_get_lock_stats(EVTHREAD_LOCK_CLASS_EVBUFFER,
+		&stats), ==, 0);
+	tt_int_op(stats.n_locks, ==, 1);
+	tt_assert(stats.n_acquired >= 2 * PROF_N_THREADS * PROF_N_ITERATIONS);
+	tt_assert(stats.n_contended <= stats.n_acquired);
+	tt_assert(stats.wait_nsec >= stats.max_wait_nsec);
+	tt_assert(stats.hold_nsec >= stats.max_hold_nsec);
+	TT_BLATHER(("evbuffer lock: %lu acquired, %lu contended, "
+		"%lu ns waiting, %lu ns held",
+		(unsigned long)stats.n_acquired,
+		(unsigned long)stats.n_contended,
+		(unsigned long)stats.wait_nsec,
+		(unsigned long)stats.hold_nsec));
+
+	/* A freed lock still counts, but is no longer a lock. */
+	evbuffer_free(buf);
+	buf = NULL;
+	tt_int_op(evthread_get_lock_stats(EVTHREAD_LOCK_CLASS_EVBUFFER,
+		&stats), ==, 0);
+	tt_int_op(stats.n_locks, ==, 0);
+	tt_assert(stats.n_acquired >= 2 * PROF_N_THREADS * PROF_N_ITERATIONS);
+
+	/* Waiting on a condition does not count as holding its lock. */
+	EVTHREAD_ALLOC_LOCK(lock, 0);
+	EVTHREAD_ALLOC_COND(cond);
+	tt_assert(lock);
+	tt_assert(cond);
+	EVLOCK_LOCK(lock, 0);
+	EVTHREAD_COND_WAIT_TIMED(cond, lock, &tv);
+	EVLOCK_UNLOCK(lock, 0);
+	tt_int_op(evthread_get_lock_stats(EVTHREAD_LOCK_CLASS_OTHER, &stats),
+	    ==, 0);
+	tt_int_op(stats.n_acquired, ==, 1);
+	tt_assert(stats.max_hold_nsec < 20000000);
+
+	evthread_reset_lock_stats();
+	tt_int_op(evthread_get_lock_stats(EVTHREAD_LOCK_CLASS_EVBUFFER,
+		&stats), ==, 0);
+	tt_int_op(stats.n_acquired, ==, 0);
+	tt_int_op(evthread_get_lock_stats(EVTHREAD_LOCK_CLASS_BASE, &stats),
+	    ==, 0);
+	tt_int_op(stats.n_locks, ==, 1);
+	tt_int_op(stats.n_acquired, ==, 0);
+
+end:
+	if (buf)
+		evbuffer_free(buf);
+	if (cond)
+		EVTHREAD_FREE_COND(cond);
+	if (lock)
+		EVTHREAD_FREE_LOCK(lock, 0);
+	if (base)
+		event_base_free(base);
+}
+
+#define ADAPTIVE_N_THREADS 8
+#define ADAPTIVE_N_ITERATIONS 20000
+
+struct adaptive_data {
+	void *lock;
+	int count;
+	int try_failed;
+};
+
+static THREAD_FN
+adaptive_count_thread(void *arg)
+{
+	struct adaptive_data *data = arg;
+	int i;
+
+	for (i = 0; i < ADAPTIVE_N_ITERATIONS; ++i) {
+		EVLOCK_LOCK(data->lock, 0);
+		++data->count;
+		EVLOCK_UNLOCK(data->lock, 0);
+	}
+	THREAD_RETURN();
+}
+
+static THREAD_FN
+adaptive_try_thread(void *arg)
+{
+	struct adaptive_data *data = arg;
+
+	if (EVLOCK_TRY_LOCK(data->lock))
+		EVLOCK_UNLOCK(data->lock, 0);
+	else
+		data->try_failed = 1;
+	THREAD_RETURN();
+}
+
+static void
+thread_adaptive_locks(void *arg)
+{
+#ifdef EVTHREAD_USE_PTHREADS_IMPLEMENTED
+	struct adaptive_data data;
+	struct timeval tv = { 0, 10000 };
+	THREAD_T threads[ADAPTIVE_N_THREADS];
+	void *rlock = NULL, *cond = NULL;
+	int i;
+
+	memset(&data, 0, sizeof(data));
+	tt_int_op(evthread_use_pthreads_adaptive(-1), ==, -1);
+	tt_int_op(evthread_use_pthreads_adaptive(0), ==, 0);
+
+	EVTHREAD_ALLOC_LOCK(data.lock, 0);
+	EVTHREAD_ALLOC_LOCK(rlock, EVTHREAD_LOCKTYPE_RECURSIVE);
+	EVTHREAD_ALLOC_COND(cond);
+	tt_assert(data.lock);
+	tt_assert(rlock);
+	tt_assert(cond);
+
+	for (i = 0; i < ADAPTIVE_N_THREADS; ++i)
+		THREAD_START(threads[i], adaptive_count_thread, &data);
+	for (i = 0; i < ADAPTIVE_N_THREADS; ++i)
+		THREAD_JOIN(threads[i]);
+	tt_int_op(data.count, ==, ADAPTIVE_N_THREADS * ADAPTIVE_N_ITERATIONS);
+
+	/* Trying a lock that someone else holds must fail, not spin. */
+	EVLOCK_LOCK(data.lock, 0);
+	THREAD_START(threads[0], adaptive_try_thread, &data);
+	THREAD_JOIN(threads[0]);
+	EVLOCK_UNLOCK(data.lock, 0);
+	tt_assert(data.try_failed);
+
+	EVLOCK_LOCK(rlock, 0);
+	EVLOCK_LOCK(rlock, 0);
+	EVLOCK_UNLOCK(rlock, 0);
+	tt_int_op(EVTHREAD_COND_WAIT_TIMED(cond, rlock, &tv), ==, 1);
+	EVLOCK_UNLOCK(rlock, 0);
+
+end:
+	if (cond)
+		EVTHREAD_FREE_COND(cond);
+	if (rlock)
+		EVTHREAD_FREE_LOCK(rlock, EVTHREAD_LOCKTYPE_RECURSIVE);
+	if (data.lock)
+		EVTHREAD_FREE_LOCK(data.lock, 0);
+#else
+	tt_skip();
+end:
+	;
+#endif
+}
+
 #define TEST(name)							\
 	{ #name, thread_##name, TT_FORK|TT_NEED_THREADS|TT_NEED_BASE,	\
 	  &basic_setup, NULL }
@@ -496,6 +1574,22 @@ struct testcase_t thread_testcases[] = {
 #endif
 	TEST(conditions_simple),
 	TEST(deferred_cb_skew),
+	TEST(remote_activate),
+	{ "remote_free_base", thread_remote_free_base,
+	  TT_FORK|TT_NEED_THREADS, &basic_setup, NULL },
+	TEST(remote_coalesce),
+	TEST(batch_wait),
+	{ "group_steal", thread_group_steal, TT_FORK|TT_NEED_THREADS,
+	  &basic_setup, NULL },
+	{ "group_steal_persist", thread_group_steal_persist,
+	  TT_FORK|TT_NEED_THREADS, &basic_setup, NULL },
+	TEST(pool_offload),
+	{ "leader_follower", thread_leader_follower, TT_FORK|TT_NEED_THREADS,
+	  &basic_setup, NULL },
+	{ "lock_profiling", thread_lock_profiling, TT_FORK|TT_NEED_THREADS,
+	  &basic_setup, NULL },
+	{ "adaptive_locks", thread_adaptive_locks, TT_FORK|TT_NEED_THREADS,
+	  &basic_setup, NULL },
 	END_OF_TESTCASES
 };
 
@@ -34,8 +34,10 @@ setup () {
 	EVENT_NOPOLL=yes; export EVENT_NOPOLL
 	EVENT_NOSELECT=yes; export EVENT_NOSELECT
 	EVENT_NOEPOLL=yes; export EVENT_NOEPOLL
+	EVENT_NOIO_URING=yes; export EVENT_NOIO_URING
 	EVENT_NOEVPORT=yes; export EVENT_NOEVPORT
 	EVENT_NOWIN32=yes; export EVENT_NOWIN32
+	unset EVENT_PRECISE_TIMER
 }
 
 announce () {
@@ -134,6 +136,17 @@ unset EVENT_NOEPOLL
 announce "EPOLL"
 run_tests
 
+setup
+unset EVENT_NOEPOLL
+EVENT_PRECISE_TIMER=yes; export EVENT_PRECISE_TIMER
+announce "EPOLL (precise timer)"
+run_tests
+
+setup
+unset EVENT_NOIO_URING
+announce "IO_URING"
+run_tests
+
 setup
 unset EVENT_NOEVPORT
 announce "EVPORT"
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <event2/event.h>
+#include <event2/util.h>
+
+/*
+ * This tool reads a trace written by event_base_trace_flush(), or the
+ * file behind a trace started with a path, and prints what the event
+ * loop did: one line per record, with times in microseconds since the
+ * first record, and then a summary.  Run it with -q to get only the
+ * summary.
+ */
+
+#define MAX_CALLBACKS 1024
+#define TOP_CALLBACKS 20
+
+struct callback_summary {
+	ev_uint64_t addr;
+	ev_uint64_t n_calls;
+	ev_uint64_t total_nsec;
+	ev_uint64_t max_nsec;
+};
+
+static struct callback_summary callbacks[MAX_CALLBACKS];
+static int n_callbacks;
+
+static double
+usec(ev_uint64_t nsec)
+{
+	return nsec / 1000.0;
+}
+
+static void
+note_callback(ev_uint64_t addr, ev_uint64_t nsec)
+{
+	int i;
+
+	for (i = 0; i < n_callbacks; ++i) {
+		if (callbacks[i].addr == addr)
+			break;
+	}
+	if (i == n_callbacks) {
+		if (n_callbacks == MAX_CALLBACKS)
+			return;
+		memset(&callbacks[i], 0, sizeof(callbacks[i]));
+		callbacks[i].addr = addr;
+		++n_callbacks;
+	}
+	++callbacks[i].n_calls;
+	callbacks[i].total_nsec += nsec;
+	if (nsec > callbacks[i].max_nsec)
+		callbacks[i].max_nsec = nsec;
+}
+
+static int
+compare_callbacks(const void *a, const void *b)
+{
+	const struct callback_summary *ca = a, *cb = b;
+
+	if (ca->total_nsec != cb->total_nsec)
+		return ca->total_nsec < cb->total_nsec ? 1 : -1;
+	return 0;
+}
+
+static const char *
+fd_events(ev_uint64_t what)
+{
+	static char buf[16];
+
+	buf[0] = '\0';
+	if (what & EV_READ)
+		strcat(buf, "R");
+	if (what & EV_WRITE)
+		strcat(buf, "W");
+	if (what & EV_ET)
+		strcat(buf, "E");
+	return buf;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct event_trace_header hdr;
+	struct event_trace_record *records = NULL, *rec;
+	ev_uint64_t n, first, i, t0 = 0;
+	ev_uint64_t n_loops = 0, n_dispatches = 0, wait_total = 0,
+	    wait_max = 0, n_fds = 0, n_timers = 0, n_deferred_runs = 0,
+	    n_deferred = 0, deferred_nsec = 0, n_calls = 0, cb_nsec = 0;
+	const char *path = NULL;
+	int quiet = 0;
+	FILE *f;
+
+	for (i = 1; i < (ev_uint64_t)argc; ++i) {
+		if (!strcmp(argv[i], "-q"))
+			quiet = 1;
+		else
+			path = argv[i];
+	}
+	if (!path) {
+		fprintf(stderr, "Usage: %s [-q] tracefile\n", argv[0]);
+		return 1;
+	}
+
+	if ((f = fopen(path, "rb")) == NULL) {
+		perror(path);
+		return 1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, EVENT_TRACE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.header_size != sizeof(hdr) ||
+	    hdr.record_size != sizeof(struct event_trace_record)) {
+		fprintf(stderr, "%s: not a trace from this libevent\n", path);
+		fclose(f);
+		return 1;
+	}
+
+	if (hdr.n_records) {
+		records = calloc((size_t)hdr.n_records, sizeof(*records));
+		if (!records ||
+		    fread(records, sizeof(*records), (size_t)hdr.n_records, f)
+		    != hdr.n_records) {
+			fprintf(stderr, "%s: truncated trace\n", path);
+			fclose(f);
+			return 1;
+		}
+	}
+	fclose(f);
+
+	/* A trace file that is still mapped may have wrapped around. */
+	n = hdr.n_written < hdr.n_records ? hdr.n_written : hdr.n_records;
+	first = hdr.n_written - n;
+	if (first)
+		printf("(%llu older records were overwritten)\n",
+		    (unsigned long long)first);
+
+	for (i = first; i < first + n; ++i) {
+		rec = &records[i % hdr.n_records];
+		if (i == first)
+			t0 = rec->nsec;
+		if (!quiet)
+			printf("%12.3f ", usec(rec->nsec - t0));
+
+		switch (rec->type) {
+		case EVENT_TRACE_LOOP:
+			++n_loops;
+			if (!quiet)
+				printf("loop         active=%llu\n",
+				    (unsigned long long)rec->value);
+			break;
+		case EVENT_TRACE_DISPATCH:
+			++n_dispatches;
+			wait_total += rec->nsec - rec->value;
+			if (rec->nsec - rec->value > wait_max)
+				wait_max = rec->nsec - rec->value;
+			if (!quiet)
+				printf("dispatch     waited=%.3fus active=%llu\n",
+				    usec(rec->nsec - rec->value),
+				    (unsigned long long)rec->extra);
+			break;
+		case EVENT_TRACE_FD_ACTIVE:
+			++n_fds;
+			if (!quiet)
+				printf("  fd %-8d %s\n", (int)rec->fd,
+				    fd_events(rec->value));
+			break;
+		case EVENT_TRACE_TIMER:
+			++n_timers;
+			if (!quiet)
+				printf("  timer      fd=%d cb=%#llx\n",
+				    (int)rec->fd,
+				    (unsigned long long)rec->value);
+			break;
+		case EVENT_TRACE_CALLBACK_BEGIN:
+			if (!quiet)
+				printf("    begin    cb=%#llx fd=%d res=%#llx\n",
+				    (unsigned long long)rec->value,
+				    (int)rec->fd,
+				    (unsigned long long)rec->extra);
+			break;
+		case EVENT_TRACE_CALLBACK_END:
+			++n_calls;
+			cb_nsec += rec->nsec - rec->value;
+			note_callback(rec->extra, rec->nsec - rec->value);
+			if (!quiet)
+				printf("    end      cb=%#llx took %.3fus\n",
+				    (unsigned long long)rec->extra,
+				    usec(rec->nsec - rec->value));
+			break;
+		case EVENT_TRACE_DEFERRED:
+			++n_deferred_runs;
+			n_deferred += rec->extra;
+			deferred_nsec += rec->nsec - rec->value;
+			if (!quiet)
+				printf("  deferred   n=%llu took %.3fus\n",
+				    (unsigned long long)rec->extra,
+				    usec(rec->nsec - rec->value));
+			break;
+		default:
+			if (!quiet)
+				printf("unknown record type %u\n",
+				    (unsigned)rec->type);
+			break;
+		}
+	}
+
+	printf("\n%llu records over %.3fus\n", (unsigned long long)n,
+	    n ? usec(records[(first + n - 1) % hdr.n_records].nsec - t0) : 0.0);
+	printf("iterations:      %llu\n", (unsigned long long)n_loops);
+	printf("backend waits:   %llu, %.3fus total, %.3fus max\n",
+	    (unsigned long long)n_dispatches, usec(wait_total),
+	    usec(wait_max));
+	printf("fds ready:       %llu\n", (unsigned long long)n_fds);
+	printf("timeouts:        %llu\n", (unsigned long long)n_timers);
+	printf("callbacks:       %llu, %.3fus total\n",
+	    (unsigned long long)n_calls, usec(cb_nsec));
+	printf("deferred runs:   %llu, %llu callbacks, %.3fus total\n",
+	    (unsigned long long)n_deferred_runs,
+	    (unsigned long long)n_deferred, usec(deferred_nsec));
+
+	qsort(callbacks, n_callbacks, sizeof(callbacks[0]), compare_callbacks);
+	if (n_callbacks)
+		printf("\n%-18s %10s %14s %12s %12s\n", "callback", "calls",
+		    "total us", "mean us", "max us");
+	for (i = 0; i < (ev_uint64_t)n_callbacks && i < TOP_CALLBACKS; ++i) {
+		printf("%#-18llx %10llu %14.3f %12.3f %12.3f\n",
+		    (unsigned long long)callbacks[i].addr,
+		    (unsigned long long)callbacks[i].n_calls,
+		    usec(callbacks[i].total_nsec),
+		    usec(callbacks[i].total_nsec) / callbacks[i].n_calls,
+		    usec(callbacks[i].max_nsec));
+	}
+
+	free(records);
+	return 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+
+#ifdef WIN32
+#include <winsock2.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#endif
+#include <sys/types.h>
+#if !defined(WIN32) && defined(_EVENT_HAVE_SYS_TIME_H)
+#include <sys/time.h>
+#endif
+#include <sys/queue.h>
+#include <string.h>
+
+#include "event2/event.h"
+#include "event2/event_struct.h"
+#include "event-internal.h"
+#include "evthread-internal.h"
+#include "log-internal.h"
+#include "mm-internal.h"
+#include "util-internal.h"
+
+/* A piece of work handed to a pool by event_base_run_in_pool(). */
+struct event_pool_job {
+	TAILQ_ENTRY(event_pool_job) next;
+	/* Activated on the base that queued the job once it is done. */
+	struct event ev;
+	void (*work_fn)(void *);
+	void (*done_fn)(void *);
+	void *arg;
+};
+
+TAILQ_HEAD(event_pool_jobq, event_pool_job);
+
+struct event_thread_pool {
+	/* Protects every other field. */
+	void *lock;
+	/* Signalled when a job is queued, or when the pool is shutting
+	 * down. */
+	void *work_cond;
+	/* Signalled when a worker leaves the pool. */
+	void *exit_cond;
+
+	/* Jobs that no worker has started yet, oldest first. */
+	struct event_pool_jobq jobs;
+	/* The most jobs we will queue at once, or 0 for no limit. */
+	int max_queued;
+	/* True once event_thread_pool_free() has been called. */
+	int shutting_down;
+
+	int n_workers;
+	int n_running;
+	int n_queued;
+	int max_queued_seen;
+	ev_uint64_t n_submitted;
+	ev_uint64_t n_completed;
+	ev_uint64_t n_rejected;
+};
+
+struct event_thread_pool *
+event_thread_pool_new(int max_queued)
+{
+#ifndef _EVENT_DISABLE_THREAD_SUPPORT
+	struct event_thread_pool *pool;
+
+	if (max_queued < 0)
+		return NULL;
+	if ((pool = mm_calloc(1, sizeof(struct event_thread_pool))) == NULL)
+		return NULL;
+
+	EVTHREAD_ALLOC_LOCK(pool->lock, 0);
+	if (pool->lock == NULL) {
+		event_warnx("%s: locking is not enabled", __func__);
+		mm_free(pool);
+		return NULL;
+	}
+	EVTHREAD_ALLOC_COND(pool->work_cond);
+	EVTHREAD_ALLOC_COND(pool->exit_cond);
+	if (pool->work_cond == NULL || pool->exit_cond == NULL) {
+		event_warnx("%s: condition variables are not enabled",
+		    __func__);
+		EVTHREAD_FREE_COND(pool->work_cond);
+		EVTHREAD_FREE_COND(pool->exit_cond);
+		EVTHREAD_FREE_LOCK(pool->lock, 0);
+		mm_free(pool);
+		return NULL;
+	}
+
+	TAILQ_INIT(&pool->jobs);
+	pool->max_queued = max_queued;
+
+	return pool;
+#else
+	event_warnx("%s: libevent was built without thread support",
+	    __func__);
+	return NULL;
+#endif
+}
+
+/* Release a job that never ran. */
+static void
+event_pool_job_free(struct event_pool_job *job)
+{
+	struct event_base *base = job->ev.ev_base;
+
+	event_debug_unassign(&job->ev);
+	mm_free_with(base->mm, job);
+}
+
+void
+event_thread_pool_free(struct event_thread_pool *pool)
+{
+	struct event_pool_job *job;
+
+	EVLOCK_LOCK(pool->lock, 0);
+	pool->shutting_down = 1;
+	EVTHREAD_COND_BROADCAST(pool->work_cond);
+	/* The workers finish everything that is queued before they leave. */
+	while (pool->n_workers)
+		EVTHREAD_COND_WAIT(pool->exit_cond, pool->lock);
+	/* Anything still here had no worker to run it. */
+	while ((job = TAILQ_FIRST(&pool->jobs)) != NULL) {
+		TAILQ_REMOVE(&pool->jobs, job, next);
+		event_pool_job_free(job);
+	}
+	EVLOCK_UNLOCK(pool->lock, 0);
+
+	EVTHREAD_FREE_COND(pool->work_cond);
+	EVTHREAD_FREE_COND(pool->exit_cond);
+	EVTHREAD_FREE_LOCK(pool->lock, 0);
+	mm_free(pool);
+}
+
+int
+_event_thread_pool_add_workers(struct event_thread_pool *pool, int n)
+{
+	EVLOCK_LOCK(pool->lock, 0);
+	if (n > 0 && pool->shutting_down) {
+		EVLOCK_UNLOCK(pool->lock, 0);
+		return -1;
+	}
+	pool->n_workers += n;
+	if (n < 0)
+		EVTHREAD_COND_BROADCAST(pool->exit_cond);
+	EVLOCK_UNLOCK(pool->lock, 0);
+	return 0;
+}
+
+void
+_event_thread_pool_work(struct event_thread_pool *pool)
+{
+	struct event_pool_job *job;
+
+	EVLOCK_LOCK(pool->lock, 0);
+	for (;;) {
+		while (TAILQ_EMPTY(&pool->jobs) && !pool->shutting_down)
+			EVTHREAD_COND_WAIT(pool->work_cond, pool->lock);
+		if ((job = TAILQ_FIRST(&pool->jobs)) == NULL)
+			break;
+		TAILQ_REMOVE(&pool->jobs, job, next);
+		--pool->n_queued;
+		++pool->n_running;
+		EVLOCK_UNLOCK(pool->lock, 0);
+
+		job->work_fn(job->arg);
+
+		/* Count the job as completed before anyone can see its
+		 * done_fn run. */
+		EVLOCK_LOCK(pool->lock, 0);
+		--pool->n_running;
+		++pool->n_completed;
+		EVLOCK_UNLOCK(pool->lock, 0);
+
+		/* The loop frees the job once its callback has run, so we
+		 * must not touch it after this. */
+		event_active(&job->ev, EV_TIMEOUT, 1);
+
+		EVLOCK_LOCK(pool->lock, 0);
+	}
+
+	--pool->n_workers;
+	EVTHREAD_COND_BROADCAST(pool->exit_cond);
+	EVLOCK_UNLOCK(pool->lock, 0);
+}
+
+int
+event_thread_pool_run_worker(struct event_thread_pool *pool)
+{
+	if (_event_thread_pool_add_workers(pool, 1) < 0)
+		return -1;
+	_event_thread_pool_work(pool);
+	return 0;
+}
+
+/* Runs on the loop of the base that queued the job, once it is done. */
+static void
+event_pool_job_done_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct event_pool_job *job = arg;
+
+	if (job->done_fn)
+		job->done_fn(job->arg);
+	event_pool_job_free(job);
+}
+
+int
+event_base_run_in_pool(struct event_base *base,
+    struct event_thread_pool *pool, void (*work_fn)(void *),
+    void (*done_fn)(void *), void *arg)
+{
+	struct event_pool_job *job;
+
+	if (!base || !pool || !work_fn)
+		return -1;
+
+	job = mm_calloc_with(base->mm, 1, sizeof(struct event_pool_job));
+	if (job == NULL)
+		return -1;
+	job->work_fn = work_fn;
+	job->done_fn = done_fn;
+	job->arg = arg;
+	/* Keep the completion on this base's own thread, even if the base
+	 * belongs to a group. */
+	event_assign(&job->ev, base, -1, EV_PINNED, event_pool_job_done_cb,
+	    job);
+
+	EVLOCK_LOCK(pool->lock, 0);
+	if (pool->shutting_down ||
+	    (pool->max_queued && pool->n_queued >= pool->max_queued)) {
+		++pool->n_rejected;
+		EVLOCK_UNLOCK(pool->lock, 0);
+		event_pool_job_free(job);
+		return -1;
+	}
+	TAILQ_INSERT_TAIL(&pool->jobs, job, next);
+	if (++pool->n_queued > pool->max_queued_seen)
+		pool->max_queued_seen = pool->n_queued;
+	++pool->n_submitted;
+	EVTHREAD_COND_SIGNAL(pool->work_cond);
+	EVLOCK_UNLOCK(pool->lock, 0);
+
+	return 0;
+}
+
+int
+event_thread_pool_get_stats(struct event_thread_pool *pool,
+    struct event_thread_pool_stats *stats)
+{
+	if (!pool || !stats)
+		return -1;
+
+	EVLOCK_LOCK(pool->lock, 0);
+	stats->n_workers = pool->n_workers;
+	stats->n_running = pool->n_running;
+	stats->n_queued = pool->n_queued;
+	stats->max_queued_seen = pool->max_queued_seen;
+	stats->n_submitted = pool->n_submitted;
+	stats->n_completed = pool->n_completed;
+	stats->n_rejected = pool->n_rejected;
+	EVLOCK_UNLOCK(pool->lock, 0);
+
+	return 0;
+}
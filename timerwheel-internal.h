@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _TIMERWHEEL_INTERNAL_H_
+#define _TIMERWHEEL_INTERNAL_H_
+
+/** @file timerwheel-internal.h
+
+  A hierarchical timing wheel: an alternative to the minheap for storing
+  events with timeouts.  Adding or removing a timeout is O(1); the price is
+  that deadlines are rounded up to the next TIMERWHEEL_TICK_USEC, and that
+  events with distant deadlines get moved ("cascaded") to a lower level of
+  the wheel a few times before they expire.
+
+  Level 0 of the wheel has one slot per tick; each slot of level N covers
+  TIMERWHEEL_SLOTS slots of level N-1.  Each slot is a doubly-linked list of
+  events, threaded through ev_timeout_pos.ev_next_with_common_timeout, so
+  that we never need to allocate memory for an event in the wheel.
+
+  As with the minheap, these functions require the lock on the corresponding
+  event_base to be held.
+ */
+
+#include "event2/event-config.h"
+#include "event2/util.h"
+
+struct event;
+struct timeval;
+
+/** The granularity of the wheel, in microseconds. */
+#define TIMERWHEEL_TICK_USEC 1000
+/** Number of bits of the tick counter that each level of the wheel covers. */
+#define TIMERWHEEL_SLOT_BITS 6
+/** Number of slots in each level of the wheel. */
+#define TIMERWHEEL_SLOTS (1<<TIMERWHEEL_SLOT_BITS)
+/** Number of levels in the wheel.  With millisecond ticks, six levels of 64
+ * slots reach a little over two years into the future; anything further out
+ * than that gets parked in the top level and rescheduled when it comes
+ * around. */
+#define TIMERWHEEL_LEVELS 6
+
+struct timerwheel {
+	/** Heads of the per-slot event lists. */
+	struct event *slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+	/** Bit N of pending[L] is set iff slots[L][N] is nonempty. */
+	ev_uint64_t pending[TIMERWHEEL_LEVELS];
+	/** Events whose deadline has already passed, in the order that they
+	 * expired. */
+	struct event *expired;
+	/** The next-pointer of the last event on the expired list. */
+	struct event **expired_tail;
+	/** The last tick we have processed: every event with a deadline at or
+	 * before this tick is on the expired list. */
+	ev_uint64_t curtick;
+	/** The tick that we last told the event loop to wake up at.  Adding an
+	 * event that expires earlier than this needs to wake up the loop. */
+	ev_uint64_t wake_tick;
+	/** Number of events in the wheel, including expired ones. */
+	unsigned n;
+};
+
+/** Initialize 'w' so that its current time is 'now'. */
+void timerwheel_init(struct timerwheel *w, const struct timeval *now);
+/** Return the number of events stored in 'w'. */
+unsigned timerwheel_size(const struct timerwheel *w);
+/** Add 'ev' to 'w', using ev->ev_timeout as its deadline.  Return 0 on
+ * success.  This never allocates memory, and so never fails. */
+int timerwheel_push(struct timerwheel *w, struct event *ev);
+/** Return true iff 'ev' expires before the time at which we last told the
+ * event loop to wake up. */
+int timerwheel_elt_is_early(const struct timerwheel *w,
+    const struct event *ev);
+/** Remove 'ev' from 'w'. */
+void timerwheel_erase(struct timerwheel *w, struct event *ev);
+/** Move every event in 'w' whose deadline is no later than 'now' onto the
+ * expired list. */
+void timerwheel_advance(struct timerwheel *w, const struct timeval *now);
+/** Return the first event on the expired list of 'w', or NULL if there is
+ * none. */
+struct event *timerwheel_first_expired(struct timerwheel *w);
+/** Return an arbitrary event in 'w', or NULL if 'w' is empty. */
+struct event *timerwheel_any(struct timerwheel *w);
+/** Set 'tv' to the earliest time at which 'w' will need attention, and
+ * remember it as the time at which the event loop will wake up.  This may
+ * be earlier than the first deadline in the wheel, if some events need to
+ * be moved to a lower level.  Return 0 on success, or -1 if 'w' is empty.
+ */
+int timerwheel_next_timeout(struct timerwheel *w, struct timeval *tv);
+/** Subtract 'off' from the deadline of every event in 'w', and reset the
+ * current time of 'w' to 'now'.  Used when the clock jumps backwards. */
+void timerwheel_adjust(struct timerwheel *w, const struct timeval *off,
+    const struct timeval *now);
+
+#endif /* _TIMERWHEEL_INTERNAL_H_ */
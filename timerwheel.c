@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+
+#ifdef WIN32
+#include <winsock2.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#endif
+#include <sys/types.h>
+#if !defined(WIN32) && defined(_EVENT_HAVE_SYS_TIME_H)
+#include <sys/time.h>
+#endif
+#include <sys/queue.h>
+#include <string.h>
+
+#include "event2/event_struct.h"
+#include "event-internal.h"
+#include "timerwheel-internal.h"
+#include "util-internal.h"
+
+/* The list linkage we use for events in the wheel.  It is never in use for
+ * anything else while the event is in the wheel: events with common timeouts
+ * never get here. */
+#define TW_LINK(ev) ((ev)->ev_timeout_pos.ev_next_with_common_timeout)
+
+#define TW_SLOT_MASK (TIMERWHEEL_SLOTS-1)
+#define TW_SHIFT(level) (TIMERWHEEL_SLOT_BITS*(level))
+/* The furthest into the future (in ticks) that the wheel can represent. */
+#define TW_MAX_DELTA \
+	((((ev_uint64_t)1) << TW_SHIFT(TIMERWHEEL_LEVELS)) - 1)
+
+/* Helpers to convert between timevals and ticks.  Deadlines are rounded up,
+ * and the current time is rounded down, so that we never report an event
+ * as expired before its deadline. */
+static inline ev_uint64_t
+tv_to_tick_floor(const struct timeval *tv)
+{
+	return ((ev_uint64_t)tv->tv_sec * 1000000 + tv->tv_usec) /
+	    TIMERWHEEL_TICK_USEC;
+}
+
+static inline ev_uint64_t
+tv_to_tick_ceil(const struct timeval *tv)
+{
+	return ((ev_uint64_t)tv->tv_sec * 1000000 + tv->tv_usec +
+	    TIMERWHEEL_TICK_USEC - 1) / TIMERWHEEL_TICK_USEC;
+}
+
+static inline void
+tick_to_tv(ev_uint64_t tick, struct timeval *tv)
+{
+	ev_uint64_t usec = tick * TIMERWHEEL_TICK_USEC;
+	tv->tv_sec = (long)(usec / 1000000);
+	tv->tv_usec = (long)(usec % 1000000);
+}
+
+/* Bit-twiddling helpers for the pending bitmaps. */
+static inline int
+tw_ctz(ev_uint64_t v)
+{
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+	return __builtin_ctzll(v);
+#else
+	int n = 0;
+	while (!(v & 1)) {
+		v >>= 1;
+		++n;
+	}
+	return n;
+#endif
+}
+
+static inline ev_uint64_t
+tw_rotr(ev_uint64_t v, int n)
+{
+	n &= TW_SLOT_MASK;
+	return n ? (v >> n) | (v << (TIMERWHEEL_SLOTS - n)) : v;
+}
+
+static inline ev_uint64_t
+tw_rotl(ev_uint64_t v, int n)
+{
+	n &= TW_SLOT_MASK;
+	return n ? (v << n) | (v >> (TIMERWHEEL_SLOTS - n)) : v;
+}
+
+/* Push 'ev' onto the front of the list whose head is at 'head'. */
+static inline void
+tw_link_head(struct event **head, struct event *ev)
+{
+	TW_LINK(ev).tqe_next = *head;
+	if (*head)
+		TW_LINK(*head).tqe_prev = &TW_LINK(ev).tqe_next;
+	*head = ev;
+	TW_LINK(ev).tqe_prev = head;
+}
+
+/* Append 'ev' to the list of expired events. */
+static inline void
+tw_link_expired(struct timerwheel *w, struct event *ev)
+{
+	TW_LINK(ev).tqe_next = NULL;
+	TW_LINK(ev).tqe_prev = w->expired_tail;
+	*w->expired_tail = ev;
+	w->expired_tail = &TW_LINK(ev).tqe_next;
+}
+
+/* Remove 'ev' from whatever list it is on, clearing the pending bit of its
+ * slot if the slot becomes empty. */
+static void
+tw_unlink(struct timerwheel *w, struct event *ev)
+{
+	struct event *next = TW_LINK(ev).tqe_next;
+	struct event **prev = TW_LINK(ev).tqe_prev;
+
+	*prev = next;
+	if (next) {
+		TW_LINK(next).tqe_prev = prev;
+		return;
+	}
+	if (w->expired_tail == &TW_LINK(ev).tqe_next) {
+		w->expired_tail = prev;
+	} else if (prev >= &w->slots[0][0] &&
+	    prev < &w->slots[0][0] + TIMERWHEEL_LEVELS*TIMERWHEEL_SLOTS) {
+		/* 'prev' is the head of a slot, and nothing follows 'ev':
+		 * the slot is now empty. */
+		int idx = (int)(prev - &w->slots[0][0]);
+		w->pending[idx / TIMERWHEEL_SLOTS] &=
+		    ~(((ev_uint64_t)1) << (idx % TIMERWHEEL_SLOTS));
+	}
+}
+
+/* Put 'ev' into the right slot for its deadline, given the current tick of
+ * 'w'. */
+static void
+tw_insert(struct timerwheel *w, struct event *ev)
+{
+	ev_uint64_t tick = tv_to_tick_ceil(&ev->ev_timeout);
+	ev_uint64_t delta;
+	int level = 0, slot;
+
+	if (tick <= w->curtick) {
+		tw_link_expired(w, ev);
+		return;
+	}
+
+	delta = tick - w->curtick;
+	if (delta > TW_MAX_DELTA) {
+		/* Too far in the future to represent: park it at the very
+		 * end of the wheel.  We'll look at its real deadline again
+		 * when it gets cascaded. */
+		delta = TW_MAX_DELTA;
+		tick = w->curtick + delta;
+	}
+	while (delta >> TW_SHIFT(level+1))
+		++level;
+
+	slot = (int)((tick >> TW_SHIFT(level)) & TW_SLOT_MASK);
+	tw_link_head(&w->slots[level][slot], ev);
+	w->pending[level] |= ((ev_uint64_t)1) << slot;
+}
+
+void
+timerwheel_init(struct timerwheel *w, const struct timeval *now)
+{
+	memset(w, 0, sizeof(*w));
+	w->expired_tail = &w->expired;
+	w->curtick = tv_to_tick_floor(now);
+	w->wake_tick = EV_UINT64_MAX;
+}
+
+unsigned
+timerwheel_size(const struct timerwheel *w)
+{
+	return w->n;
+}
+
+int
+timerwheel_push(struct timerwheel *w, struct event *ev)
+{
+	tw_insert(w, ev);
+	++w->n;
+	return 0;
+}
+
+int
+timerwheel_elt_is_early(const struct timerwheel *w, const struct event *ev)
+{
+	return tv_to_tick_ceil(&ev->ev_timeout) < w->wake_tick;
+}
+
+void
+timerwheel_erase(struct timerwheel *w, struct event *ev)
+{
+	EVUTIL_ASSERT(w->n > 0);
+	tw_unlink(w, ev);
+	--w->n;
+}
+
+struct event *
+timerwheel_first_expired(struct timerwheel *w)
+{
+	return w->expired;
+}
+
+struct event *
+timerwheel_any(struct timerwheel *w)
+{
+	int level;
+	if (w->expired)
+		return w->expired;
+	for (level = 0; level < TIMERWHEEL_LEVELS; ++level) {
+		if (w->pending[level])
+			return w->slots[level][tw_ctz(w->pending[level])];
+	}
+	return NULL;
+}
+
+void
+timerwheel_advance(struct timerwheel *w, const struct timeval *now)
+{
+	ev_uint64_t nowtick = tv_to_tick_floor(now);
+	struct event *todo = NULL, *ev;
+	int level;
+
+	if (nowtick <= w->curtick)
+		return;
+
+	for (level = 0; level < TIMERWHEEL_LEVELS; ++level) {
+		/* The slots of this level whose start we have reached since
+		 * the last time we were called are the ones with indices in
+		 * (curtick>>shift, nowtick>>shift]. */
+		ev_uint64_t first = (w->curtick >> TW_SHIFT(level)) + 1;
+		ev_uint64_t n_crossed =
+		    (nowtick >> TW_SHIFT(level)) - (first - 1);
+		int start = (int)(first & TW_SLOT_MASK);
+		ev_uint64_t crossed, bits;
+
+		if (!n_crossed)
+			break; /* No higher level can have moved either. */
+		if (n_crossed >= TIMERWHEEL_SLOTS)
+			crossed = ~(ev_uint64_t)0;
+		else
+			crossed = tw_rotl(
+			    (((ev_uint64_t)1) << n_crossed) - 1, start);
+
+		/* Walk the crossed slots in the order we reached them, so
+		 * that level 0 expires its events in deadline order. */
+		bits = tw_rotr(w->pending[level] & crossed, start);
+		while (bits) {
+			int slot = (start + tw_ctz(bits)) & TW_SLOT_MASK;
+			struct event **head = &w->slots[level][slot];
+			while ((ev = *head)) {
+				*head = TW_LINK(ev).tqe_next;
+				if (level == 0) {
+					/* Everything in a crossed level-0
+					 * slot has expired. */
+					tw_link_expired(w, ev);
+				} else {
+					TW_LINK(ev).tqe_next = todo;
+					todo = ev;
+				}
+			}
+			w->pending[level] &= ~(((ev_uint64_t)1) << slot);
+			bits &= bits - 1;
+		}
+	}
+
+	w->curtick = nowtick;
+
+	/* Cascade: reschedule everything from the higher-level slots that we
+	 * crossed relative to the new current time. */
+	while ((ev = todo)) {
+		todo = TW_LINK(ev).tqe_next;
+		tw_insert(w, ev);
+	}
+}
+
+int
+timerwheel_next_timeout(struct timerwheel *w, struct timeval *tv)
+{
+	ev_uint64_t best = EV_UINT64_MAX;
+	int level;
+
+	if (w->expired) {
+		best = w->curtick;
+	} else {
+		for (level = 0; level < TIMERWHEEL_LEVELS; ++level) {
+			ev_uint64_t pos, tick;
+			int r;
+			if (!w->pending[level])
+				continue;
+			/* Find the first nonempty slot after the current
+			 * position at this level; we need to look at it
+			 * when we reach its start. */
+			pos = w->curtick >> TW_SHIFT(level);
+			r = tw_ctz(tw_rotr(w->pending[level],
+				(int)((pos + 1) & TW_SLOT_MASK))) + 1;
+			tick = (pos + r) << TW_SHIFT(level);
+			if (tick < best)
+				best = tick;
+		}
+	}
+
+	w->wake_tick = best;
+	if (best == EV_UINT64_MAX)
+		return -1;
+	tick_to_tv(best, tv);
+	return 0;
+}
+
+void
+timerwheel_adjust(struct timerwheel *w, const struct timeval *off,
+    const struct timeval *now)
+{
+	struct event *todo = NULL, *ev;
+	int level, slot;
+
+	while ((ev = w->expired)) {
+		w->expired = TW_LINK(ev).tqe_next;
+		TW_LINK(ev).tqe_next = todo;
+		todo = ev;
+	}
+	w->expired_tail = &w->expired;
+	for (level = 0; level < TIMERWHEEL_LEVELS; ++level) {
+		for (slot = 0; slot < TIMERWHEEL_SLOTS; ++slot) {
+			while ((ev = w->slots[level][slot])) {
+				w->slots[level][slot] = TW_LINK(ev).tqe_next;
+				TW_LINK(ev).tqe_next = todo;
+				todo = ev;
+			}
+		}
+		w->pending[level] = 0;
+	}
+
+	w->curtick = tv_to_tick_floor(now);
+	w->wake_tick = EV_UINT64_MAX;
+	while ((ev = todo)) {
+		todo = TW_LINK(ev).tqe_next;
+		evutil_timersub(&ev->ev_timeout, off, &ev->ev_timeout);
+		tw_insert(w, ev);
+	}
+}
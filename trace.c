@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+
+#ifdef WIN32
+#include <winsock2.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#include <io.h>
+#endif
+#include <sys/types.h>
+#if !defined(WIN32) && defined(_EVENT_HAVE_SYS_TIME_H)
+#include <sys/time.h>
+#endif
+#ifdef _EVENT_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef _EVENT_HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef _EVENT_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/queue.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "event2/event.h"
+#include "event2/event_struct.h"
+#include "event2/util.h"
+#include "event-internal.h"
+#include "evthread-internal.h"
+#include "log-internal.h"
+#include "mm-internal.h"
+#include "util-internal.h"
+
+#if defined(_EVENT_HAVE_MMAP) && defined(_EVENT_HAVE_FCNTL_H) && \
+    defined(_EVENT_HAVE_UNISTD_H)
+#define USE_TRACE_MMAP
+#endif
+
+/* A trace: the header and ring of records, laid out as in the file. */
+struct event_trace {
+	/* Where the header is; the records follow it. */
+	struct event_trace_header *hdr;
+	struct event_trace_record *records;
+	/* How many bytes hdr points to. */
+	size_t len;
+	/* True if hdr is mapped from a file, rather than allocated. */
+	int mapped;
+};
+
+ev_uint64_t
+_event_trace_now(void)
+{
+	struct timeval tv;
+#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (ev_uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+	evutil_gettimeofday(&tv, NULL);
+	return (ev_uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+static void
+trace_free(struct event_trace *trace)
+{
+#ifdef USE_TRACE_MMAP
+	if (trace->mapped)
+		munmap((void *)trace->hdr, trace->len);
+	else
+#endif
+		mm_free(trace->hdr);
+	mm_free(trace);
+}
+
+/* Map 'len' bytes of a new file at 'path' into memory.  Returns NULL on
+ * failure. */
+static void *
+trace_map_file(const char *path, size_t len)
+{
+#ifdef USE_TRACE_MMAP
+	void *p;
+	int fd;
+
+	if ((fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0600)) < 0) {
+		event_warn("%s: open(%s)", __func__, path);
+		return NULL;
+	}
+	if (ftruncate(fd, len) < 0) {
+		event_warn("%s: ftruncate", __func__);
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		event_warn("%s: mmap", __func__);
+		return NULL;
+	}
+	return p;
+#else
+	event_warnx("%s: no mmap() on this platform", __func__);
+	return NULL;
+#endif
+}
+
+int
+event_base_trace_start(struct event_base *base, unsigned n_records,
+    const char *path)
+{
+	struct event_trace *trace, *old;
+	size_t len;
+
+	/* Do the size check in 64 bits, where it cannot overflow; it can
+	 * only fail where size_t is narrower than that. */
+	if (n_records == 0 ||
+	    (ev_uint64_t)n_records * sizeof(struct event_trace_record) >
+	    (ev_uint64_t)(EV_SIZE_MAX - sizeof(struct event_trace_header)))
+		return -1;
+	len = sizeof(struct event_trace_header) +
+	    (size_t)n_records * sizeof(struct event_trace_record);
+
+	if ((trace = mm_calloc(1, sizeof(struct event_trace))) == NULL)
+		return -1;
+	trace->len = len;
+	if (path) {
+		trace->hdr = trace_map_file(path, len);
+		trace->mapped = 1;
+	} else {
+		trace->hdr = mm_malloc(len);
+	}
+	if (trace->hdr == NULL) {
+		mm_free(trace);
+		return -1;
+	}
+	memset(trace->hdr, 0, sizeof(struct event_trace_header));
+	memcpy(trace->hdr->magic, EVENT_TRACE_MAGIC, 8);
+	trace->hdr->header_size = sizeof(struct event_trace_header);
+	trace->hdr->record_size = sizeof(struct event_trace_record);
+	trace->hdr->n_records = n_records;
+	trace->records = (struct event_trace_record *)(trace->hdr + 1);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	old = base->trace;
+	base->trace = trace;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	if (old)
+		trace_free(old);
+	return 0;
+}
+
+void
+event_base_trace_stop(struct event_base *base)
+{
+	struct event_trace *trace;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	trace = base->trace;
+	base->trace = NULL;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	if (trace)
+		trace_free(trace);
+}
+
+void
+_event_trace_free(struct event_base *base)
+{
+	if (base->trace) {
+		trace_free(base->trace);
+		base->trace = NULL;
+	}
+}
+
+/* Write all of 'len' bytes at 'p' to 'fd'. */
+static int
+trace_write_all(int fd, const void *p, size_t len)
+{
+	const char *cp = p;
+
+	while (len) {
+#ifdef WIN32
+		int r = _write(fd, cp, (unsigned)len);
+#else
+		ssize_t r = write(fd, cp, len);
+#endif
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		cp += r;
+		len -= r;
+	}
+	return 0;
+}
+
+int
+event_base_trace_flush(struct event_base *base, int fd)
+{
+	struct event_trace *trace;
+	struct event_trace_header hdr;
+	ev_uint64_t n, first;
+	int r = -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (!(trace = base->trace))
+		goto done;
+
+	/* Write the records out oldest first, so the file never wraps. */
+	hdr = *trace->hdr;
+	n = hdr.n_written < hdr.n_records ? hdr.n_written : hdr.n_records;
+	first = hdr.n_written - n;
+	hdr.n_records = hdr.n_written = n;
+
+	if (trace_write_all(fd, &hdr, sizeof(hdr)) < 0)
+		goto done;
+	if (n) {
+		size_t start = (size_t)(first % trace->hdr->n_records);
+		size_t tail = (size_t)trace->hdr->n_records - start;
+		if (tail > n)
+			tail = (size_t)n;
+		if (trace_write_all(fd, trace->records + start,
+			tail * sizeof(struct event_trace_record)) < 0 ||
+		    trace_write_all(fd, trace->records,
+			((size_t)n - tail) * sizeof(struct event_trace_record))
+		    < 0)
+			goto done;
+	}
+
+	trace->hdr->n_written = 0;
+	r = 0;
+done:
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
+ev_uint64_t
+_event_trace_record(struct event_base *base, int type, evutil_socket_t fd,
+    ev_uint64_t value, ev_uint64_t extra)
+{
+	struct event_trace *trace = base->trace;
+	struct event_trace_header *hdr = trace->hdr;
+	struct event_trace_record *rec;
+
+	rec = &trace->records[hdr->n_written % hdr->n_records];
+	rec->nsec = _event_trace_now();
+	rec->value = value;
+	rec->extra = extra;
+	rec->fd = (ev_int32_t)fd;
+	rec->type = type;
+	/* Count the record only once it is all there, for the benefit of
+	 * anyone reading a mapped trace as we go. */
+	++hdr->n_written;
+	return rec->nsec;
+}
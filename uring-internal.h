@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2009-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EVENT_URING_INTERNAL_H
+#define _EVENT_URING_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "event2/event-config.h"
+#include "event2/util.h"
+#include "defer-internal.h"
+
+/* This whole file only matters when the io_uring backend is built; it
+ * plays the same role for it that iocp-internal.h plays for IOCP. */
+#ifdef _EVENT_HAVE_IO_URING
+
+#include <sys/uio.h>
+
+struct event_base;
+struct bufferevent;
+struct evbuffer;
+struct evbuffer_chain;
+struct event_uring_op;
+typedef void (*uring_callback)(struct event_uring_op *, int res);
+
+/**
+   Internal use only.  An I/O operation submitted to the io_uring of an
+   event_base.  When the kernel completes the operation, the result (a
+   byte count, or a negative errno value) is stored in 'res' and 'cb' is
+   run from the event loop as a deferred callback, without the base lock
+   held.
+ */
+struct event_uring_op {
+	struct deferred_cb deferred;
+	uring_callback cb;
+	int res;
+};
+
+/** Initialize the fields in an event_uring_op. */
+void event_uring_op_init(struct event_uring_op *op, uring_callback cb);
+
+/** Return true iff 'base' is using the io_uring backend. */
+int event_base_uses_uring(struct event_base *base);
+
+/** Queue a readv or writev on 'fd' using the io_uring of 'base'.  The
+    iovecs must stay valid until the operation completes.  Operations
+    queued from the loop thread are submitted along with the next
+    dispatch; others are submitted immediately.
+
+    @return 0 on success, -1 if the base does not use io_uring or the
+	submission queue is full.
+ */
+int event_uring_readv(struct event_base *base, evutil_socket_t fd,
+    const struct iovec *iov, int n_iov, struct event_uring_op *op);
+int event_uring_writev(struct event_base *base, evutil_socket_t fd,
+    const struct iovec *iov, int n_iov, struct event_uring_op *op);
+
+/** Ask the kernel to cancel 'op'.  The op still completes (with
+    -ECANCELED if the cancellation won), so its callback still runs. */
+int event_uring_cancel(struct event_base *base, struct event_uring_op *op);
+
+#define URING_MAX_IOVEC 16
+
+/** The state of an io_uring read into, or write from, an evbuffer. */
+struct evbuffer_uring_io {
+	struct event_uring_op op;
+	/** The first pinned chain in the buffer. */
+	struct evbuffer_chain *first_pinned;
+	/** How many chains are pinned; how many of the fields in buffers
+	 * are we using. */
+	int n_buffers;
+	struct iovec buffers[URING_MAX_IOVEC];
+};
+
+/** Start reading up to 'at_most' bytes from 'fd' directly into free space
+    at the end of 'buf'.  While the read is in progress, no other data may
+    be added to the end of the buffer.  evbuffer_uring_commit_read() must
+    be called from the completion callback of io->op.
+
+    @return 0 on success, -1 on error.
+ */
+int evbuffer_uring_launch_read(struct evbuffer *buf, struct event_base *base,
+    evutil_socket_t fd, size_t at_most, struct evbuffer_uring_io *io);
+
+/** Start writing up to 'at_most' bytes from the start of 'buf' to 'fd',
+    straight out of its chains.  While the write is in progress, no data
+    may be removed from the front of the buffer.
+    evbuffer_uring_commit_write() must be called from the completion
+    callback of io->op.
+
+    @return 0 on success, -1 on error.
+ */
+int evbuffer_uring_launch_write(struct evbuffer *buf, struct event_base *base,
+    evutil_socket_t fd, ev_ssize_t at_most, struct evbuffer_uring_io *io);
+
+/** Finish a read or write started with evbuffer_uring_launch_*(), given
+    the number of bytes the kernel transferred. */
+void evbuffer_uring_commit_read(struct evbuffer *buf,
+    struct evbuffer_uring_io *io, ev_ssize_t nbytes);
+void evbuffer_uring_commit_write(struct evbuffer *buf,
+    struct evbuffer_uring_io *io, ev_ssize_t nbytes);
+
+/** Return true iff bufferevent_socket_new() on 'base' should create a
+    completion-based bufferevent. */
+int event_base_wants_uring_bufferevents(struct event_base *base);
+
+/** Create a bufferevent that does its socket I/O by posting reads and
+    writes to the io_uring of 'base'. */
+struct bufferevent *bufferevent_uring_new(struct event_base *base,
+    evutil_socket_t fd, int options);
+
+/** Tell a completion-based bufferevent that its socket has connected. */
+void bufferevent_uring_set_connected(struct bufferevent *bev);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -92,6 +92,7 @@ struct eventop win32ops = {
 	0, /* doesn't need reinit */
 	0, /* No features supported. */
 	sizeof(struct idx_info),
+	NULL, /* rearm */
 };
 
 #define FD_SET_ALLOC_SIZE(n) ((sizeof(struct win_fd_set) + ((n)-1)*sizeof(SOCKET)))